@@ -0,0 +1,141 @@
+/*
+
+ * Description:
+   The client's acknowledgement stage. See ack_receiver.h.
+
+ */
+
+#include "ack_receiver.h"
+#include "socket_tuning.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+// How often the receiving thread wakes up from an idle socket to see whether it should stop.
+#define ACK_STOP_CHECK_MS 100
+
+bool ack_receiver::start(int socket_fd) {
+
+    this->socket_fd = socket_fd;
+
+    event_fd = eventfd(0, EFD_NONBLOCK);
+    if (event_fd == -1) {
+        perror("(client) error when calling eventfd");
+        return false;
+    }
+
+    struct timeval wait_time;
+    wait_time.tv_sec = 0;
+    wait_time.tv_usec = ACK_STOP_CHECK_MS * 1000;
+
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &wait_time, sizeof(struct timeval)) == -1) {
+        perror("(client) error when calling setsockopt (SO_RCVTIMEO)");
+        close(event_fd);
+        event_fd = -1;
+        return false;
+    }
+
+    stopping = false;
+    receiver = std::thread(&ack_receiver::receive_loop, this);
+    return true;
+}
+
+void ack_receiver::stop() {
+
+    if (receiver.joinable()) {
+        stopping = true;
+        receiver.join();
+    }
+
+    if (event_fd != -1) {
+        close(event_fd);
+        event_fd = -1;
+    }
+}
+
+void ack_receiver::receive_loop() {
+
+    ack_datagram datagram;
+    uint64_t one = 1;
+
+    while (!stopping.load()) {
+
+        memset(datagram.data, '\0', sizeof(datagram.data));
+        int num_bytes = receive_datagram(socket_fd, datagram.data, sizeof(datagram.data) - 1, 0, NULL, NULL, NULL);
+
+        if (num_bytes == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+            perror("(client) error when calling recvfrom");
+            exit(EXIT_FAILURE);
+        }
+
+        datagram.length = num_bytes;
+
+        int attempts = 0;
+        while (!datagrams.push(datagram)) {
+            if (stopping.load()) return;
+            queue_backoff(attempts);
+        }
+
+        if (write(event_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+            perror("(client) error when writing to the eventfd");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int ack_receiver::receive(char *buffer, int buffer_length, int timeout_ms) {
+
+    struct timespec now, deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    ack_datagram datagram;
+
+    // The receiving thread queues the datagram before it signals the eventfd, so a datagram queued after the pop below
+    // found nothing always wakes up the poll() that follows.
+    while (!datagrams.pop(datagram)) {
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long remaining_ms = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+
+        if (remaining_ms <= 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        struct pollfd event;
+        event.fd = event_fd;
+        event.events = POLLIN;
+
+        if (poll(&event, 1, remaining_ms) == -1 && errno != EINTR) {
+            perror("(client) error when calling poll");
+            exit(EXIT_FAILURE);
+        }
+
+        uint64_t count;
+        if (read(event_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+            perror("(client) error when reading the eventfd");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int length = datagram.length < buffer_length - 1 ? datagram.length : buffer_length - 1;
+    memcpy(buffer, datagram.data, length);
+    buffer[length] = '\0';
+
+    return length;
+}
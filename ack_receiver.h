@@ -0,0 +1,54 @@
+/*
+
+ * Description:
+   The client's acknowledgement stage (--threads 2 or more). A thread of its own blocks on the listener socket, reads
+   each acknowledgement as soon as it arrives and queues it for the sending thread, which applies it to the window.
+   The sender waits on an eventfd instead of the socket, so sending a window and taking acknowledgements off the
+   socket no longer hold each other up.
+
+ */
+
+#ifndef ACK_RECEIVER_H
+#define ACK_RECEIVER_H
+
+#include <atomic>
+#include <thread>
+#include "spsc_queue.h"
+
+// Acknowledgements and EOT packets are short; anything longer, such as a late SYN-ACK, is cut to this length, which
+// still keeps its packet type.
+#define ACK_DATAGRAM_LENGTH 64
+
+#define ACK_QUEUE_LENGTH 1024
+
+struct ack_datagram {
+    int length;
+    char data[ACK_DATAGRAM_LENGTH];
+};
+
+class ack_receiver {
+
+private:
+
+    int socket_fd = -1;
+    int event_fd = -1;
+    std::thread receiver;
+    std::atomic<bool> stopping{false};
+    spsc_queue<ack_datagram> datagrams{ACK_QUEUE_LENGTH};
+
+    void receive_loop();
+
+public:
+
+    ~ack_receiver() { stop(); }
+
+    bool start(int socket_fd);
+    void stop();
+    bool running() const { return receiver.joinable(); }
+
+    // Like recvfrom() with a timeout: copies the next datagram into buffer and returns its length, or returns -1 with
+    // errno set to EAGAIN if none arrives within timeout_ms.
+    int receive(char *buffer, int buffer_length, int timeout_ms);
+};
+
+#endif
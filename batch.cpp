@@ -0,0 +1,319 @@
+/*
+
+ * Description:
+   Batch transfers. See batch.h.
+
+ */
+
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+using namespace std;
+
+#define MAX_MANIFEST_LINE 4096
+
+bool is_directory(const string &path) {
+
+    struct stat path_status;
+    return stat(path.c_str(), &path_status) == 0 && S_ISDIR(path_status.st_mode);
+}
+
+// Adds the regular files below directory/prefix to entries. Symbolic links to directories are not followed, so a link
+// loop cannot make the listing endless.
+static bool list_directory(const string &directory, const string &prefix, vector<batch_entry> &entries) {
+
+    string path = prefix.empty() ? directory : directory + "/" + prefix;
+    DIR *listing = opendir(path.c_str());
+
+    if (listing == NULL) {
+        perror(("(client) error when listing " + path).c_str());
+        return false;
+    }
+
+    bool listed = true;
+    struct dirent *entry;
+
+    while (listed && (entry = readdir(listing)) != NULL) {
+
+        string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+
+        string relative_path = prefix.empty() ? name : prefix + "/" + name;
+        string full_path = directory + "/" + relative_path;
+        struct stat entry_status;
+
+        if (lstat(full_path.c_str(), &entry_status) == -1) continue;
+
+        if (S_ISDIR(entry_status.st_mode)) {
+            listed = list_directory(directory, relative_path, entries);
+        } else if (stat(full_path.c_str(), &entry_status) == 0 && S_ISREG(entry_status.st_mode)) {
+
+            if (relative_path.find('\n') != string::npos) {
+                fprintf(stderr, "(client) skipping %s: newline in file name\n", full_path.c_str());
+                continue;
+            }
+
+            entries.push_back({relative_path, (long long) entry_status.st_size});
+        }
+    }
+
+    closedir(listing);
+    return listed;
+}
+
+// Lists every regular file below directory, sorted by path so the same directory always gives the same stream.
+bool list_batch_files(const string &directory, vector<batch_entry> &entries) {
+
+    entries.clear();
+    if (!list_directory(directory, "", entries)) return false;
+
+    sort(entries.begin(), entries.end(), [](const batch_entry &a, const batch_entry &b) { return a.path < b.path; });
+    return true;
+}
+
+bool batch_source::open(const string &directory_name) {
+
+    directory = directory_name;
+
+    if (!list_batch_files(directory, entries)) return false;
+
+    manifest = string(BATCH_MANIFEST_TAG) + " " + to_string(entries.size()) + "\n";
+    for (const batch_entry &entry : entries) {
+        manifest += to_string(entry.size) + " " + entry.path + "\n";
+    }
+
+    stream_size = manifest.size();
+    entry_offsets.clear();
+
+    for (const batch_entry &entry : entries) {
+        entry_offsets.push_back(stream_size);
+        stream_size += entry.size;
+    }
+
+    return true;
+}
+
+int batch_source::read_at(long long offset, char *buffer, int length) {
+
+    int copied = 0;
+
+    while (copied < length && offset < stream_size) {
+
+        int block_length;
+
+        if (offset < (long long) manifest.size()) {
+
+            block_length = min((long long) length - copied, (long long) manifest.size() - offset);
+            memcpy(buffer + copied, manifest.data() + offset, block_length);
+
+        } else {
+
+            // The file holding offset is the last one starting at or before it; empty files before it share its start.
+            int index = upper_bound(entry_offsets.begin(), entry_offsets.end(), offset) - entry_offsets.begin() - 1;
+
+            if (index != open_entry) {
+                entry_file.close();
+                entry_file.clear();
+                entry_file.open(directory + "/" + entries[index].path, ios::binary);
+                open_entry = index;
+            }
+
+            long long entry_end = entry_offsets[index] + entries[index].size;
+
+            entry_file.clear();
+            entry_file.seekg(offset - entry_offsets[index]);
+            entry_file.read(buffer + copied, min((long long) length - copied, entry_end - offset));
+            block_length = entry_file.gcount();
+
+            // A file that shrank since it was listed ends the stream early; the server reports the batch incomplete.
+            if (block_length == 0) break;
+        }
+
+        copied += block_length;
+        offset += block_length;
+    }
+
+    return copied;
+}
+
+// Creates the directories leading up to the last '/' of path.
+static bool make_parent_directories(const string &path) {
+
+    for (size_t separator = path.find('/', 1); separator != string::npos; separator = path.find('/', separator + 1)) {
+        if (mkdir(path.substr(0, separator).c_str(), 0755) == -1 && errno != EEXIST) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Only plain relative paths are accepted, so a manifest cannot write outside the batch directory.
+static bool safe_relative_path(const string &path) {
+
+    if (path.empty() || path[0] == '/') return false;
+
+    size_t start = 0;
+
+    while (start <= path.size()) {
+
+        size_t end = path.find('/', start);
+        if (end == string::npos) end = path.size();
+
+        string component = path.substr(start, end - start);
+        if (component.empty() || component == "." || component == "..") return false;
+
+        start = end + 1;
+    }
+
+    return true;
+}
+
+void batch_writer::start(const string &directory_name) {
+
+    directory = directory_name;
+    manifest_line.clear();
+    manifest_files = -1;
+    entries.clear();
+    entry_file.close();
+    current_entry = 0;
+    entry_remaining = 0;
+    manifest_done = false;
+
+    mkdir(directory.c_str(), 0755);
+}
+
+bool batch_writer::parse_manifest_line() {
+
+    if (manifest_files == -1) {
+
+        char tag[16];
+        if (sscanf(manifest_line.c_str(), "%15s %d", tag, &manifest_files) != 2 ||
+            strcmp(tag, BATCH_MANIFEST_TAG) != 0 || manifest_files < 0) {
+            fprintf(stderr, "(server) malformed batch manifest\n");
+            return false;
+        }
+
+    } else {
+
+        char *end;
+        batch_entry entry;
+        entry.size = strtoll(manifest_line.c_str(), &end, 10);
+
+        if (end == manifest_line.c_str() || *end != ' ' || entry.size < 0) {
+            fprintf(stderr, "(server) malformed batch manifest line: %s\n", manifest_line.c_str());
+            return false;
+        }
+
+        entry.path = end + 1;
+
+        if (!safe_relative_path(entry.path)) {
+            fprintf(stderr, "(server) refusing batch path %s\n", entry.path.c_str());
+            return false;
+        }
+
+        entries.push_back(entry);
+    }
+
+    manifest_done = ((int) entries.size() == manifest_files);
+    return true;
+}
+
+// Opens the next file of the batch. Empty files are created and closed straight away.
+bool batch_writer::open_next_entry() {
+
+    while (current_entry < (int) entries.size()) {
+
+        string path = directory + "/" + entries[current_entry].path;
+
+        if (!make_parent_directories(path)) {
+            perror(("(server) error when creating the directories for " + path).c_str());
+            return false;
+        }
+
+        entry_file.configure(direct_io, sync_policy);
+
+        if (!entry_file.open(path, 0, 1, entries[current_entry].size)) {
+            perror(("(server) error when opening " + path).c_str());
+            return false;
+        }
+
+        entry_remaining = entries[current_entry].size;
+        if (entry_remaining > 0) return true;
+
+        if (!entry_file.close()) {
+            perror(("(server) error when writing " + path).c_str());
+            return false;
+        }
+
+        current_entry++;
+    }
+
+    return true;
+}
+
+// Consumes the next part of the batch stream. Returns false if the manifest is malformed, the stream carries more data
+// than the manifest announced, or a file cannot be written.
+bool batch_writer::write(const char *data, int length) {
+
+    int position = 0;
+
+    while (position < length) {
+
+        if (!manifest_done) {
+
+            char character = data[position++];
+
+            if (character != '\n') {
+                manifest_line += character;
+                if (manifest_line.size() > MAX_MANIFEST_LINE) return false;
+                continue;
+            }
+
+            if (!parse_manifest_line()) return false;
+            manifest_line.clear();
+
+            if (manifest_done && !open_next_entry()) return false;
+            continue;
+        }
+
+        if (current_entry >= (int) entries.size()) {
+            fprintf(stderr, "(server) batch stream is longer than its manifest\n");
+            return false;
+        }
+
+        int block_length = min((long long) length - position, entry_remaining);
+
+        if (!entry_file.write(data + position, block_length)) {
+            perror(("(server) error when writing " + entries[current_entry].path).c_str());
+            return false;
+        }
+
+        position += block_length;
+        entry_remaining -= block_length;
+
+        if (entry_remaining == 0) {
+
+            if (!entry_file.close()) {
+                perror(("(server) error when writing " + entries[current_entry].path).c_str());
+                return false;
+            }
+
+            current_entry++;
+            if (!open_next_entry()) return false;
+        }
+    }
+
+    return true;
+}
+
+bool batch_writer::finished() const {
+    return manifest_done && current_entry == (int) entries.size();
+}
@@ -0,0 +1,88 @@
+/*
+
+ * Description:
+   Batch transfers. When the client is given a directory, every regular file below it is sent in one session: the
+   stream starts with a manifest,
+
+     gbn-batch <number of files>
+     <size> <relative path>
+     ...
+
+   followed by the contents of the files back to back, in manifest order. Chunks are cut from this stream without
+   regard to file boundaries, so small files share packets and the whole batch shares one window and one EOT. The
+   server parses the manifest as it arrives and fans the stream out to the files below its own directory argument,
+   each written through a block_writer that knows its size from the manifest.
+
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "input_source.h"
+#include "block_writer.h"
+
+#define BATCH_MANIFEST_TAG "gbn-batch"
+
+struct batch_entry {
+    std::string path;  // relative to the batch directory
+    long long size;
+};
+
+bool is_directory(const std::string &path);
+bool list_batch_files(const std::string &directory, std::vector<batch_entry> &entries);
+
+class batch_source : public input_source {
+
+private:
+
+    std::string directory;
+    std::vector<batch_entry> entries;
+    std::vector<long long> entry_offsets;  // where each file starts in the stream
+    std::string manifest;
+    long long stream_size = 0;
+
+    std::ifstream entry_file;
+    int open_entry = -1;
+
+public:
+
+    bool open(const std::string &directory_name);
+
+    long long size() { return stream_size; }
+    int read_at(long long offset, char *buffer, int length);
+
+    int file_count() const { return entries.size(); }
+};
+
+class batch_writer {
+
+private:
+
+    std::string directory;
+    std::string manifest_line;
+    int manifest_files = -1;  // -1 until the first manifest line is parsed
+    std::vector<batch_entry> entries;
+
+    block_writer entry_file;
+    bool direct_io = false;
+    int sync_policy = 0;
+    int current_entry = 0;
+    long long entry_remaining = 0;
+    bool manifest_done = false;
+
+    bool parse_manifest_line();
+    bool open_next_entry();
+
+public:
+
+    void configure(bool direct, int sync) { direct_io = direct; sync_policy = sync; }
+    void start(const std::string &directory_name);
+
+    bool write(const char *data, int length);
+    bool finished() const;
+};
+
+#endif
@@ -0,0 +1,256 @@
+/*
+
+ * Description:
+   The server's output file writer. See block_writer.h.
+
+ */
+
+#include "block_writer.h"
+#include "config.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+
+using namespace std;
+
+// Opens file_name for writing. With keep_length 0 the file is truncated; otherwise its first keep_length bytes are
+// kept, anything after them is cut off, and writing continues from there. With more than one buffer, blocks are
+// written by a background thread. expected_length, if known, is how long the file will be.
+bool block_writer::open(const string &file_name, long long keep_length, int buffers, long long expected_length) {
+
+    close();
+
+    int flags = O_WRONLY | O_CREAT | (keep_length == 0 ? O_TRUNC : 0);
+
+    // File systems without direct I/O (tmpfs among them) refuse O_DIRECT, and the file is written through the page
+    // cache instead.
+    direct = false;
+    if (direct_requested) {
+        file_fd = ::open(file_name.c_str(), flags | O_DIRECT, 0644);
+        direct = (file_fd != -1);
+    }
+
+    if (file_fd == -1) file_fd = ::open(file_name.c_str(), flags, 0644);
+    if (file_fd == -1) return false;
+
+    block.resize(BLOCK_WRITER_SIZE);
+    used = 0;
+    file_offset = keep_length;
+
+    if (keep_length > 0 && ftruncate(file_fd, keep_length) == -1) {
+        ::close(file_fd);
+        file_fd = -1;
+        return false;
+    }
+
+    // Direct writes start on an aligned offset, so the partial unit before keep_length is read back into the block and
+    // written again with what follows it.
+    if (direct && keep_length % DIRECT_IO_ALIGNMENT != 0) {
+
+        file_offset = keep_length - keep_length % DIRECT_IO_ALIGNMENT;
+        used = keep_length - file_offset;
+
+        int read_fd = ::open(file_name.c_str(), O_RDONLY);
+        bool read_back = (read_fd != -1 && pread(read_fd, block.data(), used, file_offset) == (ssize_t) used);
+        if (read_fd != -1) ::close(read_fd);
+
+        if (!read_back) {
+            ::close(file_fd);
+            file_fd = -1;
+            return false;
+        }
+    }
+
+    // The rest of the file is reserved in one go, so it is laid out in few extents. The file keeps its length until
+    // data is written, and close() gives back whatever was not used. Not every file system can do this.
+    preallocated = (expected_length > keep_length &&
+                    fallocate(file_fd, FALLOC_FL_KEEP_SIZE, keep_length, expected_length - keep_length) == 0);
+
+    buffer_count = max(buffers, 1);
+    write_failed = false;
+    stop_flag = false;
+
+    if (buffer_count > 1) {
+        spare_blocks.assign(buffer_count - 1, aligned_block(BLOCK_WRITER_SIZE));
+        writer_thread = thread(&block_writer::background_writer, this);
+    }
+
+    return true;
+}
+
+bool block_writer::write(const char *data, size_t length) {
+
+    char *destination = reserve(length);
+    if (destination == NULL) return false;
+
+    memcpy(destination, data, length);
+    commit(length);
+    return true;
+}
+
+// Returns room for length bytes at the end of the block, writing the block out first if it is too full. The room stays
+// valid until the next reserve(), write() or flush().
+char *block_writer::reserve(size_t length) {
+
+    if (block.size() - used < length) {
+        if (!hand_off()) return NULL;
+        if (block.size() < length) block.resize(length);
+    }
+
+    return block.data() + used;
+}
+
+// Bytes that can be buffered before the protocol loop has to wait for the disk. A single buffer is written in place
+// whenever it fills up, so it never runs out.
+size_t block_writer::free_space() const {
+
+    if (buffer_count == 1) return block.size();
+
+    lock_guard<mutex> lock(blocks_mutex);
+    return spare_blocks.size() * BLOCK_WRITER_SIZE + (block.size() - used);
+}
+
+bool block_writer::write_out(const char *data, size_t length, long long offset) {
+
+    size_t written = 0;
+
+    while (written < length) {
+
+        ssize_t result = pwrite(file_fd, data + written, length - written, offset + written);
+
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        written += result;
+    }
+
+    return sync_policy != SYNC_BLOCK || length == 0 || fdatasync(file_fd) == 0;
+}
+
+// Gets the filled part of the block written and starts over with an empty block. With a writer thread, the block is
+// queued and a spare one taken, waiting for one to come back from the disk if there is none. With direct I/O, a partial
+// unit at the end is not written but moved to the start of the new block.
+bool block_writer::hand_off() {
+
+    size_t tail = direct ? used % DIRECT_IO_ALIGNMENT : 0, length = used - tail;
+
+    if (buffer_count == 1) {
+        bool written = write_out(block.data(), length, file_offset);
+        memmove(block.data(), block.data() + length, tail);
+        file_offset += length;
+        used = tail;
+        return written;
+    }
+
+    if (length == 0) return true;
+
+    unique_lock<mutex> lock(blocks_mutex);
+    blocks_changed.wait(lock, [this] { return !spare_blocks.empty() || write_failed; });
+
+    if (write_failed) return false;
+
+    queued_block full;
+    full.data.swap(block);
+    full.length = length;
+    full.offset = file_offset;
+
+    block.swap(spare_blocks.back());
+    spare_blocks.pop_back();
+    if (block.size() < BLOCK_WRITER_SIZE) block.resize(BLOCK_WRITER_SIZE);
+    memcpy(block.data(), full.data.data() + length, tail);
+    file_offset += length;
+    used = tail;
+
+    queued_blocks.push_back(std::move(full));
+    blocks_changed.notify_all();
+    return true;
+}
+
+// Writes out everything buffered so far, and returns once it is in the file. With direct I/O the last partial unit is
+// written padded with zeros; it stays in the block, to be written again once more data follows, and close() cuts the
+// padding off.
+bool block_writer::flush() {
+
+    if (!hand_off()) return false;
+
+    if (buffer_count > 1) {
+        unique_lock<mutex> lock(blocks_mutex);
+        blocks_changed.wait(lock, [this] { return (queued_blocks.empty() && !writing) || write_failed; });
+        if (write_failed) return false;
+    }
+
+    if (used > 0) {
+
+        size_t padded = (used + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+        if (block.size() < padded) block.resize(padded);
+        memset(block.data() + used, 0, padded - used);
+
+        if (!write_out(block.data(), padded, file_offset)) return false;
+    }
+
+    return sync_policy == SYNC_NONE || fdatasync(file_fd) == 0;
+}
+
+bool block_writer::close() {
+
+    if (file_fd == -1) return true;
+
+    bool flushed = flush();
+
+    if (writer_thread.joinable()) {
+        {
+            lock_guard<mutex> lock(blocks_mutex);
+            stop_flag = true;
+        }
+        blocks_changed.notify_all();
+        writer_thread.join();
+    }
+
+    // The file ends where the data does: the padding of a last partial unit and unused preallocated space are cut off.
+    bool trimmed = true;
+    if (direct || preallocated) {
+        trimmed = (ftruncate(file_fd, file_offset + used) == 0);
+        if (trimmed && sync_policy != SYNC_NONE) trimmed = (fdatasync(file_fd) == 0);
+    }
+
+    bool closed = (::close(file_fd) == 0);
+    file_fd = -1;
+    used = 0;
+
+    spare_blocks.clear();
+    queued_blocks.clear();
+
+    return flushed && trimmed && closed;
+}
+
+// Runs on writer_thread. Blocks are written in the order they were queued, and go back to the spares once written.
+void block_writer::background_writer() {
+
+    unique_lock<mutex> lock(blocks_mutex);
+
+    while (true) {
+
+        blocks_changed.wait(lock, [this] { return stop_flag || !queued_blocks.empty(); });
+
+        if (queued_blocks.empty()) break;
+
+        queued_block full = std::move(queued_blocks.front());
+        queued_blocks.pop_front();
+        writing = true;
+
+        lock.unlock();
+        bool written = write_out(full.data.data(), full.length, full.offset);
+        lock.lock();
+
+        if (!written) write_failed = true;
+
+        spare_blocks.push_back(std::move(full.data));
+        writing = false;
+        blocks_changed.notify_all();
+    }
+}
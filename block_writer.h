@@ -0,0 +1,117 @@
+/*
+
+ * Description:
+   The server's output file writer. Data is gathered in a large block and written with one write() per block. Besides
+   write(), which copies into the block, the block can be filled in place: reserve() hands out the free space at its
+   end, recvmsg() or the decompressor fills it, and commit() keeps what was filled. Data placed that way is never copied
+   in user space.
+
+   With more than one buffer, full blocks are handed to a writer thread and filling goes on in a spare block, so the
+   protocol loop only waits for the disk once every spare block is queued. free_space() tells how much can still be
+   buffered; the server advertises it to the client as its receive window.
+
+   When the length of the file is known, it is reserved with fallocate() on open. With direct I/O the file is opened
+   with O_DIRECT and bypasses the page cache: blocks are aligned in memory, and only whole DIRECT_IO_ALIGNMENT units
+   are written, so a partial unit at the end of a block moves to the start of the next one. The sync policy adds
+   fdatasync() after every flush() or every block.
+
+ */
+
+#ifndef BLOCK_WRITER_H
+#define BLOCK_WRITER_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define BLOCK_WRITER_SIZE (1 << 20)
+
+// O_DIRECT needs the buffer, the file offset and the length of every write aligned to the logical block size of the
+// device; 4096 covers both 512 and 4096 byte sectors.
+#define DIRECT_IO_ALIGNMENT 4096
+
+// Allocates block memory on DIRECT_IO_ALIGNMENT boundaries.
+template <typename T>
+struct aligned_allocator {
+
+    typedef T value_type;
+
+    aligned_allocator() {}
+    template <typename U> aligned_allocator(const aligned_allocator<U> &) {}
+
+    T *allocate(size_t count) {
+        void *memory;
+        if (posix_memalign(&memory, DIRECT_IO_ALIGNMENT, count * sizeof(T)) != 0) throw std::bad_alloc();
+        return (T *) memory;
+    }
+
+    void deallocate(T *memory, size_t) { free(memory); }
+
+    template <typename U> bool operator==(const aligned_allocator<U> &) const { return true; }
+    template <typename U> bool operator!=(const aligned_allocator<U> &) const { return false; }
+};
+
+typedef std::vector<char, aligned_allocator<char>> aligned_block;
+
+class block_writer {
+
+private:
+
+    int file_fd = -1;
+    aligned_block block;
+    size_t used = 0;
+    long long file_offset = 0;  // where the block starts in the file
+
+    bool direct_requested = false;
+    bool direct = false;        // the file was opened with O_DIRECT
+    bool preallocated = false;
+    int sync_policy = 0;
+
+    // Background writing, with more than one buffer.
+    struct queued_block {
+        aligned_block data;
+        size_t length;
+        long long offset;
+    };
+
+    int buffer_count = 1;
+    std::vector<aligned_block> spare_blocks;
+    std::deque<queued_block> queued_blocks;
+    bool writing = false;
+    bool write_failed = false;
+    bool stop_flag = false;
+    std::thread writer_thread;
+    mutable std::mutex blocks_mutex;
+    std::condition_variable blocks_changed;
+
+    bool write_out(const char *data, size_t length, long long offset);
+    bool hand_off();
+    void background_writer();
+
+public:
+
+    ~block_writer() { close(); }
+
+    void configure(bool direct_io, int sync) { direct_requested = direct_io; sync_policy = sync; }
+
+    bool open(const std::string &file_name, long long keep_length, int buffers = 1, long long expected_length = -1);
+    bool is_open() const { return file_fd != -1; }
+    bool direct_io() const { return direct; }
+
+    bool write(const char *data, size_t length);
+    char *reserve(size_t length);
+    void commit(size_t length) { used += length; }
+
+    size_t free_space() const;
+
+    bool flush();
+    bool close();
+};
+
+#endif
@@ -0,0 +1,95 @@
+/*
+
+ * Description:
+   Checkpoints for resumable transfers. See checkpoint.h.
+
+ */
+
+#include "checkpoint.h"
+#include "checksum.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+string checkpoint_path(const string &output_file_name) {
+    return output_file_name + ".checkpoint";
+}
+
+bool load_checkpoint(const string &path, transfer_checkpoint &checkpoint) {
+
+    FILE *checkpoint_file = fopen(path.c_str(), "r");
+    if (checkpoint_file == NULL) return false;
+
+    transfer_checkpoint loaded;
+    bool valid = fscanf(checkpoint_file, "offset=%lld file-size=%lld file-mtime=%lld", &loaded.committed_offset,
+                        &loaded.file_size, &loaded.file_mtime) == 3 && loaded.committed_offset >= 0;
+    fclose(checkpoint_file);
+
+    if (valid) checkpoint = loaded;
+    return valid;
+}
+
+// Writes the checkpoint to a temporary file, syncs it and renames it over the old one.
+bool save_checkpoint(const string &path, const transfer_checkpoint &checkpoint) {
+
+    string temporary_path = path + ".tmp";
+    char text[128];
+    int text_length = snprintf(text, sizeof(text), "offset=%lld file-size=%lld file-mtime=%lld\n",
+                               checkpoint.committed_offset, checkpoint.file_size, checkpoint.file_mtime);
+
+    int checkpoint_fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (checkpoint_fd == -1) {
+        perror("(server) error when opening checkpoint file");
+        return false;
+    }
+
+    bool written = write(checkpoint_fd, text, text_length) == text_length && fsync(checkpoint_fd) == 0;
+    close(checkpoint_fd);
+
+    if (!written || rename(temporary_path.c_str(), path.c_str()) == -1) {
+        perror("(server) error when writing checkpoint file");
+        unlink(temporary_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void remove_checkpoint(const string &path) {
+    unlink(path.c_str());
+}
+
+// The size and modification time stand in for the file's identity; a changed source file does not resume.
+bool file_identity(const string &file_name, long long &file_size, long long &file_mtime) {
+
+    struct stat file_status;
+    if (stat(file_name.c_str(), &file_status) == -1) return false;
+
+    file_size = file_status.st_size;
+    file_mtime = file_status.st_mtime;
+    return true;
+}
+
+// CRC32C of the first length bytes of a file, used to pick up the whole-file digest where a resumed transfer starts.
+bool digest_file_prefix(const string &file_name, long long length, uint32_t &digest) {
+
+    ifstream input_file(file_name, ios::binary);
+    vector<char> block(1 << 16);
+
+    digest = 0;
+
+    while (length > 0 && input_file) {
+        input_file.read(block.data(), min((long long) block.size(), length));
+        digest = crc32c_update(digest, block.data(), input_file.gcount());
+        length -= input_file.gcount();
+    }
+
+    return length == 0;
+}
@@ -0,0 +1,33 @@
+/*
+
+ * Description:
+   Checkpoints for resumable transfers. While it writes the output file the server periodically records how many bytes
+   of it are committed, together with the size and modification time of the client's source file, in
+   `<output>.checkpoint`. When the same source file is sent again, the handshake tells the client to start at the
+   committed offset and only the missing part is sent. The file is replaced atomically (written aside, then renamed), so
+   a crash leaves either the old checkpoint or the new one.
+
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <string>
+
+struct transfer_checkpoint {
+    long long committed_offset = 0;  // bytes of the output file that are complete
+    long long file_size = -1;        // identity of the source file being received
+    long long file_mtime = -1;
+};
+
+std::string checkpoint_path(const std::string &output_file_name);
+
+bool load_checkpoint(const std::string &path, transfer_checkpoint &checkpoint);
+bool save_checkpoint(const std::string &path, const transfer_checkpoint &checkpoint);
+void remove_checkpoint(const std::string &path);
+
+bool file_identity(const std::string &file_name, long long &file_size, long long &file_mtime);
+bool digest_file_prefix(const std::string &file_name, long long length, uint32_t &digest);
+
+#endif
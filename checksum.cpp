@@ -0,0 +1,248 @@
+/*
+
+ * Description:
+   CRC32C implementation. See checksum.h.
+
+ */
+
+#include "checksum.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define CRC32C_POLYNOMIAL 0x82f63b78u  // reflected Castagnoli polynomial
+#define STREAM_LENGTH 512              // bytes per stream in the three-way hardware loop
+
+static uint32_t slicing_table[8][256];
+static uint32_t power_table[32];  // power_table[k] = x^(2^k) mod P
+static uint32_t stream_shift_constant[2];
+static bool hardware_crc = false;
+static bool hardware_combine = false;
+
+// Multiplies two polynomials modulo P, both in reflected bit order.
+static uint32_t multiply_modulo(uint32_t a, uint32_t b) {
+
+    uint32_t bit = 1u << 31, product = 0;
+
+    for (;;) {
+        if (a & bit) {
+            product ^= b;
+            if ((a & (bit - 1)) == 0) break;
+        }
+        bit >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLYNOMIAL : b >> 1;
+    }
+
+    return product;
+}
+
+// Returns x^(n * 2^k) mod P.
+static uint32_t x_power_modulo(uint64_t n, unsigned k) {
+
+    uint32_t power = 1u << 31;  // x^0
+
+    while (n) {
+        if (n & 1) power = multiply_modulo(power_table[k & 31], power);
+        n >>= 1;
+        k++;
+    }
+
+    return power;
+}
+
+static void initialize_tables() {
+
+    for (uint32_t index = 0; index < 256; index++) {
+        uint32_t crc = index;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        }
+        slicing_table[0][index] = crc;
+    }
+
+    for (uint32_t index = 0; index < 256; index++) {
+        for (int slice = 1; slice < 8; slice++) {
+            uint32_t previous = slicing_table[slice - 1][index];
+            slicing_table[slice][index] = (previous >> 8) ^ slicing_table[0][previous & 0xff];
+        }
+    }
+
+    uint32_t power = 1u << 30;  // x^1
+    power_table[0] = power;
+    for (int k = 1; k < 32; k++) {
+        power_table[k] = power = multiply_modulo(power, power);
+    }
+
+    // Shifting a CRC over n bytes with PCLMULQDQ multiplies it by x^(8n - 33): the carry-less product of two reflected
+    // values comes out one bit short, and the crc32 instruction used for the reduction contributes the other x^32.
+    stream_shift_constant[0] = x_power_modulo(8 * STREAM_LENGTH - 33, 0);
+    stream_shift_constant[1] = x_power_modulo(2 * 8 * STREAM_LENGTH - 33, 0);
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    hardware_crc = __builtin_cpu_supports("sse4.2");
+    hardware_combine = hardware_crc && __builtin_cpu_supports("pclmul");
+#endif
+}
+
+// The tables are built on first use. A function-local static makes that safe when several threads checksum at once.
+static void ensure_tables() {
+    static const bool ready = (initialize_tables(), true);
+    (void) ready;
+}
+
+// Table-driven CRC over the raw register (no pre- or post-inversion), eight bytes per step.
+static uint32_t crc32c_software(uint32_t crc, const unsigned char *data, size_t length) {
+
+    while (length && ((uintptr_t) data & 7)) {
+        crc = (crc >> 8) ^ slicing_table[0][(crc ^ *data++) & 0xff];
+        length--;
+    }
+
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        word ^= crc;
+        crc = slicing_table[7][word & 0xff] ^ slicing_table[6][(word >> 8) & 0xff] ^
+              slicing_table[5][(word >> 16) & 0xff] ^ slicing_table[4][(word >> 24) & 0xff] ^
+              slicing_table[3][(word >> 32) & 0xff] ^ slicing_table[2][(word >> 40) & 0xff] ^
+              slicing_table[1][(word >> 48) & 0xff] ^ slicing_table[0][word >> 56];
+        data += 8;
+        length -= 8;
+    }
+
+    while (length--) {
+        crc = (crc >> 8) ^ slicing_table[0][(crc ^ *data++) & 0xff];
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t shift_crc(uint32_t crc, uint32_t constant) {
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc), _mm_cvtsi32_si128(constant), 0);
+    return (uint32_t) _mm_crc32_u64(0, (uint64_t) _mm_cvtsi128_si64(product));
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crc32c_hardware(uint32_t crc, const unsigned char *data, size_t length) {
+
+    uint64_t crc64 = crc;
+
+    while (length && ((uintptr_t) data & 7)) {
+        crc64 = _mm_crc32_u8((uint32_t) crc64, *data++);
+        length--;
+    }
+
+    // The crc32 instruction has a latency of three cycles but a throughput of one, so three interleaved streams keep
+    // it busy. The streams are merged by shifting the first two over the bytes that follow them.
+    if (hardware_combine) {
+
+        while (length >= 3 * STREAM_LENGTH) {
+
+            uint64_t crc1 = 0, crc2 = 0;
+            const unsigned char *end = data + STREAM_LENGTH;
+
+            while (data < end) {
+                uint64_t word0, word1, word2;
+                memcpy(&word0, data, 8);
+                memcpy(&word1, data + STREAM_LENGTH, 8);
+                memcpy(&word2, data + 2 * STREAM_LENGTH, 8);
+                crc64 = _mm_crc32_u64(crc64, word0);
+                crc1 = _mm_crc32_u64(crc1, word1);
+                crc2 = _mm_crc32_u64(crc2, word2);
+                data += 8;
+            }
+
+            crc64 = shift_crc((uint32_t) crc64, stream_shift_constant[1]) ^
+                    shift_crc((uint32_t) crc1, stream_shift_constant[0]) ^ (uint32_t) crc2;
+
+            data += 2 * STREAM_LENGTH;
+            length -= 3 * STREAM_LENGTH;
+        }
+    }
+
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+
+    while (length--) {
+        crc64 = _mm_crc32_u8((uint32_t) crc64, *data++);
+    }
+
+    return (uint32_t) crc64;
+}
+
+#endif
+
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t length) {
+
+    ensure_tables();
+
+    const unsigned char *bytes = (const unsigned char *) data;
+    crc = ~crc;
+
+#if defined(__x86_64__)
+    if (hardware_crc) {
+        return ~crc32c_hardware(crc, bytes, length);
+    }
+#endif
+
+    return ~crc32c_software(crc, bytes, length);
+}
+
+uint32_t crc32c(const void *data, size_t length) {
+    return crc32c_update(0, data, length);
+}
+
+// Returns the CRC of A followed by B, given crc(A), crc(B) and the length of B, without touching the data.
+uint32_t crc32c_combine(uint32_t first_crc, uint32_t second_crc, size_t second_length) {
+
+    ensure_tables();
+
+    return multiply_modulo(x_power_modulo(second_length, 3), first_crc) ^ second_crc;
+}
+
+// Extends the CRC of a packet's data with its type and sequence number.
+uint32_t packet_checksum(uint32_t data_crc, int type, int sequence_number) {
+
+    int32_t header[2] = {type, sequence_number};
+
+    return crc32c_update(data_crc, header, sizeof(header));
+}
+
+void write_checksum_field(uint32_t checksum, char *field) {
+
+    static const char hex_digits[] = "0123456789abcdef";
+
+    for (int position = CHECKSUM_FIELD_LENGTH - 1; position >= 0; position--) {
+        field[position] = hex_digits[checksum & 0xf];
+        checksum >>= 4;
+    }
+}
+
+bool read_checksum_field(const char *field, uint32_t &checksum) {
+
+    checksum = 0;
+
+    for (int position = 0; position < CHECKSUM_FIELD_LENGTH; position++) {
+
+        char digit = field[position];
+        checksum <<= 4;
+
+        if (digit >= '0' && digit <= '9') checksum |= digit - '0';
+        else if (digit >= 'a' && digit <= 'f') checksum |= digit - 'a' + 10;
+        else return false;
+    }
+
+    return true;
+}
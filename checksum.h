@@ -0,0 +1,32 @@
+/*
+
+ * Description:
+   CRC32C (Castagnoli) checksums for packet payloads and whole-file digests. The SSE4.2 crc32 instruction is used when
+   the CPU has it, running three independent streams that are merged with PCLMULQDQ; otherwise a slicing-by-8 table
+   is used. Both give the same result.
+
+   When checksum=crc32c is negotiated, the first CHECKSUM_FIELD_LENGTH characters of a data packet's data field hold
+   the packet checksum as lower case hex. It covers the data that follows, then the packet type and sequence number, so
+   it can be derived from the CRC of the data alone. The EOT packets carry the CRC32C of the whole file in the same
+   format.
+
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHECKSUM_FIELD_LENGTH 8
+
+uint32_t crc32c(const void *data, size_t length);
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t length);
+uint32_t crc32c_combine(uint32_t first_crc, uint32_t second_crc, size_t second_length);
+
+uint32_t packet_checksum(uint32_t data_crc, int type, int sequence_number);
+
+void write_checksum_field(uint32_t checksum, char *field);
+bool read_checksum_field(const char *field, uint32_t &checksum);
+
+#endif
@@ -0,0 +1,196 @@
+/*
+
+ * Description:
+   The client's chunk preparation stage. See chunk_store.h.
+
+ */
+
+#include "chunk_store.h"
+#include "checksum.h"
+#include "compression.h"
+
+#include <string.h>
+
+using namespace std;
+
+// base_digest is the CRC32C of the first base_offset bytes of the file, so that digest() covers the whole file.
+chunk_store::chunk_store(input_source &source, const session_config &config, long long base_offset,
+                         uint32_t base_digest) : source(source), base_offset(base_offset) {
+
+    payload_size = config.payload_size;
+    compression = config.compression;
+    compression_level = config.compression_level;
+    checksum_flag = (config.checksum == CHECKSUM_CRC32C);
+
+    first_index = 0;
+    end_index = -1;
+    file_digest = base_digest;
+    digest_chunks = 0;
+
+    raw.resize(payload_size);
+    scratch_raw.resize(payload_size);
+}
+
+chunk_store::~chunk_store() {
+
+    if (!reader.joinable()) return;
+
+    stopping = true;
+    reader.join();
+
+    prepared_chunk *chunk;
+    while (ready->pop(chunk)) delete chunk;
+}
+
+// Moves chunk preparation to a reader thread that keeps up to queue_length chunks ready ahead of the sender. Must be
+// called before the first get().
+void chunk_store::start_reader(int queue_length) {
+
+    ready.reset(new spsc_queue<prepared_chunk *>(queue_length));
+    reader = thread(&chunk_store::read_ahead, this);
+}
+
+// The reader thread: prepares every chunk in file order and queues it, then queues NULL.
+void chunk_store::read_ahead() {
+
+    for (int index = 0; ; index++) {
+
+        prepared_chunk *chunk = new prepared_chunk;
+
+        if (!prepare(index, *chunk, raw, true)) {
+            delete chunk;
+            chunk = NULL;
+        }
+
+        int attempts = 0;
+        while (!ready->push(chunk)) {
+            if (stopping.load()) {
+                delete chunk;
+                return;
+            }
+            queue_backoff(attempts);
+        }
+
+        if (chunk == NULL) return;
+    }
+}
+
+// Moves the next chunk from the reader thread into the store, waiting for it if asked to. Returns false if no chunk
+// was ready or the end of the file was reached.
+bool chunk_store::take_ready(bool wait) {
+
+    prepared_chunk *chunk;
+    int attempts = 0;
+
+    while (!ready->pop(chunk)) {
+        if (!wait) return false;
+        queue_backoff(attempts);
+    }
+
+    if (chunk == NULL) {
+        end_index = first_index + (int) chunks.size();
+        return false;
+    }
+
+    chunks.push_back(std::move(*chunk));
+    delete chunk;
+    return true;
+}
+
+// Reads chunk index from the source and encodes it, using raw_buffer for the compressor's input. Returns false if the
+// chunk lies past the end of the stream. in_order is set for the chunks prepared in file order.
+bool chunk_store::prepare(int index, prepared_chunk &chunk, vector<char> &raw_buffer, bool in_order) {
+
+    chunk.data.resize(payload_size + COMPRESSION_OVERHEAD);
+
+    // Without compression the file is read straight into the packet data.
+    char *destination = (compression == COMPRESSION_NONE) ? chunk.data.data() : raw_buffer.data();
+
+    {
+        lock_guard<mutex> guard(source_lock);
+        chunk.raw_length = source.read_at(base_offset + (long long) index * payload_size, destination, payload_size);
+    }
+
+    if (chunk.raw_length == 0) {
+        return false;
+    }
+
+    // Chunks are first prepared in file order, so the whole-file digest is built in a single pass.
+    if (checksum_flag && in_order && index == digest_chunks) {
+        file_digest = crc32c_update(file_digest, destination, chunk.raw_length);
+        digest_chunks++;
+    }
+
+    if (compression == COMPRESSION_NONE) {
+        chunk.data_length = chunk.raw_length;
+    } else {
+        chunk.data_length = compress_chunk(compression, compression_level, raw_buffer.data(), chunk.raw_length,
+                                           chunk.data.data());
+    }
+
+    if (checksum_flag) {
+        chunk.data_crc = crc32c(chunk.data.data(), chunk.data_length);
+    }
+
+    return true;
+}
+
+// Returns chunk index, preparing it (and every chunk before it that is not prepared yet) if needed. Returns NULL past
+// the end of the file. The pointer stays valid until the next call.
+prepared_chunk *chunk_store::get(int index) {
+
+    if (end_index != -1 && index >= end_index) {
+        return NULL;
+    }
+
+    // A chunk that was already released, e.g. after the window slid back, is prepared again from the file.
+    if (index < first_index) {
+        return prepare(index, scratch, scratch_raw, false) ? &scratch : NULL;
+    }
+
+    while (first_index + (int) chunks.size() <= index) {
+
+        if (ready) {
+            if (!take_ready(true)) return NULL;
+            continue;
+        }
+
+        chunks.emplace_back();
+
+        if (!prepare(first_index + (int) chunks.size() - 1, chunks.back(), raw, true)) {
+            chunks.pop_back();
+            end_index = first_index + (int) chunks.size();
+            return NULL;
+        }
+    }
+
+    return &chunks[index - first_index];
+}
+
+// Prepares every chunk up to last_index ahead of the send window. With a reader thread, this only collects the chunks
+// it has ready and never waits.
+void chunk_store::prefetch(int last_index) {
+
+    if (!ready) {
+        get(last_index);
+        return;
+    }
+
+    while (end_index == -1 && first_index + (int) chunks.size() <= last_index && take_ready(false)) {}
+}
+
+// Drops the chunks before index once they are acknowledged. A chunk that the kernel may still be sending from with
+// MSG_ZEROCOPY is kept, along with the chunks after it, until the send is reported finished.
+void chunk_store::release_before(int index, uint32_t completed_zero_copy_sends) {
+
+    while (first_index < index && !chunks.empty()) {
+
+        const prepared_chunk &chunk = chunks.front();
+        if (chunk.zero_copy_pending && chunk.last_zero_copy_send >= completed_zero_copy_sends) break;
+
+        chunks.pop_front();
+        first_index++;
+    }
+
+    source.release_before(base_offset + (long long) first_index * payload_size);
+}
@@ -0,0 +1,92 @@
+/*
+
+ * Description:
+   The client's chunk preparation stage. A chunk is the part of the stream carried by one data packet; preparing it
+   means reading it, compressing it when compression is negotiated, and taking its CRC when checksums are. Chunks are
+   prepared ahead of the send window and kept until they are acknowledged, so retransmissions neither re-read the file
+   nor compress again.
+
+   With --threads 2 or more, a reader thread prepares the chunks in file order and hands them to the sending thread
+   through a lock-free queue, so reading and encoding overlap with sending and waiting for acknowledgements.
+
+ */
+
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "input_source.h"
+#include "spsc_queue.h"
+
+struct prepared_chunk {
+    std::vector<char> data;  // the packet's data field after the checksum field
+    int data_length = 0;
+    int raw_length = 0;      // bytes of the file this chunk carries
+    uint32_t data_crc = 0;   // CRC32C of data, when checksums are on
+
+    // The packet header goes with the chunk, so a MSG_ZEROCOPY send can use it until the kernel is done with it.
+    char header[MAX_HEADER_LENGTH];
+    bool zero_copy_pending = false;
+    uint32_t last_zero_copy_send = 0;
+};
+
+class chunk_store {
+
+private:
+
+    input_source &source;
+    long long base_offset;              // where chunk 0 starts: a resumed transfer skips what the server already has
+    int payload_size;
+    int compression;
+    int compression_level;
+    bool checksum_flag;
+
+    std::deque<prepared_chunk> chunks;  // chunks first_index, first_index + 1, ...
+    int first_index;
+    int end_index;                      // index of the first chunk past the end of the file, -1 until it is reached
+    prepared_chunk scratch;             // holds chunks asked for again after they were released
+    std::vector<char> raw;              // compression input of the chunks prepared in file order
+    std::vector<char> scratch_raw;      // compression input of scratch
+
+    uint32_t file_digest;               // CRC32C of the file up to the end of chunk digest_chunks - 1
+    int digest_chunks;
+
+    // The reader thread, when there is one. It owns raw, file_digest and digest_chunks; a NULL in the queue marks the
+    // end of the file. The sending thread may still read the source for scratch, hence the lock.
+    std::thread reader;
+    std::unique_ptr<spsc_queue<prepared_chunk *>> ready;
+    std::atomic<bool> stopping{false};
+    std::mutex source_lock;
+
+    bool prepare(int index, prepared_chunk &chunk, std::vector<char> &raw_buffer, bool in_order);
+    bool take_ready(bool wait);
+    void read_ahead();
+
+public:
+
+    chunk_store(input_source &source, const session_config &config, long long base_offset = 0,
+                uint32_t base_digest = 0);
+    ~chunk_store();
+
+    void start_reader(int queue_length);
+
+    prepared_chunk *get(int index);
+    void prefetch(int last_index);
+    void release_before(int index, uint32_t completed_zero_copy_sends = UINT32_MAX);
+
+    // Chunks asked for again after they were released are prepared in a buffer that is reused, so they must not be
+    // sent with MSG_ZEROCOPY.
+    bool stable(const prepared_chunk *chunk) const { return chunk != &scratch; }
+
+    // Complete once get() has returned NULL for the end of the file.
+    uint32_t digest() const { return file_digest; }
+};
+
+#endif
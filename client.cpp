@@ -21,65 +21,1015 @@
 struct talker_variables talker;
 struct listener_variables listener;
 struct client_state state;
+struct session_config config;
 
-struct sockaddr recv_from;
+struct sockaddr_storage recv_from;
+
+zerocopy_tracker zero_copy;
+copy_counters copies;
+segment_batch batch;
+ack_receiver acknowledgements;
+receiver_set receivers;  // active when the file goes to several servers at once (see distribution.h)
+rate_scheduler pacing;
+packet_capture capture;
+int last_captured_acknowledgement = -1;
 
 /*
 
-   To ensure reliable transmission, the GBN client should behave as follows:
+   To ensure reliable transmission, the GBN client should behave as follows:
+
+     1. Should the client have a packet to send, it first checks if the window is full. If the window is not full, the
+        packet is sent and the appropriate variables are updated.
+
+     2. The client should make use of a single timer set for the oldest transmitted-but-not-yet-acknowledged packet.
+
+     3. If the receiver times out, the client should resend all packets that have been previously sent but that have
+        not been acknowledged. If an ACK is received corresponding to an unacknowledged packet within the window, the
+        timer should be restarted. If there are no outstanding packets, the timer should be stopped.
+
+     4. When the client receives an acknowledgement with sequence number n, the acknowledgement should be treated as a
+        cumulative acknowledgement, indicating that all packets with sequence number up to and including n have been
+        correctly received at the server.
+
+     5. The client should fill the window and then obtain an acknowledgement and wait to obtain an acknowledgement.
+        When that acknowledgement comes in, it should check to see if the window has space and send again. Then, wait
+        for an acknowledgement again, and so on. This ensures that the client's window always keeps full. (This is an
+        assignment requirement)
+
+ */
+
+
+// Sets how long recvfrom() blocks on socket_fd before failing with EAGAIN.
+void set_receive_timeout(int socket_fd, int timeout_ms) {
+
+    struct timeval wait_time;
+    wait_time.tv_sec = timeout_ms / 1000;
+    wait_time.tv_usec = (timeout_ms % 1000) * 1000;
+
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &wait_time, sizeof(struct timeval)) == -1) {
+        perror("(client) error when calling setsockopt (SO_RCVTIMEO)");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// CLOCK_MONOTONIC in milliseconds, the clock of the retransmission timers.
+static long long monotonic_ms() {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+// Sends packets first .. first + count - 1 of the batch with one sendmsg(). Several packets go out as the segments of
+// one UDP_SEGMENT send. Returns false if the kernel refuses the segmentation.
+static bool send_batch_range(size_t first, size_t count) {
+
+    char control[SEGMENT_CONTROL_LENGTH];
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_name = &recv_from;
+    message.msg_namelen = talker.address_length;
+    message.msg_iov = &batch.pieces[2 * first];
+    message.msg_iovlen = 2 * count;
+
+    if (count > 1) set_segment_size(message, control, batch.segment_length);
+
+    bool zero_copy_send = batch.zero_copy_send;
+
+    // Send a message to the server socket using UDP datagrams. The kernel limits how much memory unfinished zero-copy
+    // sends may pin; past that limit the packets are sent the usual way.
+    while (sendmsg(batch.socket_fd, &message, zero_copy_send ? MSG_ZEROCOPY : 0) == -1) {
+
+        if (zero_copy_send && errno == ENOBUFS) {
+            zero_copy_send = false;
+            continue;
+        }
+
+        if (count > 1 && (errno == EIO || errno == EINVAL || errno == EMSGSIZE || errno == ENOPROTOOPT ||
+                          errno == EOPNOTSUPP)) {
+            return false;
+        }
+
+        perror("(client) error when calling sendmsg:");
+        exit(EXIT_FAILURE);
+    }
+
+    if (zero_copy_send) {
+
+        uint32_t send = zero_copy.record_send();
+
+        for (size_t member = first; member < first + count; member++) {
+            batch.members[member]->zero_copy_pending = true;
+            batch.members[member]->last_zero_copy_send = send;
+        }
+    }
+
+    return true;
+}
+
+// Sends the data packets held back in the batch. Called before the client waits and before it sends anything else,
+// so packets still leave in order.
+template <typename trace>
+static void flush_data_packets() {
+
+    size_t count = batch.members.size();
+    if (count == 0) return;
+
+    if (!send_batch_range(0, count)) {
+
+        // Without UDP GSO support on the path, every packet is sent on its own from now on.
+        batch.offload = false;
+
+        if (trace::enabled) {
+            cout << "UDP segmentation offload is not available, packets are sent one by one" << endl << endl;
+        }
+
+        for (size_t member = 0; member < count; member++) send_batch_range(member, 1);
+    }
+
+    batch.pieces.clear();
+    batch.members.clear();
+    batch.total_length = 0;
+}
+
+// Points the packets sent from now on at address. Packets held back for the previous destination leave first.
+template <typename trace>
+static void aim_at(const struct sockaddr_storage &address) {
+
+    if (memcmp(&recv_from, &address, sizeof(recv_from)) == 0) return;
+
+    flush_data_packets<trace>();
+    memcpy(&recv_from, &address, sizeof(recv_from));
+}
+
+// Records a datagram from the server in the capture, with what it is. An acknowledgement that repeats the one before
+// it is a duplicate, which follows a lost or overtaken packet. Returns num_bytes.
+static int record_arrival(char *buffer, int buffer_length, int num_bytes) {
+
+    if (!capture.enabled() || num_bytes < 0 || num_bytes >= buffer_length) return num_bytes;
+
+    int type = -1, sequence_number = -1;
+    const char *note = "unknown";
+
+    buffer[num_bytes] = '\0';
+    sscanf(buffer, "%d %d", &type, &sequence_number);
+
+    if (type == 0) {
+        note = (sequence_number == last_captured_acknowledgement) ? "duplicate acknowledgement" : "acknowledgement";
+        last_captured_acknowledgement = sequence_number;
+    } else if (type == 2) {
+        note = "EOT";
+    } else if (type == SYN_ACK_PACKET_TYPE) {
+        note = "SYN-ACK";
+    } else if (type == NAK_PACKET_TYPE) {
+        note = "NAK";
+    }
+
+    capture.record(CAPTURE_INBOUND, talker.address, buffer, num_bytes, note);
+    return num_bytes;
+}
+
+// Waits up to timeout_ms for the next acknowledgement, from the acknowledgement thread if there is one and from the
+// listener socket otherwise. Returns like recvfrom(). The wait changes with every retransmission deadline, so it is
+// given to poll() rather than set on the socket.
+template <typename trace>
+static int receive_acknowledgement(char *buffer, int buffer_length, int timeout_ms) {
+
+    flush_data_packets<trace>();
+
+    if (acknowledgements.running()) {
+        return record_arrival(buffer, buffer_length, acknowledgements.receive(buffer, buffer_length, timeout_ms));
+    }
+
+    struct pollfd event;
+    event.fd = listener.socket_fd;
+    event.events = POLLIN;
+
+    long long deadline = monotonic_ms() + timeout_ms;
+    int ready;
+
+    // Data packets leave through the listener's socket too, so zero-copy completion reports wake poll() with POLLERR.
+    // They are collected, and the wait goes on for the rest of its time.
+    while ((ready = poll(&event, 1, (int) max(0LL, deadline - monotonic_ms()))) > 0 && !(event.revents & POLLIN)) {
+        zero_copy.poll(listener.socket_fd);
+        if (!zero_copy.enabled() || monotonic_ms() >= deadline) {
+            ready = 0;
+            break;
+        }
+    }
+
+    if (ready == -1 && errno != EINTR) {
+        perror("(client) error when calling poll");
+        exit(EXIT_FAILURE);
+    }
+
+    if (ready <= 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return record_arrival(buffer, buffer_length,
+                          receive_datagram(listener.socket_fd, buffer, buffer_length - 1, MSG_DONTWAIT, NULL, NULL,
+                                           NULL));
+}
+
+// Whether the input is read as a stream of unknown length (see input_source.h). Streams are not resumable, so the SYN
+// leaves out the file's identity.
+static bool streaming_input() {
+    return !is_directory(config.file_name) && (config.streaming || is_stream(config.file_name));
+}
+
+static const char *recovery_phase_name(int phase) {
+    return (phase == RECOVERY_REWOUND) ? "rewound" : "open";
+}
+
+// Packets the client may have in flight (see window_limit in gbn_rules.h).
+static int send_limit() {
+    return window_limit(config.window_size, state.advertised_window);
+}
+
+// Elapsed time between two CLOCK_MONOTONIC readings, in milliseconds.
+static double elapsed_ms(const struct timespec &start, const struct timespec &end) {
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+// The handshake of a distribution. SYNs go to the group, or to every receiver that has not answered yet, until all the
+// receivers expected have answered or the attempts run out. The nonce numbers the attempt and, in list mode, the
+// receiver, so every SYN-ACK can be timed and matched. The receivers have to accept the same parameters, except for
+// the window: the smallest one is used. The retransmission timeout covers the farthest receiver. No data packet is held
+// back for sending yet, so the send helpers run untraced here.
+int perform_distribution_handshake(session_parameters offer) {
+
+    char text[HANDSHAKE_TEXT_LENGTH], received_text[HANDSHAKE_BUFFER_LENGTH];
+    char payload[HANDSHAKE_BUFFER_LENGTH], buffer[HANDSHAKE_BUFFER_LENGTH];
+    struct timespec sent_at[HANDSHAKE_ATTEMPTS + 1], received_at;
+    session_parameters agreed;
+    int num_bytes, answered = 0, wait_ms = config.timeout_ms;
+
+    offer.receivers = receivers.expected;
+
+    for (int attempt = 1; attempt <= HANDSHAKE_ATTEMPTS && answered < receivers.expected; attempt++) {
+
+        clock_gettime(CLOCK_MONOTONIC, &sent_at[attempt]);
+
+        int destinations = receivers.group ? 1 : (int) receivers.members.size();
+
+        for (int position = 0; position < destinations; position++) {
+
+            if (!receivers.group && receivers.members[position].id != -1) continue;
+
+            offer.nonce = attempt * DISTRIBUTION_MAX_RECEIVERS + position;
+            int text_length = encode_parameters(offer, text, sizeof(text));
+
+            packet *syn = new packet(SYN_PACKET_TYPE, 0, text_length, text);
+            syn->serialize(payload);
+            delete syn;
+
+            aim_at<silent_trace>(receivers.group ? talker.address : receivers.members[position].address);
+
+            capture.record(CAPTURE_OUTBOUND, recv_from, payload, strlen(payload), "SYN");
+
+            if (sendto(talker.socket_fd, payload, strlen(payload), 0, (const sockaddr *) &recv_from,
+                       talker.address_length) == -1) {
+                perror("(client) error when calling sendto");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        if (state.verbose_flag) {
+            cout << "[HANDSHAKE]: Client sent SYN " << attempt;
+            cout << (receivers.group ? " to the group: " : " to the receivers: ") << text << endl << endl;
+        }
+
+        long long deadline = monotonic_ms() + wait_ms, remaining_ms;
+
+        // Collect SYN-ACKs until the attempt times out. Anything else is skipped, and so are answers to retransmitted
+        // SYNs from receivers that have already answered.
+        while (answered < receivers.expected && (remaining_ms = deadline - monotonic_ms()) > 0) {
+
+            num_bytes = receive_acknowledgement<silent_trace>(buffer, sizeof(buffer), (int) remaining_ms);
+
+            if (num_bytes == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                perror("(client) error when calling recvfrom");
+                exit(EXIT_FAILURE);
+            }
+
+            buffer[num_bytes] = '\0';
+            if (atoi(buffer) != SYN_ACK_PACKET_TYPE) continue;
+
+            clock_gettime(CLOCK_MONOTONIC, &received_at);
+
+            packet *reply = new packet(0, 0, 0, received_text);
+            reply->deserialize(buffer);
+            int received_length = reply->getLength();
+            delete reply;
+
+            session_parameters accepted;
+            if (!decode_parameters(received_text, received_length, accepted)) {
+                fprintf(stderr, "(client) a receiver sent invalid session parameters\n");
+                return -1;
+            }
+
+            int answered_attempt = accepted.nonce / DISTRIBUTION_MAX_RECEIVERS;
+            int position = accepted.nonce % DISTRIBUTION_MAX_RECEIVERS;
+
+            if (answered_attempt < 1 || answered_attempt > attempt) continue;
+
+            if (accepted.receiver == -1) {
+                fprintf(stderr, "(client) a server that does not take part in distributions answered\n");
+                return -1;
+            }
+
+            if (receivers.find(accepted.receiver) != -1) continue;
+
+            receiver_state *receiver;
+
+            if (receivers.group) {
+                receivers.members.push_back(receiver_state());
+                receiver = &receivers.members.back();
+            } else if (position < (int) receivers.members.size() && receivers.members[position].id == -1) {
+                receiver = &receivers.members[position];
+            } else {
+                continue;
+            }
+
+            if (answered == 0) {
+                agreed = accepted;
+            } else if (accepted.payload_size != agreed.payload_size ||
+                       accepted.sequence_space != agreed.sequence_space || accepted.checksum != agreed.checksum ||
+                       accepted.compression != agreed.compression || accepted.zero_copy != agreed.zero_copy) {
+                fprintf(stderr, "(client) the receivers accepted different session parameters\n");
+                return -1;
+            }
+
+            agreed.window_size = min(agreed.window_size, accepted.window_size);
+            receiver->id = accepted.receiver;
+            receiver->round_trip_time_ms = elapsed_ms(sent_at[answered_attempt], received_at);
+            answered++;
+
+            if (state.verbose_flag) {
+                received_text[received_length] = '\0';
+                cout << "[HANDSHAKE]: Client received SYN-ACK from receiver " << receiver->id << ": ";
+                cout << received_text << endl << endl;
+            }
+        }
+
+        wait_ms = min(wait_ms * 2, 60000);  // back off between attempts
+    }
+
+    if (answered == 0) {
+        fprintf(stderr, "(client) no SYN-ACK from any receiver after %d attempts\n", HANDSHAKE_ATTEMPTS);
+        return -1;
+    }
+
+    if (answered < receivers.expected) {
+        fprintf(stderr, "(client) only %d of %d receivers answered, sending to them\n", answered, receivers.expected);
+    }
+
+    apply_parameters(agreed, config);
+
+    state.round_trip_time_ms = receivers.round_trip_time_ms();
+    state.retransmission_timeout_ms = retransmission_timeout(state.round_trip_time_ms, config.timeout_ms);
+    set_receive_timeout(listener.socket_fd, state.retransmission_timeout_ms);
+
+    if (state.verbose_flag) {
+        cout << "Sending to " << answered << " receivers, window " << config.window_size << ". Longest round trip ";
+        cout << "time: " << state.round_trip_time_ms << " ms, retransmission timeout: ";
+        cout << state.retransmission_timeout_ms << " ms" << endl << endl;
+    }
+
+    return 0;
+}
+
+// Sends SYN packets until the server answers with a SYN-ACK, then adopts the session parameters the server accepted.
+// Each SYN carries a nonce that the server echoes, so the round trip of the answered SYN can be timed even when earlier
+// attempts were lost. That round trip seeds the retransmission timeout (RTO = 3 * RTT, as with RFC 6298's initial
+// SRTT = R and RTTVAR = R / 2), bounded by the configured timeout.
+int perform_handshake() {
+
+    char text[HANDSHAKE_TEXT_LENGTH], received_text[HANDSHAKE_BUFFER_LENGTH];
+    char payload[HANDSHAKE_BUFFER_LENGTH], buffer[HANDSHAKE_BUFFER_LENGTH];
+    struct sockaddr_storage server_addr;
+    socklen_t addr_len;
+    struct timespec sent_at, received_at;
+    int num_bytes, wait_ms = config.timeout_ms;
+
+    session_parameters offer = parameters_from_config(config);
+
+    // The session number tells a restarted client apart from retransmitted SYNs, and the file's size and modification
+    // time let the server recognise a file it has already partly received. Batches are always sent from the start.
+    offer.session = (int) ((getpid() ^ time(NULL)) & 0x7fffffff);
+    offer.batch = is_directory(config.file_name) ? 1 : 0;
+    if (!offer.batch && !streaming_input()) file_identity(config.file_name, offer.file_size, offer.file_mtime);
+
+    if (receivers.active()) return perform_distribution_handshake(offer);
+
+    for (int attempt = 1; attempt <= HANDSHAKE_ATTEMPTS; attempt++) {
+
+        offer.nonce = attempt;
+        int text_length = encode_parameters(offer, text, sizeof(text));
+
+        packet *syn = new packet(SYN_PACKET_TYPE, 0, text_length, text);
+        syn->serialize(payload);
+        delete syn;
+
+        clock_gettime(CLOCK_MONOTONIC, &sent_at);
+
+        capture.record(CAPTURE_OUTBOUND, talker.address, payload, strlen(payload), "SYN");
+
+        if (sendto(talker.socket_fd, payload, strlen(payload), 0, (const sockaddr *) &talker.address,
+                   talker.address_length) == -1) {
+            perror("(client) error when calling sendto");
+            exit(EXIT_FAILURE);
+        }
+
+        if (state.verbose_flag) cout << "[HANDSHAKE]: Client sent SYN " << attempt << ": " << text << endl << endl;
+
+        set_receive_timeout(listener.socket_fd, wait_ms);
+
+        // Wait for the matching SYN-ACK. Anything else (stray ACKs, answers to earlier SYNs) is skipped.
+        while (true) {
+
+            addr_len = sizeof(server_addr);
+            num_bytes = record_arrival(buffer, sizeof(buffer),
+                                       recvfrom(listener.socket_fd, buffer, sizeof(buffer) - 1, 0,
+                                                (struct sockaddr *) &server_addr, &addr_len));
+
+            if (num_bytes == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                perror("(client) error when calling recvfrom");
+                exit(EXIT_FAILURE);
+            }
+
+            buffer[num_bytes] = '\0';
+            if (atoi(buffer) != SYN_ACK_PACKET_TYPE) continue;
+
+            clock_gettime(CLOCK_MONOTONIC, &received_at);
+
+            packet *reply = new packet(0, 0, 0, received_text);
+            reply->deserialize(buffer);
+            int received_length = reply->getLength();
+            delete reply;
+
+            session_parameters accepted;
+            if (!decode_parameters(received_text, received_length, accepted)) {
+                fprintf(stderr, "(client) the server sent invalid session parameters\n");
+                return -1;
+            }
+
+            if (accepted.nonce != attempt) continue;
+
+            if (accepted.resume_offset > 0 && accepted.resume_offset > offer.file_size) {
+                fprintf(stderr, "(client) the server asked to resume past the end of the file\n");
+                return -1;
+            }
+
+            apply_parameters(accepted, config);
+            state.resume_offset = accepted.resume_offset;
+
+            state.round_trip_time_ms = elapsed_ms(sent_at, received_at);
+            state.retransmission_timeout_ms = retransmission_timeout(state.round_trip_time_ms, config.timeout_ms);
+            set_receive_timeout(listener.socket_fd, state.retransmission_timeout_ms);
+
+            if (state.verbose_flag) {
+                received_text[received_length] = '\0';
+                cout << "[HANDSHAKE]: Client received SYN-ACK: " << received_text << endl;
+                cout << "Round trip time: " << state.round_trip_time_ms << " ms, retransmission timeout: ";
+                cout << state.retransmission_timeout_ms << " ms" << endl << endl;
+            }
+
+            return 0;
+        }
+
+        wait_ms = min(wait_ms * 2, 60000);  // back off between attempts
+    }
+
+    fprintf(stderr, "(client) no SYN-ACK from the server after %d attempts\n", HANDSHAKE_ATTEMPTS);
+    return -1;
+}
+
+// Sends a prepared chunk as a data packet. sendmsg() gathers the header (with the checksum field) and the chunk's data
+// into one datagram, so the data is never copied into a packet buffer; a compressed chunk may also contain NUL bytes,
+// where packet::serialize()'s %s would stop. The header is the one serialize() writes, or its fixed-width form on the
+// zero-copy path. With MSG_ZEROCOPY the kernel sends straight from the chunk, which stays in the chunk store until the
+// send is reported finished. With FEC on, the checksum covers the chunk's index instead of its sequence number (see
+// fec.h).
+template <typename trace>
+static void send_data_packet(int sequence_number, int chunk_index, prepared_chunk *chunk, bool stable_chunk) {
+
+    bool checksum_flag = (config.checksum == CHECKSUM_CRC32C);
+    int data_length = chunk->data_length + (checksum_flag ? CHECKSUM_FIELD_LENGTH : 0);
+    int header_length = sprintf(chunk->header, config.zero_copy ? FIXED_HEADER_FORMAT : "%d %d %d ", 1,
+                                sequence_number, data_length);
+
+    if (checksum_flag) {
+        int identity = (config.fec_block > 0) ? chunk_index : sequence_number;
+        write_checksum_field(packet_checksum(chunk->data_crc, 1, identity), chunk->header + header_length);
+        header_length += CHECKSUM_FIELD_LENGTH;
+    }
+
+    // With several interfaces, consecutive packets leave through each of them in turn. Zero-copy completions are
+    // only collected from the session's own socket.
+    int path_fd = talker.path_fds[chunk_index % talker.path_fds.size()];
+    bool zero_copy_send = stable_chunk && zero_copy.enabled() && path_fd == talker.socket_fd;
+    int datagram_length = header_length + chunk->data_length;
+
+    // The packet joins the run of packets waiting to be sent if they can all leave in one sendmsg().
+    if (!batch.members.empty() &&
+        (path_fd != batch.socket_fd || datagram_length != batch.segment_length ||
+         zero_copy_send != batch.zero_copy_send || batch.members.size() == GSO_MAX_SEGMENTS ||
+         (zero_copy_send && batch.members.size() == GSO_MAX_ZERO_COPY_SEGMENTS) ||
+         batch.total_length + datagram_length > GSO_MAX_BYTES ||
+         find(batch.members.begin(), batch.members.end(), chunk) != batch.members.end())) {
+        flush_data_packets<trace>();
+    }
+
+    struct iovec header_piece = {chunk->header, (size_t) header_length};
+    struct iovec data_piece = {chunk->data.data(), (size_t) chunk->data_length};
+
+    if (capture.enabled()) {
+        struct iovec pieces[2] = {header_piece, data_piece};
+        capture.record(CAPTURE_OUTBOUND, recv_from, pieces, 2,
+                       chunk_index < state.current_file_seek ? "data, retransmission" : "data, new");
+    }
+
+    batch.socket_fd = path_fd;
+    batch.segment_length = datagram_length;
+    batch.zero_copy_send = zero_copy_send;
+    batch.total_length += datagram_length;
+    batch.pieces.push_back(header_piece);
+    batch.pieces.push_back(data_piece);
+    batch.members.push_back(chunk);
+
+    // The scratch chunk is reused by the next get(), so it is sent right away.
+    if (!batch.offload || !stable_chunk) flush_data_packets<trace>();
+
+    copies.bytes_in_place += chunk->data_length;
+    pacing.charge(datagram_length);
+
+    if (trace::enabled) {
+        cout << "Client sent a packet with sequence number " << sequence_number << endl << endl;
+    }
+}
+
+// Sends a data packet for the first time: once to the server or the group, or to every receiver of a list in turn.
+template <typename trace>
+static void distribute_data_packet(int sequence_number, int chunk_index, prepared_chunk *chunk, bool stable_chunk) {
+
+    if (!receivers.fan_out()) {
+        send_data_packet<trace>(sequence_number, chunk_index, chunk, stable_chunk);
+        return;
+    }
+
+    for (size_t position = 0; position < receivers.members.size(); position++) {
+
+        const receiver_state &receiver = receivers.members[position];
+        if (receiver.id == -1 || receiver.dropped) continue;
+
+        aim_at<trace>(receiver.address);
+        send_data_packet<trace>(sequence_number, chunk_index, chunk, stable_chunk);
+    }
+}
+
+// Sends the repair packets of the current FEC block, which ends with the packet sequence_number, and starts the next
+// block. A stream that ends on a chunk boundary leaves its last block short; it is finished here too.
+template <typename trace>
+static void send_repair_packets(fec_encoder &fec, char *datagram, int sequence_number) {
+
+    flush_data_packets<trace>();  // the repair packets follow the block's data packets
+
+    for (int repair = 0; repair < fec.repairs_per_block(); repair++) {
+
+        int datagram_length = fec.write_repair(repair, datagram);
+
+        capture.record(CAPTURE_OUTBOUND, recv_from, datagram, datagram_length, "FEC repair");
+
+        if (sendto(talker.socket_fd, datagram, datagram_length, 0, (struct sockaddr *) &recv_from,
+                   talker.address_length) == -1) {
+            perror("(client) error when calling sendto");
+            exit(EXIT_FAILURE);
+        }
+        pacing.charge(datagram_length);
+    }
+
+    if (trace::enabled) {
+        cout << "Client sent " << fec.repairs_per_block() << " repair packets for the block ending with packet ";
+        cout << sequence_number << endl << endl;
+    }
+
+    fec.next_block();
+}
+
+// Adds a data packet that is sent for the first time to its FEC block, and sends the block's repair packets once the
+// block is complete. Retransmissions are not added again.
+template <typename trace>
+static void protect_data_packet(fec_encoder &fec, char *datagram, int sequence_number, int chunk_index,
+                                prepared_chunk *chunk) {
+
+    if (!fec.enabled() || chunk_index != fec.next_index()) return;
+
+    char checksum_field[CHECKSUM_FIELD_LENGTH + 1];
+    write_checksum_field(packet_checksum(chunk->data_crc, 1, chunk_index), checksum_field);
+
+    fec.add(checksum_field, CHECKSUM_FIELD_LENGTH, chunk->data.data(), chunk->data_length);
+
+    if (!fec.block_full() && chunk_index != state.total_packets_in_file - 1) return;
+
+    send_repair_packets<trace>(fec, datagram, sequence_number);
+}
+
+// Called once the end of a stream is found, when packets chunks make up all of it. Sets the packet count that could
+// not be known up front, and finishes a FEC block that the stream's end left short. An empty last chunk is not sent,
+// so its block is complete once every packet before it was added.
+template <typename trace>
+static void note_end_of_input(fec_encoder &fec, char *datagram, int packets, int last_sequence_number) {
+
+    if (state.total_packets_in_file != -1) return;
+
+    state.total_packets_in_file = packets;
+    if (trace::enabled) cout << "[STATE]: The stream ended after " << packets << " packets" << endl << endl;
+
+    if (fec.enabled() && !fec.block_empty() && fec.next_index() == packets) {
+        send_repair_packets<trace>(fec, datagram, last_sequence_number);
+    }
+}
+
+// The transport of the client's gbn_sender (see gbn_sender.h): a packet of the window is resent from the chunk store.
+template <typename trace>
+struct chunk_transport {
+
+    chunk_store &chunks;
+
+    explicit chunk_transport(chunk_store &chunks) : chunks(chunks) {}
+
+    bool resend(int sequence_number, int chunk_index) {
+
+        prepared_chunk *chunk = chunks.get(chunk_index);
+        if (chunk == NULL) return false;
+
+        send_data_packet<trace>(sequence_number, chunk_index, chunk, chunks.stable(chunk));
+        return true;
+    }
+};
+
+// Lets go of the chunks of the packets that have left the window.
+static void release_chunks(long long packets_acknowledged, chunk_store &chunks) {
+
+    if (config.zero_copy) zero_copy.poll(talker.socket_fd);
+    chunks.release_before(packets_acknowledged, zero_copy.completed());
+}
+
+// Resends the packets of a distribution from the from-th one of the transfer to the last one sent: to one receiver in
+// list mode, to the group otherwise. The window's timer is for the oldest packet, so only a repair that starts with it
+// restarts the timer; a faster receiver's repair would otherwise keep postponing the slowest one's.
+template <typename sequence_space, typename retransmission, typename trace>
+static void repair_receivers(gbn_sender<sequence_space, retransmission, trace> &sender,
+                             const receiver_state *receiver, long long from, chunk_store &chunks) {
+
+    if (from >= sender.packets_sent) return;
+
+    aim_at<trace>(receiver != NULL ? receiver->address : talker.address);
+
+    chunk_transport<trace> link(chunks);
+
+    for (long long position = from; position < sender.packets_sent; position++) {
+
+        int offset = (int) (position - sender.packets_acknowledged);
+        if (link.resend(sender.sequence_numbers[offset], sender.chunk_indices[offset])) {
+            sender.resent(sender.chunk_indices[offset]);
+        }
+    }
+
+    sender.arm(0, from == sender.packets_acknowledged, monotonic_ms());
+}
+
+// Applies an acknowledgement or a NAK from one receiver of a distribution. Either moves the receiver's own window; a
+// NAK then has the packets after it resent, unless a repair sent to the group within the retransmission timeout
+// already covers them. Returns how many packets leave the window, as every receiver has them now.
+template <typename sequence_space, typename retransmission, typename trace>
+static int acknowledge_receiver(gbn_sender<sequence_space, retransmission, trace> &sender, receiver_state &receiver,
+                                int type, int sequence_number, int advertised_window, chunk_store &chunks) {
+
+    long long acknowledged = sender.packets_acknowledged, sent = sender.packets_sent;
+    int packets_acknowledged;
+    int kind = classify_acknowledgement(sender.space, sequence_number,
+                                        sender.space.wrap(sender.window_base +
+                                                          (int) (receiver.acknowledged - acknowledged)),
+                                        (int) (sent - receiver.acknowledged), packets_acknowledged);
+
+    receiver.heard = true;
+
+    if (advertised_window != -1 && kind != ACKNOWLEDGEMENT_LATE) receiver.advertised_window = advertised_window;
+
+    if (kind == ACKNOWLEDGEMENT_ADVANCES) {
+        receiver.acknowledged += packets_acknowledged;
+        receiver.recovery = RECOVERY_OPEN;
+    }
+
+    if (type == NAK_PACKET_TYPE && kind != ACKNOWLEDGEMENT_LATE && receiver.recovery == RECOVERY_OPEN &&
+        receiver.acknowledged < sent) {
+
+        long long now = monotonic_ms();
+
+        if (receivers.group && receiver.acknowledged >= receivers.repair_from &&
+            receiver.acknowledged < receivers.repair_until &&
+            now - receivers.repaired_at_ms < sender.retransmission_timeout_ms) {
+
+            if (trace::enabled) {
+                cout << "[DISTRIBUTION]: NAK from receiver " << receiver.id << " already answered" << endl << endl;
+            }
+
+        } else {
+
+            if (trace::enabled) {
+                cout << "[DISTRIBUTION]: NAK from receiver " << receiver.id << ", resending its last ";
+                cout << sent - receiver.acknowledged << " packets" << endl << endl;
+            }
+
+            repair_receivers(sender, receivers.group ? NULL : &receiver, receiver.acknowledged, chunks);
+
+            if (receivers.group) {
+                receivers.repair_from = receiver.acknowledged;
+                receivers.repair_until = sent;
+                receivers.repaired_at_ms = now;
+            }
+
+            sender.rewinds++;
+        }
+
+        receiver.recovery = RECOVERY_REWOUND;
+    }
+
+    state.advertised_window = receivers.advertised_window();
+    return (int) (receivers.slowest(sent) - acknowledged);
+}
+
+// The window's timer ran out in a distribution. Every receiver short of the last packet sent has what it misses
+// resent: each on its own in list mode, the group once from the slowest receiver otherwise. A receiver not heard from
+// through DISTRIBUTION_DROP_TIMEOUTS timeouts in a row is dropped, so that the others can finish. Returns how many
+// packets leave the window because of the drops.
+template <typename sequence_space, typename retransmission, typename trace>
+static int time_out_receivers(gbn_sender<sequence_space, retransmission, trace> &sender, chunk_store &chunks) {
+
+    long long acknowledged = sender.packets_acknowledged, sent = sender.packets_sent;
+
+    for (size_t position = 0; position < receivers.members.size(); position++) {
+
+        receiver_state &receiver = receivers.members[position];
+        if (receiver.id == -1 || receiver.dropped) continue;
+
+        receiver.silent_timeouts = (receiver.heard || receiver.acknowledged == sent) ? 0 : receiver.silent_timeouts + 1;
+        receiver.heard = false;
+
+        if (receiver.acknowledged == sent) continue;
+
+        if (receiver.silent_timeouts >= DISTRIBUTION_DROP_TIMEOUTS) {
+            fprintf(stderr, "(client) receiver %d stopped answering and is left out\n", receiver.id);
+            receiver.dropped = true;
+            continue;
+        }
+
+        receiver.recovery = RECOVERY_REWOUND;
+
+        if (!receivers.group) {
+            repair_receivers(sender, &receiver, receiver.acknowledged, chunks);
+        }
+    }
+
+    long long slowest = receivers.slowest(sent);
+
+    if (receivers.group && slowest < sent) {
+        repair_receivers(sender, NULL, slowest, chunks);
+        receivers.repair_from = slowest;
+        receivers.repair_until = sent;
+        receivers.repaired_at_ms = monotonic_ms();
+    }
+
+    state.advertised_window = receivers.advertised_window();
+    return (int) (slowest - acknowledged);
+}
+
+// Ends a distribution. The EOT in payload goes to the group, or to every receiver that has not answered it, until each
+// receiver taking part has answered with an EOT of its own or MAX_EOT_ATTEMPTS have been sent. With checksums on,
+// every answer's digest is checked against digest. Returns true if every receiver expected ended with an intact copy.
+template <typename trace>
+static bool finish_distribution(const char *payload, int sequence_number, uint32_t digest, char *buffer,
+                                int buffer_length, char *received_payload, log_sink &seqlog_file,
+                                log_sink &acklog_file) {
+
+    int finished = 0, num_bytes;
+    bool intact = true;
+
+    for (int attempt = 1; attempt <= MAX_EOT_ATTEMPTS && finished < receivers.live(); attempt++) {
+
+        for (size_t position = 0; position < receivers.members.size(); position++) {
+
+            const receiver_state &receiver = receivers.members[position];
+
+            if (receivers.group && position > 0) break;
+            if (!receivers.group && (receiver.id == -1 || receiver.dropped || receiver.finished)) continue;
+
+            aim_at<trace>(receivers.group ? talker.address : receiver.address);
+
+            capture.record(CAPTURE_OUTBOUND, recv_from, payload, strlen(payload), "EOT");
+
+            if (sendto(talker.socket_fd, payload, strlen(payload), 0, (struct sockaddr *) &recv_from,
+                       talker.address_length) == -1) {
+                perror("(client) error when calling sendto\n");
+                exit(1);
+            }
+        }
+
+        seqlog_file.record(sequence_number);
+
+        if (trace::enabled) {
+            cout << "Client sent an EOT packet with sequence number " << sequence_number << " (attempt " << attempt;
+            cout << ")" << endl << endl;
+        }
+
+        long long eot_deadline = monotonic_ms() + config.eot_timeout_ms, remaining_ms;
+
+        while (finished < receivers.live() && (remaining_ms = eot_deadline - monotonic_ms()) > 0) {
+
+            memset(&buffer[0], '\0', buffer_length);
+            num_bytes = receive_acknowledgement<trace>(buffer, buffer_length, (int) remaining_ms);
+
+            if (num_bytes == -1) {
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+                perror("(client) error when calling recvfrom");
+                exit(EXIT_FAILURE);
+            }
+
+            if (atoi(buffer) != 2) continue;
+
+            packet *answer = new packet(0, 0, 0, received_payload);
+            answer->deserialize(buffer);
+
+            int member = receivers.find(receiver_tag(answer->getData(), answer->getLength()));
+
+            if (member != -1 && !receivers.members[member].dropped && !receivers.members[member].finished) {
+
+                receiver_state &receiver = receivers.members[member];
+                uint32_t receiver_digest;
+
+                acklog_file.record(answer->getSeqNum());
+                receiver.finished = true;
+                finished++;
+
+                // The receiver's EOT carries the CRC32C of what it wrote ahead of its id.
+                if (config.checksum == CHECKSUM_CRC32C &&
+                    (answer->getLength() <= CHECKSUM_FIELD_LENGTH ||
+                     !read_checksum_field(answer->getData(), receiver_digest) || receiver_digest != digest)) {
+                    fprintf(stderr, "(client) file digest mismatch: receiver %d's copy is corrupt\n", receiver.id);
+                    intact = false;
+                } else if (trace::enabled) {
+                    cout << "Client received an EOT packet from receiver " << receiver.id << endl << endl;
+                }
+            }
+
+            delete answer;
+        }
+    }
+
+    for (size_t position = 0; position < receivers.members.size(); position++) {
+
+        const receiver_state &receiver = receivers.members[position];
+
+        if (receiver.id != -1 && !receiver.dropped && !receiver.finished) {
+            fprintf(stderr, "(client) no EOT from receiver %d after %d attempts\n", receiver.id, MAX_EOT_ATTEMPTS);
+        }
+    }
+
+    if (trace::enabled) {
+        cout << finished << " of " << receivers.expected << " receivers have the whole file" << endl << endl;
+    }
 
-     1. Should the client have a packet to send, it first checks if the window is full. If the window is not full, the
-        packet is sent and the appropriate variables are updated.
+    return intact && finished == receivers.expected;
+}
 
-     2. The client should make use of a single timer set for the oldest transmitted-but-not-yet-acknowledged packet.
+// The client's protocol loop, specialized for the session's sequence space, retransmission policy and tracing (see
+// gbn_engine.h).
+template <typename sequence_space, typename retransmission, typename trace>
+static int run_driver(char *file_name, const sequence_space &space) {
+
+    file_source single_file;
+    stream_source stream;
+    batch_source batch;
+    input_source *source = &single_file;
+    log_sink seqlog_file, acklog_file;
+    int payload_size = config.payload_size, buffer_length = config.buffer_length();
+    vector<char> buffer_storage(buffer_length), payload_storage(buffer_length);
+    vector<char> received_payload_storage(CHECKSUM_FIELD_LENGTH + payload_size + 1);
+    char *buffer = buffer_storage.data(), *payload = payload_storage.data();
+    char *received_payload = received_payload_storage.data();
+    int seek_offset, num_bytes, ack_sequence_number, last_sequence_number = 0;
+
+    // A directory is sent as a batch: a manifest followed by all of its files, in one stream.
+    if (is_directory(file_name)) {
+
+        if (!batch.open(file_name)) {
+            exit(EXIT_FAILURE);
+        }
 
-     3. If the receiver times out, the client should resend all packets that have been previously sent but that have
-        not been acknowledged. If an ACK is received corresponding to an unacknowledged packet within the window, the
-        timer should be restarted. If there are no outstanding packets, the timer should be stopped.
+        source = &batch;
+        if (trace::enabled) cout << "Sending " << batch.file_count() << " files as a batch" << endl << endl;
 
-     4. When the client receives an acknowledgement with sequence number n, the acknowledgement should be treated as a
-        cumulative acknowledgement, indicating that all packets with sequence number up to and including n have been
-        correctly received at the server.
+    } else if (streaming_input()) {
 
-     5. The client should fill the window and then obtain an acknowledgement and wait to obtain an acknowledgement.
-        When that acknowledgement comes in, it should check to see if the window has space and send again. Then, wait
-        for an acknowledgement again, and so on. This ensures that the client's window always keeps full. (This is an
-        assignment requirement)
+        if (!stream.open(file_name)) {
+            perror("(client) error when opening the input stream");
+            exit(EXIT_FAILURE);
+        }
 
- */
+        source = &stream;
+
+    } else if (!single_file.open(file_name)) {
+        perror("(client) error when opening the input file");
+        exit(EXIT_FAILURE);
+    }
+
+    // A resumed transfer skips the part of the file the server already has. With checksums on, the whole-file digest
+    // still has to cover that part, so it is read once up front.
+    uint32_t resume_digest = 0;
+    if (state.resume_offset > 0 && config.checksum == CHECKSUM_CRC32C &&
+        !digest_file_prefix(file_name, state.resume_offset, resume_digest)) {
+        fprintf(stderr, "(client) error when reading %s\n", file_name);
+        exit(EXIT_FAILURE);
+    }
 
+    // Chunks are read, compressed and checksummed ahead of the window and kept until they are acknowledged.
+    chunk_store chunks(*source, config, state.resume_offset, resume_digest);
 
-int driver(char *file_name) {
+    // With FEC on, repair packets follow every block of data packets (see fec.h).
+    fec_encoder fec;
+    fec.configure(config);
+    vector<char> repair_storage(buffer_length);
 
-    ifstream source_file(file_name);
-    ofstream seqlog_file("clientseqnum.log"), acklog_file("clientack.log");
-    char send_packet_data[30], buffer[MAX_BUFFER_LENGTH], payload[MAX_BUFFER_LENGTH];
-    char received_payload[30];
-    int seek_offset, num_bytes, send_packet_data_length, ack_sequence_number, last_sequence_number = 0;
+    // With more than one thread the client runs as a pipeline: a reader thread prepares chunks, this thread sends, and
+    // an acknowledgement thread takes acknowledgements off the socket.
+    if (config.thread_count > 1) {
 
-    struct sockaddr client_addr;
-    socklen_t addr_len;
+        chunks.start_reader(max(2 * config.window_size, PIPELINE_MIN_QUEUE_LENGTH));
+
+        if (!acknowledgements.start(listener.socket_fd)) {
+            exit(EXIT_FAILURE);
+        }
+
+        if (trace::enabled) {
+            cout << "Running the reader, sender and acknowledgement stages in threads" << endl << endl;
+        }
+    }
 
-    list<int> window_number_sequence;
-    list<int> window_file_seek_sequence;
+    // The window, its retransmission timers and the recovery from losses (see gbn_sender.h). Packets of the window
+    // are resent from the chunk store. The handshake's round trip is the first measurement of the timeout. With FEC
+    // on, the server keeps the packets that arrive ahead of a lost one.
+    gbn_sender<sequence_space, retransmission, trace> sender(space, retransmission(), config.window_size,
+                                                             config.timeout_ms, fec.enabled());
+    chunk_transport<trace> link(chunks);
+    sender.start(monotonic_ms());
 
-    struct sockaddr* ptr = talker.p->ai_addr;
-    recv_from = *ptr;
-    ptr = &recv_from;
+    if (config.handshake_flag) sender.measured(state.round_trip_time_ms);
 
-    // Count the total number of characters in the input file.
-    source_file.seekg(0, source_file.end);
-    int characters_in_file = source_file.tellg();
-    source_file.seekg(0, source_file.beg);
+    bool transfer_failed = false;
 
-    // Compute the total number of packets that can be created.
-    state.total_packets_in_file = characters_in_file / 30;
-    if (characters_in_file % 30 != 0) {
-        state.total_packets_in_file++;
+    // The sequence number logs are buffered in memory and written out in blocks rather than flushed per packet.
+    if (!seqlog_file.open("clientseqnum.log", config.log_mode, config.log_block_size) || !acklog_file.open("clientack.log", config.log_mode, config.log_block_size)) {
+        exit(EXIT_FAILURE);
     }
 
-    if (state.verbose_flag) {
-        cout << "File data can be broken down into " << state.total_packets_in_file << " packets" << endl << endl;
+    memcpy(&recv_from, &talker.address, sizeof(recv_from));
+
+    if (config.zero_copy && !zero_copy.enable(talker.socket_fd) && trace::enabled) {
+        cout << "MSG_ZEROCOPY is not available, packets are sent with a copy" << endl << endl;
+    }
+
+    long long characters_in_file = source->size() - state.resume_offset;
+
+    if (trace::enabled && state.resume_offset > 0) {
+        cout << "Resuming the transfer at byte " << state.resume_offset << endl << endl;
+    }
+
+    // Compute the total number of packets that can be created. The length of a stream is only known once it ends, and
+    // the count is set then (see note_end_of_input).
+    if (source->size() == -1) {
+
+        state.total_packets_in_file = -1;
+        if (trace::enabled) cout << "Streaming the input, its length is known once it ends" << endl << endl;
+
+    } else {
+
+        state.total_packets_in_file = characters_in_file / payload_size;
+        if (characters_in_file % payload_size != 0) {
+            state.total_packets_in_file++;
+        }
+
+        if (trace::enabled) {
+            cout << "File data can be broken down into " << state.total_packets_in_file << " packets" << endl << endl;
+        }
     }
 
     // GBN sender must respond to three types of events: [EVENT 1] Invocation from above, [EVENT 2] Receipt of an ACK,
@@ -89,13 +1039,13 @@ int driver(char *file_name) {
         // Updates relevant state variables
         if (state.update_state_flag) {
 
-            if (state.outstanding_acknowledgements == WINDOW_SIZE) {
+            if (sender.outstanding() >= send_limit()) {
                 state.full_window = true;
             } else {
                 state.full_window = false;
             }
 
-            if (state.outstanding_acknowledgements == 0) {
+            if (sender.outstanding() == 0) {
                 state.empty_window = true;
             } else {
                 state.empty_window = false;
@@ -104,429 +1054,405 @@ int driver(char *file_name) {
             state.update_state_flag = true;
         }
 
-        // If the failbit or badbit flags are set, remove the flag(s) and allow further operations
-        if (source_file.fail()) {
-            source_file.clear();
-        }
-
-        // If the do_nothing flag is set, the client stop transmitting data but actively listens for acknowledgements.
-        // In this state, any incoming acknowledgements are discarded.
-        if (!state.do_nothing) {
-
-            if (state.verbose_flag) {
+        if (trace::enabled) {
 
-            if (state.total_unique_packets_sent != 0) {
+            if (sender.packets_sent != 0) {
                 cout << endl << "===================================================" << endl << endl << endl << endl;
             }
 
             cout << "===================================================" << endl;
             cout << "Full Window: " << state.full_window << endl;
             cout << "Empty Window: " << state.empty_window << endl;
-            cout << "Resend Window: " << state.resend_window << endl;
-            cout << "Do Nothing: " << state.do_nothing << endl;
-            cout << "Send EOT: " << state.send_eot << endl;
-            cout << "Acknowledgements Pending: " << state.outstanding_acknowledgements << endl;
-            cout << "Total Acknowledgements: " << state.total_unique_packets_acknowledged << endl;
-            cout << "Total Packets sent: " << state.total_unique_packets_sent << endl;
+            cout << "Resend Window: " << sender.resend_window << endl;
+            cout << "Recovery: " << recovery_phase_name(sender.recovery) << endl;
+            cout << "Acknowledgements Pending: " << sender.outstanding() << endl;
+            cout << "Total Acknowledgements: " << sender.packets_acknowledged << endl;
+            cout << "Total Packets sent: " << sender.packets_sent << endl;
             cout << "EOF encountered: " << state.eof_encountered_flag << endl;
             cout << "File seek: " << state.current_file_seek << endl;
-            cout << "Window Base: " << state.window_base << endl;
+            cout << "Window Base: " << sender.window_base << endl;
             cout << "..................................................." << endl << endl;
+        }
 
-            }
-
-            // [Event 1]: Checks if window is full, if it isn't full a packet is created and sent. The window is kept
-            // full before listening for acknowledgements.
-
-            // The window cannot be empty. If there is data left to send, make packets and sent them until window full.
-            if (state.empty_window && state.outstanding_acknowledgements == 0) {
-
-                if (state.verbose_flag) cout << "[STATE]: Window is empty" << endl << endl;
-
-                int packet_sequence_number = state.window_base % MAX_SEQUENCE_NUMBERS;
-                int sequence_number_outside_window = (state.window_base + WINDOW_SIZE) % MAX_SEQUENCE_NUMBERS;
-                int file_seek = state.current_file_seek;
+        // After a timeout, or a run of duplicate acknowledgements, all packets with outstanding acknowledgements are
+        // retransmitted to the server, ahead of any new packet.
+        sender.resend_pending(link, monotonic_ms());
 
-                // While the window isn't full and there is data to send, make a packet and send it.
-                while (packet_sequence_number != sequence_number_outside_window && !state.eof_encountered_flag) {
+        // [Event 1]: Checks if window is full, if it isn't full a packet is created and sent. The window is kept
+        // full before listening for acknowledgements.
 
-                    memset(&payload[0], '\0', sizeof(payload));
-                    memset(&send_packet_data[0], '\0', sizeof(send_packet_data));
+        // The window cannot be empty. If there is data left to send, make packets and sent them until window full.
+        if (state.empty_window && sender.outstanding() == 0) {
 
-                    // Read a appropriate chunk of data from the file.
-                    source_file.seekg(file_seek * sizeof(send_packet_data));
-                    source_file.read(send_packet_data, sizeof(send_packet_data));
+            if (trace::enabled) cout << "[STATE]: Window is empty" << endl << endl;
 
-                    // If the number of characters read is less than the packet data size available, either EOF has
-                    // been reached or there is a file stream error.
-                    if (source_file.gcount() < sizeof(send_packet_data)) {
-                        state.eof_encountered_flag = true;
-                        state.update_state_flag = true;
+            int packet_sequence_number = sender.next_sequence_number();
+            int sequence_number_outside_window = space.wrap(sender.window_base + config.window_size);
+            int file_seek = state.current_file_seek;
 
-                        if (source_file.gcount() == 0) {
-                            state.instream_error_state_flag = true;
-                            break;
-                        }
-                    }
+            // While the window isn't full and there is data to send, make a packet and send it.
+            while (packet_sequence_number != sequence_number_outside_window && !state.eof_encountered_flag &&
+                   sender.outstanding() < send_limit() && pacing.admit()) {
 
-                    packet *send_packet = new packet(1, packet_sequence_number, sizeof(send_packet_data),
-                                                     send_packet_data);  // new operator used for dynamic memory allocation.
-                    send_packet->serialize(payload);
-                    delete send_packet;  // delete operator deallocates send_packet from heap memory.
+                // Get the prepared chunk of data from the file.
+                prepared_chunk *chunk = chunks.get(file_seek);
+                int chunk_length = chunk ? chunk->raw_length : 0;
 
-                    // Send a message to the server socket using UDP datagrams.
-                    if ((num_bytes = sendto(talker.socket_fd, payload, sizeof(payload), 0,
-                                            (const sockaddr *) &recv_from,
-                                            sizeof(recv_from))) == -1) {
-                        perror("(client) error when calling sendto:");
-                        exit(EXIT_FAILURE);
-                    }
+                // If the number of characters read is less than the packet data size available, either EOF has
+                // been reached or there is a file stream error.
+                if (chunk_length < payload_size) {
+                    state.eof_encountered_flag = true;
+                    state.update_state_flag = true;
+                    note_end_of_input<trace>(fec, repair_storage.data(), file_seek + (chunk_length > 0 ? 1 : 0),
+                                      previous_sequence_number(space, packet_sequence_number));
 
-                    if (state.verbose_flag) {
-                        cout << "Client sent a packet with sequence number " << packet_sequence_number << endl << endl;
+                    if (chunk_length == 0) {
+                        state.instream_error_state_flag = true;
+                        break;
                     }
+                }
 
-                    // Write the packet's sequence number to the log file
-                    seqlog_file << packet_sequence_number << endl;
+                distribute_data_packet<trace>(packet_sequence_number, file_seek, chunk, chunks.stable(chunk));
+                protect_data_packet<trace>(fec, repair_storage.data(), packet_sequence_number, file_seek, chunk);
+                sender.sent(packet_sequence_number, file_seek, monotonic_ms());
 
-                    // Add the current file seek and sequence number combo to their respective lists.
-                    window_number_sequence.push_back(packet_sequence_number);
-                    window_file_seek_sequence.push_back(file_seek);
+                // Write the packet's sequence number to the log file
+                seqlog_file.record(packet_sequence_number);
 
-                    packet_sequence_number = (packet_sequence_number + 1) % MAX_SEQUENCE_NUMBERS;
-                    state.outstanding_acknowledgements++;
-                    state.total_unique_packets_sent++;
-                    file_seek++;
-                }
-                state.next_sequence_number = packet_sequence_number;
-                state.current_file_seek = file_seek;
+                packet_sequence_number = next_sequence_number(space, packet_sequence_number);
+                file_seek++;
             }
+            state.current_file_seek = file_seek;
+        }
 
-            // The code block below verifies that the window has space before sending new packets keeping window full.
-            if (!state.full_window && !state.empty_window && !state.eof_encountered_flag) {
+        // The code block below verifies that the window has space before sending new packets keeping window full.
+        if (!state.full_window && !state.empty_window && !state.eof_encountered_flag) {
 
-                if (state.verbose_flag) cout << "[STATE]: Window is neither full nor empty" << endl << endl;
-                int packet_sequence_number = state.next_sequence_number % MAX_SEQUENCE_NUMBERS;
-                int file_seek = state.current_file_seek;
+            if (trace::enabled) cout << "[STATE]: Window is neither full nor empty" << endl << endl;
+            int packet_sequence_number = sender.next_sequence_number();
+            int file_seek = state.current_file_seek;
 
-                while (!state.eof_encountered_flag && state.outstanding_acknowledgements < WINDOW_SIZE) {
+            while (!state.eof_encountered_flag && sender.outstanding() < send_limit() && pacing.admit()) {
 
-                    memset(&send_packet_data[0], '\0', sizeof(send_packet_data));
+                // Get the prepared chunk of data from the file.
+                prepared_chunk *chunk = chunks.get(file_seek);
+                int chunk_length = chunk ? chunk->raw_length : 0;
 
-                    // Read a appropriate chunk of data from the file.
-                    source_file.seekg(file_seek * sizeof(send_packet_data));
-                    source_file.read(send_packet_data, sizeof(send_packet_data));
+                // If the number of characters read from source file is less than the packet data size expected,
+                // then end of file flag is set. An empty chunk (the file ends on a packet boundary) is not sent.
+                if (chunk_length < payload_size) {
+                    state.eof_encountered_flag = true;
+                    note_end_of_input<trace>(fec, repair_storage.data(), file_seek + (chunk_length > 0 ? 1 : 0),
+                                      previous_sequence_number(space, packet_sequence_number));
 
-                    // If the number of characters read from source file is less than the packet data size expected,
-                    // then end of file flag is set
-                    if (source_file.gcount() < sizeof(send_packet_data)) {
-                        state.eof_encountered_flag = true;
+                    if (chunk_length == 0) {
+                        break;
                     }
+                }
 
-                    packet *send_packet = new packet(1, packet_sequence_number, sizeof(send_packet_data),
-                                                     send_packet_data);  // new operator used for dynamic memory allocation.
-
-                    send_packet->serialize(payload);
-                    delete send_packet;  // delete operator deallocates send_packet from heap memory.
+                distribute_data_packet<trace>(packet_sequence_number, file_seek, chunk, chunks.stable(chunk));
+                protect_data_packet<trace>(fec, repair_storage.data(), packet_sequence_number, file_seek, chunk);
+                sender.sent(packet_sequence_number, file_seek, monotonic_ms());
 
-                    // Send a message to the server socket using UDP datagrams.
-                    if ((num_bytes = sendto(talker.socket_fd, payload, sizeof(payload), 0,
-                                            (const sockaddr *) &recv_from,
-                                            sizeof(recv_from))) == -1) {
-                        perror("(client) error when calling sendto:");
-                        exit(EXIT_FAILURE);
-                    }
+                // Write the packet's sequence number to the log file
+                seqlog_file.record(packet_sequence_number);
 
-                    if (state.verbose_flag) {
-                        cout << "Client sent a packet with sequence number " << packet_sequence_number << endl << endl;
-                    }
+                packet_sequence_number = next_sequence_number(space, packet_sequence_number);
+                file_seek++;
+            }
+            state.current_file_seek = file_seek;
+        }
 
-                    // Write the packet's sequence number to the log file
-                    seqlog_file << packet_sequence_number << endl;
+        // Once every packet has been sent and acknowledged, the transfer ends with the EOT exchange.
+        if (state.eof_encountered_flag && sender.outstanding() == 0 &&
+            sender.packets_acknowledged == state.total_packets_in_file) {
 
-                    // Add the current file seek and sequence number combo to their respective lists.
-                    window_number_sequence.push_back(packet_sequence_number);
-                    window_file_seek_sequence.push_back(file_seek);
+            if (trace::enabled) cout << "[STATE]: Transmission complete, sending EOT to server" << endl << endl;
 
-                    packet_sequence_number = (packet_sequence_number + 1) % MAX_SEQUENCE_NUMBERS;
-                    state.outstanding_acknowledgements++;
-                    state.total_unique_packets_sent++;
-                    file_seek++;
-                }
-                state.next_sequence_number = packet_sequence_number;
-                state.current_file_seek = file_seek;
+            // With checksums on, the EOT carries the CRC32C of the whole file for the server to compare.
+            char digest_field[CHECKSUM_FIELD_LENGTH + 1] = "";
+            if (config.checksum == CHECKSUM_CRC32C) {
+                write_checksum_field(chunks.digest(), digest_field);
             }
 
-            // In case of a timeout, all packets with outstanding acknowledgements are retransmitted to the server.
-            if (state.resend_window) {
+            packet *send_packet = new packet(3, sender.window_base, strlen(digest_field), digest_field);
+            send_packet->serialize(payload);
+            delete send_packet;
+
+            if (receivers.active()) {
+                transfer_failed = !finish_distribution<trace>(payload, sender.window_base, chunks.digest(), buffer,
+                                                              buffer_length, received_payload, seqlog_file,
+                                                              acklog_file);
+                break;
+            }
 
-                if (state.verbose_flag) cout << "[STATE]: Window will resend" << endl << endl;
+            // Every data packet has been acknowledged, so the server holds the whole file and only the EOT itself or
+            // the answer to it can be lost. The EOT is sent again each time eot_timeout passes without an answer, up
+            // to MAX_EOT_ATTEMPTS times; acknowledgements that arrive meanwhile are late duplicates.
+            for (int attempt = 1; attempt <= MAX_EOT_ATTEMPTS && !state.server_sent_eot_flag; attempt++) {
 
-                list<int>::iterator packet_number = window_number_sequence.begin();
-                list<int>::iterator seek_at = window_file_seek_sequence.begin();
+                capture.record(CAPTURE_OUTBOUND, recv_from, payload, strlen(payload), "EOT");
 
-                int packet_sequence_number;
-                int file_seek;
+                // Send an EOT packet to the server over UDP datagrams.
+                if ((num_bytes = sendto(talker.socket_fd, payload, strlen(payload), 0,
+                                        (struct sockaddr *) &recv_from, talker.address_length)) == -1) {
+                    perror("(client) error when calling sendto\n");
+                    exit(1);
+                }
 
-                // Resend sequence number and packet data until interator points to Null.
-                while (packet_number != window_number_sequence.end()) {
+                if (trace::enabled) {
+                    cout << "Client sent an EOT packet with sequence number " << sender.window_base << endl << endl;
+                }
 
-                    packet_sequence_number = *packet_number;
-                    file_seek = *seek_at;
+                // Update log file with EOT sequence number
+                seqlog_file.record(sender.window_base);
 
-                    memset(&send_packet_data[0], '\0', sizeof(send_packet_data));
+                long long eot_deadline = monotonic_ms() + config.eot_timeout_ms, remaining_ms;
 
-                    // Read a appropriate chunk of data from the file.
-                    source_file.seekg(file_seek * sizeof(send_packet_data));
-                    source_file.read(send_packet_data, sizeof(send_packet_data));
+                // Wait for an EOT packet from the server.
+                while (!state.server_sent_eot_flag && (remaining_ms = eot_deadline - monotonic_ms()) > 0) {
 
-                    // If the number of characters read from source file is less than the packet data size expected,
-                    // then end of file flag is set
-                    if (source_file.gcount() < sizeof(send_packet_data)) {
-                        state.eof_encountered_flag = true;
-                    }
+                    memset(&buffer[0], '\0', buffer_length);
+                    num_bytes = receive_acknowledgement<trace>(buffer, buffer_length, (int) remaining_ms);
 
-                    packet *send_packet = new packet(1, packet_sequence_number, sizeof(send_packet_data),
-                                                     send_packet_data);  // new operator used for dynamic memory allocation.
+                    if (num_bytes == -1) {
 
-                    send_packet->serialize(payload);
-                    delete send_packet;  // delete operator deallocates send_packet from heap memory.
+                        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
 
-                    // Send a message to the server socket using UDP datagrams.
-                    if ((num_bytes = sendto(talker.socket_fd, payload, sizeof(payload), 0,
-                                            (const sockaddr *) &recv_from,
-                                            sizeof(recv_from))) == -1) {
-                        perror("(client) error when calling sendto:");
+                        perror("(client) error when calling recvfrom");
                         exit(EXIT_FAILURE);
                     }
 
-                    if (state.verbose_flag) {
-                        cout << "Client sent a packet with sequence number " << packet_sequence_number << endl << endl;
+                    if (atoi(buffer) != 2) {
+                        continue;
                     }
 
-                    packet_number++;
-                    seek_at++;
-                }
-                state.resend_window = false;
-            }
-        }
-
-        memset(&buffer[0], '\0', sizeof(buffer));
+                    packet *acknowledgement = new packet(0, 0, 0, received_payload);
+                    acknowledgement->deserialize(buffer);
 
-        // [Event 2]: Waits for acknowledgement from server.
-        num_bytes = recvfrom(listener.socket_fd, buffer, MAX_BUFFER_LENGTH - 1, 0,
-                (struct sockaddr *) &client_addr, &addr_len);
+                    if (trace::enabled) {
+                        cout << "Client received an EOT packet with sequence number " << sender.window_base;
+                        cout << endl << endl;
+                        cout << "===================================================" << endl;
+                    }
 
-        // [Event 3]: A timeout event when packets are lost or overly delayed. All unacknowledged packets will be
-        // resent to the server. The resend_window is raised.
-        if (num_bytes == -1) {
+                    // Add acknowledgement to the log file.
+                    acklog_file.record(acknowledgement->getSeqNum());
+                    state.server_sent_eot_flag = true;
 
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // The server answers with the CRC32C of what it wrote.
+                    if (config.checksum == CHECKSUM_CRC32C) {
 
-                if (state.verbose_flag) {
-                    cout << "[STATE]: Timeout occured when waiting for acknowledgement" << endl << endl;
-                }
+                        uint32_t server_digest;
 
-                if (state.outstanding_acknowledgements > 0) {
-                    if (!state.do_nothing) state.resend_window = true;
-                } else {
-                    if(state.do_nothing) {
-                        state.do_nothing = false;
+                        if (acknowledgement->getLength() != CHECKSUM_FIELD_LENGTH ||
+                            !read_checksum_field(acknowledgement->getData(), server_digest) ||
+                            server_digest != chunks.digest()) {
+                            fprintf(stderr, "(client) file digest mismatch: the server's copy is corrupt\n");
+                            transfer_failed = true;
+                        } else if (trace::enabled) {
+                            cout << "File digest verified by the server" << endl << endl;
+                        }
                     }
 
-                    if (state.eof_encountered_flag && state.total_unique_packets_acknowledged == state.total_packets_in_file) {
-                        state.send_eot = true;
-                        state.do_nothing = true;
-                    }
+                    delete acknowledgement;
                 }
-            } else {
-                perror("(client) error when calling recvfrom");
-                exit(EXIT_FAILURE);
             }
-        } else {
 
-            packet *acknowledgement = new packet(0, 0, 0, received_payload);
-            acknowledgement->deserialize(buffer);
-            ack_sequence_number = acknowledgement->getSeqNum();
-            delete acknowledgement;
-
-            // Discard any incoming acknowledgements, if do_nothing flag is set.
-            if (state.do_nothing) {
-                if (state.verbose_flag) {
-                    cout << "[STATE]: Acknowledgement for packet " << ack_sequence_number << " out of order. ";
-                    cout << " Acknowledgement dropped" << endl << endl;
-                }
-                continue;
+            if (!state.server_sent_eot_flag) {
+                fprintf(stderr, "(client) no EOT from the server after %d attempts\n", MAX_EOT_ATTEMPTS);
+                transfer_failed = true;
             }
 
-            if (state.verbose_flag) {
-                cout << "[STATE]: Client received an acknowledgement for packet " << ack_sequence_number << endl << endl;
-            }
+            break;
+        }
 
-            // Add acknowledged sequence number to log file.
-            acklog_file << ack_sequence_number << endl;
+        // Prepare the chunks of the next window while waiting for acknowledgements.
+        chunks.prefetch(state.current_file_seek + config.window_size - 1);
 
-            int packets_acknowledged = 0;
-            bool acknowledgement_in_window = false;
+        memset(&buffer[0], '\0', buffer_length);
 
-            // Checks the current window for the acknowledged sequence number and counts the number of packets that
-            // are acknowledged cumulatively.
-            for (list<int>::iterator element = window_number_sequence.begin(); element != window_number_sequence.end(); element++) {
+        // [Event 2]: Waits for acknowledgement from server, at most until the next retransmission deadline. Every
+        // outstanding packet is covered by a timer, so a wait that ends without one is handled as [Event 3] below.
+        int wait_ms = sender.retransmission_timeout_ms;
+        long long next_deadline = sender.timers.next_deadline();
+        if (next_deadline != -1) wait_ms = (int) max(0LL, min((long long) wait_ms, next_deadline - monotonic_ms()));
 
-                packets_acknowledged++;
+        // A packet held back by the pacing is sent once its bucket has the tokens or its turn has come.
+        if (pacing.held()) {
+            wait_ms = min(wait_ms, pacing.delay_ms());
+        } else {
+            pacing.idle();
+        }
 
-                if (*element == ack_sequence_number)
-                {
-                    acknowledgement_in_window = true;
-                    break;
-                }
+        num_bytes = receive_acknowledgement<trace>(buffer, buffer_length, wait_ms);
 
-                if (packets_acknowledged >= WINDOW_SIZE) {
-                    packets_acknowledged = 0;
-                    break;
-                }
-            }
+        if (num_bytes == -1) {
 
-            if (state.total_unique_packets_sent == state.total_packets_in_file && state.outstanding_acknowledgements < WINDOW_SIZE - 1)
-            {
-                if (ack_sequence_number == state.total_unique_packets_sent % MAX_SEQUENCE_NUMBERS) {
-                    acknowledgement_in_window = true;
-                    packets_acknowledged = window_number_sequence.size();
-                }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("(client) error when calling recvfrom");
+                exit(EXIT_FAILURE);
             }
 
-            // If a packet is acknowledged then the window's base is incremented and the appropriate state values are
-            // updated.
-            if (acknowledgement_in_window) {
+        } else if (atoi(buffer) == SYN_ACK_PACKET_TYPE) {
+
+            // A late answer to a retransmitted SYN; the session parameters are already settled.
+            continue;
 
-                for (int counter = 0; counter < packets_acknowledged; counter++) {
+        } else if (receivers.active()) {
 
-                    if (state.verbose_flag) {
-                        if (state.verbose_flag) {
-                            int packet_number = window_number_sequence.front();
-                            cout << "Packet with sequence number " << packet_number << " acknowledged" << endl << endl;
-                        }
-                    }
+            // In a distribution, acknowledgements and NAKs move the state of the receiver that sent them, and the
+            // window follows the slowest receiver (see distribution.h).
+            packet *acknowledgement = new packet(0, 0, 0, received_payload);
+            acknowledgement->deserialize(buffer);
 
-                    state.window_base = (state.window_base + 1) % MAX_SEQUENCE_NUMBERS;
-                    state.total_unique_packets_acknowledged++;
-                    state.outstanding_acknowledgements--;
+            int type = acknowledgement->getType();
+            int member = receivers.find(receiver_tag(acknowledgement->getData(), acknowledgement->getLength()));
+            string window_field(acknowledgement->getData(), acknowledgement->getLength());
+            ack_sequence_number = acknowledgement->getSeqNum();
 
-                    window_file_seek_sequence.pop_front();
-                    window_number_sequence.pop_front();
-                }
-            } else {
+            delete acknowledgement;
+
+            if ((type == 0 || type == NAK_PACKET_TYPE) && member != -1 && !receivers.members[member].dropped) {
 
-                // If the acknowledgement was outside the current window, the window must slide back and resend.
-                if (state.verbose_flag) {
-                    cout << "[STATE]: Acknowledgement for a packet outside current window, window slides back";
+                if (trace::enabled) {
+                    cout << "[STATE]: Client received " << (type == 0 ? "an acknowledgement" : "a NAK");
+                    cout << " for packet " << ack_sequence_number << " from receiver " << receivers.members[member].id;
                     cout << endl << endl;
                 }
 
-                state.empty_window = true;
-                state.eof_encountered_flag = false;
-                state.update_state_flag = true;
-                state.full_window = false;
-                state.do_nothing = true;
-                state.outstanding_acknowledgements = 0;
-                state.total_unique_packets_acknowledged--;
-                state.total_unique_packets_sent = state.total_unique_packets_acknowledged;
-                state.window_base = ack_sequence_number;
-                state.current_file_seek = state.total_unique_packets_acknowledged;
-                state.next_sequence_number = 0;
-                window_number_sequence.clear();
-                window_file_seek_sequence.clear();
-            }
-        }
+                acklog_file.record(ack_sequence_number);
 
-        // If there are no outstanding acknowledgements, and there is no new data to read from the source file, then
-        // send end-of-transmission packet and close the connection after performing the appropriate tasks.
-        if (state.send_eot) {
+                int packets_acknowledged = acknowledge_receiver(sender, receivers.members[member], type,
+                                                                ack_sequence_number, atoi(window_field.c_str()),
+                                                                chunks);
 
-            if (state.verbose_flag) cout << "[STATE]: Transmission complete, sending EOT to server" << endl << endl;
+                if (packets_acknowledged > 0) {
+                    sender.release(packets_acknowledged, monotonic_ms());
+                    release_chunks(sender.packets_acknowledged, chunks);
+                }
+            }
 
-            memset(&send_packet_data[0], '\0', sizeof(send_packet_data));
-            memset(&buffer[0], '\0', sizeof(buffer));
+        } else {
 
-            packet *send_packet = new packet(3, state.window_base % MAX_SEQUENCE_NUMBERS, 0, NULL);
-            send_packet->serialize(payload);
+            packet *acknowledgement = new packet(0, 0, 0, received_payload);
+            acknowledgement->deserialize(buffer);
+            ack_sequence_number = acknowledgement->getSeqNum();
 
-            // Send an EOT packet to the server over UDP datagrams.
-            if ((num_bytes = sendto(talker.socket_fd, payload, sizeof(payload), 0, &recv_from,
-                                    sizeof(recv_from))) == -1) {
-                perror("(client) error when calling sendto\n");
-                exit(1);
+            // The data field, if the server sent one, is its receive window.
+            int advertised_window = -1;
+            if (acknowledgement->getLength() > 0) {
+                string window_field(acknowledgement->getData(), acknowledgement->getLength());
+                advertised_window = atoi(window_field.c_str());
             }
 
-            if (state.verbose_flag) {
-                cout << "Client sent an EOT packet with sequence number " << state.window_base << endl << endl;
+            delete acknowledgement;
+
+            if (trace::enabled) {
+                cout << "[STATE]: Client received an acknowledgement for packet " << ack_sequence_number << endl << endl;
             }
 
-            // Update log file with EOT sequence number
-            seqlog_file << state.window_base % MAX_SEQUENCE_NUMBERS << endl;
+            // Add acknowledged sequence number to log file.
+            acklog_file.record(ack_sequence_number);
+
+            // Every acknowledgement is cumulative: it moves the window, repeats the one for the packet just before
+            // it, or is a late copy of an older one (see classify_acknowledgement in gbn_rules.h). A few duplicates
+            // in a row rewind the window (see gbn_sender.h).
+            int kind = sender.acknowledge(link, ack_sequence_number, monotonic_ms());
 
-            // Wait for an EOT packet from the server.
-            if ((num_bytes = recvfrom(listener.socket_fd, buffer, MAX_BUFFER_LENGTH - 1, 0,
-                                      (struct sockaddr *) &client_addr, &addr_len)) == -1) {
-                perror("(client) error when calling recvfrom");
-                exit(EXIT_FAILURE);
+            // Late acknowledgements may carry a window that is out of date; the others update it.
+            if (advertised_window != -1 && kind != ACKNOWLEDGEMENT_LATE) {
+                state.advertised_window = advertised_window;
             }
 
-            packet *acknowledgement = new packet(0, 0, 0, received_payload);
-            acknowledgement->deserialize(buffer);
+            if (kind == ACKNOWLEDGEMENT_ADVANCES) release_chunks(sender.packets_acknowledged, chunks);
+        }
+
+        // [Event 3]: Retransmission timers that have run out. The window's timer in GBN mode has the window resent;
+        // in per-packet mode, each packet whose own timer expired is resent on its own.
+        if (sender.expire(monotonic_ms())) {
+
+            if (receivers.active()) {
 
-             // If an EOT packet is received, terminate connection.
-            if (acknowledgement->getType() == 2) {
+                int packets_acknowledged = time_out_receivers(sender, chunks);
 
-                if (state.verbose_flag) {
-                    cout << "Client received an EOT packet with sequence number " << state.window_base << endl << endl;
-                    cout << "===================================================" << endl;
+                if (receivers.live() == 0) {
+                    fprintf(stderr, "(client) no receiver is left\n");
+                    transfer_failed = true;
+                    break;
                 }
 
-                // Add acknowledgement to the log file.
-                acklog_file << acknowledgement->getSeqNum() << endl;
-                state.server_sent_eot_flag = true;
+                if (packets_acknowledged > 0) {
+                    sender.release(packets_acknowledged, monotonic_ms());
+                    release_chunks(sender.packets_acknowledged, chunks);
+                }
 
             } else {
+                sender.retransmit_expired(link, monotonic_ms());
+            }
+        }
+    }
 
-                // If EOT packet is not received, resend window.
-                if (acknowledgement->getType() == 0)
-                {
-                    state.window_base = acknowledgement->getSeqNum() % MAX_SEQUENCE_NUMBERS;
-                }
+    if (trace::enabled) {
+        cout << "Packets retransmitted: " << sender.packets_retransmitted << " (" << sender.timeouts << " timeouts, ";
+        cout << sender.rewinds << " rewinds on duplicate acknowledgements)" << endl;
+        cout << "Acknowledgements dropped by the kernel (socket buffer full): " << kernel_drops() << endl;
+        cout << "Payload bytes copied in user space: " << copies.bytes_copied << ", sent in place: ";
+        cout << copies.bytes_in_place << endl;
 
-                if (state.verbose_flag) {
-                    cout << "Client received an out-of-order EOT packet with sequence number ";
-                    cout << state.window_base << endl << endl;
-                    cout << endl << "===================================================" << endl;
+        if (fec.enabled()) {
+            cout << "FEC: " << fec.repairs_per_block() << " repair packets per block of " << config.fec_block;
+            cout << " data packets" << endl;
+        }
 
-                }
-                state.empty_window = true;
-                state.update_state_flag = false;
-                state.eof_encountered_flag = false;
-                if (source_file.fail()) {
-                    source_file.clear();
-                }
-            }
+        if (pacing.enabled()) {
+            cout << "New packets held back by the transfer's rate: " << pacing.held_by_rate << ", by the scheduler's";
+            cout << " rate: " << pacing.held_by_scheduler << ", for other transfers: " << pacing.held_by_turn << endl;
+        }
+
+        if (config.zero_copy) {
+            cout << "MSG_ZEROCOPY sends completed without a copy: " << zero_copy.zero_copied();
+            cout << ", with a kernel copy: " << zero_copy.copied() << endl;
         }
     }
 
+    acknowledgements.stop();
+
     // Close file streams.
     seqlog_file.close();
     acklog_file.close();
 
-    return 0;
+    return transfer_failed ? 1 : 0;
+}
+
+template <typename sequence_space, typename trace>
+int client_engine::run(const sequence_space &space) {
+
+    if (config.retransmission == RETRANSMIT_PACKET) {
+        return run_driver<sequence_space, packet_retransmission, trace>(file_name, space);
+    }
+
+    return run_driver<sequence_space, window_retransmission, trace>(file_name, space);
+}
+
+// Runs the protocol loop specialized for the settings the handshake settled on.
+int driver(char *file_name) {
+
+    client_engine engine;
+    engine.file_name = file_name;
+
+    return select_sequence_space(engine, config.sequence_space, state.verbose_flag);
 }
 
 void initialize_talker(char *host_name, char *server_port) {
 
     int getaddrinfo_call_status;
-    int counter = 0;
+    int family = socket_family(listener.socket_fd);
     struct addrinfo hints, *server_info;
 
     // loading up address structs with getaddrinfo():
     memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_INET;    // use IPv4
+    hints.ai_family = AF_UNSPEC;    // IPv4 or IPv6, whichever the host name has
     hints.ai_socktype = SOCK_DGRAM;    // UDP sockets
 
     // get information about a host name and/or service and load up a struct sockaddr with the result.
@@ -535,23 +1461,43 @@ void initialize_talker(char *host_name, char *server_port) {
         exit(EXIT_FAILURE);
     }
 
-    // loop through all the results and make a socket
+    // The listener's socket sends too, so the first address it can reach is used (see endpoint.h).
     for (talker.p = server_info; talker.p != NULL; talker.p = talker.p->ai_next) {
-        // make a socket using socket call and ensure that it has run error-free
-        if ((talker.socket_fd = socket(talker.p->ai_family, (talker.p)->ai_socktype, talker.p->ai_protocol)) == -1) {
-            perror("(client) error during socket creation");
-            continue;
+        if (adapt_address(talker.p, family, talker.address, talker.address_length)) {
+            break;
         }
-
-        break;
     }
 
     if (talker.p == NULL) {
-        fprintf(stderr, "client: failed to create datagram socket\n");
+        fprintf(stderr, "client: %s cannot be reached from an IPv%d socket\n", host_name, family == AF_INET6 ? 6 : 4);
         exit(EXIT_FAILURE);
     }
 
+    talker.socket_fd = listener.socket_fd;
+
     freeaddrinfo(server_info);  // the server_info structure is no longer needed
+
+    // Every further interface gets a send-only socket of its own, and data packets are striped over all of them.
+    vector<string> interfaces = split_interfaces(config.interfaces);
+    talker.path_fds.assign(1, talker.socket_fd);
+
+    for (size_t position = 1; position < interfaces.size(); position++) {
+
+        int path_fd = socket(family, SOCK_DGRAM, 0);
+
+        if (path_fd == -1 || (family == AF_INET6 && !make_dual_stack(path_fd))) {
+            perror("(client) error during path socket creation");
+            exit(EXIT_FAILURE);
+        }
+
+        if (!bind_to_interface(path_fd, interfaces[position])) {
+            fprintf(stderr, "(client) error when binding a socket to %s: %s\n", interfaces[position].c_str(),
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        talker.path_fds.push_back(path_fd);
+    }
 }
 
 void initialize_listener(char *listen_port) {
@@ -560,96 +1506,177 @@ void initialize_listener(char *listen_port) {
     struct addrinfo hints, *server_info;
     struct timeval wait_time;
     int yes = 1;
-    wait_time.tv_sec = 2;
-    wait_time.tv_usec = 0;
+    wait_time.tv_sec = config.timeout_ms / 1000;
+    wait_time.tv_usec = (config.timeout_ms % 1000) * 1000;
+    vector<string> interfaces = split_interfaces(config.interfaces);
+    bool bound = false;
 
-    // loading up address structs with getaddrinfo():
-    memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_INET;  // use IPv4
-    hints.ai_socktype = SOCK_DGRAM;  // UDP sockets
-    hints.ai_flags = AI_PASSIVE;  // fill in my IP for me
+    // An IPv6 socket also takes IPv4 traffic, so it is tried first; without IPv6, an IPv4 socket is used.
+    int families[2] = {AF_INET6, AF_INET};
 
-    // get information about a host name and/or service and load up a struct sockaddr with the result.
-    if ((getaddrinfo_call_status = getaddrinfo(NULL, listen_port, &hints, &server_info)) != 0) {
-        fprintf(stderr, "(client) error when calling getaddrinfo in listener: %s\n",
-                gai_strerror(getaddrinfo_call_status));
-        exit(EXIT_FAILURE);
-    }
+    for (int attempt = 0; attempt < 2 && !bound; attempt++) {
 
-    // loop through all the results and bind to the first we can
-    for (listener.p = server_info; listener.p != NULL; listener.p = listener.p->ai_next) {
+        // loading up address structs with getaddrinfo():
+        memset(&hints, 0, sizeof hints);
+        hints.ai_family = families[attempt];
+        hints.ai_socktype = SOCK_DGRAM;  // UDP sockets
+        hints.ai_flags = AI_PASSIVE;  // fill in my IP for me
 
-        // make a socket using socket() call, and ensure that it ran error-free
-        if ((listener.socket_fd = socket(listener.p->ai_family, listener.p->ai_socktype,
-                                         listener.p->ai_protocol)) == -1) {
-            perror("(client) error during listener's socket creation");
-            continue;
-        }
+        // get information about a host name and/or service and load up a struct sockaddr with the result.
+        if ((getaddrinfo_call_status = getaddrinfo(NULL, listen_port, &hints, &server_info)) != 0) {
 
-        // helps avoid the "Address already in use" error message.
-        if (setsockopt(listener.socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
-            perror("(client) error when calling setsockopt (SO_REUSEADDR) in listener");
-            exit(EXIT_FAILURE);
-        }
+            if (families[attempt] == AF_INET6) continue;
 
-        // Reference: https://stackoverflow.com/questions/39840877/c-recvfrom-timeout
-        // make this a non-blocking socket
-        if (setsockopt(listener.socket_fd, SOL_SOCKET, SO_RCVTIMEO, &wait_time, sizeof(struct timeval)) == -1) {
-            perror("(client) error when calling setsockopt (SO_RCVTIMEO) in listener");
+            fprintf(stderr, "(client) error when calling getaddrinfo in listener: %s\n",
+                    gai_strerror(getaddrinfo_call_status));
             exit(EXIT_FAILURE);
         }
 
-        // associate a socket with an IP address and port number using the bind() call, and make sure it ran error-free.
-        if (bind(listener.socket_fd, listener.p->ai_addr, listener.p->ai_addrlen) == -1) {
-            close(listener.socket_fd);
-            perror("(client) error when binding socket in listener");
-            continue;
+        // loop through all the results and bind to the first we can
+        for (listener.p = server_info; listener.p != NULL; listener.p = listener.p->ai_next) {
+
+            // make a socket using socket() call, and ensure that it ran error-free
+            if ((listener.socket_fd = socket(listener.p->ai_family, listener.p->ai_socktype,
+                                             listener.p->ai_protocol)) == -1) {
+                if (errno != EAFNOSUPPORT) perror("(client) error during listener's socket creation");
+                continue;
+            }
+
+            if (listener.p->ai_family == AF_INET6 && !make_dual_stack(listener.socket_fd)) {
+                perror("(client) error when calling setsockopt (IPV6_V6ONLY) in listener");
+                exit(EXIT_FAILURE);
+            }
+
+            // helps avoid the "Address already in use" error message.
+            if (setsockopt(listener.socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
+                perror("(client) error when calling setsockopt (SO_REUSEADDR) in listener");
+                exit(EXIT_FAILURE);
+            }
+
+            // Reference: https://stackoverflow.com/questions/39840877/c-recvfrom-timeout
+            // make this a non-blocking socket
+            if (setsockopt(listener.socket_fd, SOL_SOCKET, SO_RCVTIMEO, &wait_time, sizeof(struct timeval)) == -1) {
+                perror("(client) error when calling setsockopt (SO_RCVTIMEO) in listener");
+                exit(EXIT_FAILURE);
+            }
+
+            // With --interface, the session's traffic goes through the first interface given.
+            if (!interfaces.empty() && !bind_to_interface(listener.socket_fd, interfaces[0])) {
+                fprintf(stderr, "(client) error when binding the listener to %s: %s\n", interfaces[0].c_str(),
+                        strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+
+            // associate a socket with an IP address and port number using the bind() call, and make sure it ran
+            // error-free.
+            if (bind(listener.socket_fd, listener.p->ai_addr, listener.p->ai_addrlen) == -1) {
+                close(listener.socket_fd);
+                perror("(client) error when binding socket in listener");
+                continue;
+            }
+
+            bound = true;
+            break;
         }
 
-        break;
+        freeaddrinfo(server_info);  // the server_info structure is no longer needed
     }
 
-    if (listener.p == NULL) {
+    if (!bound) {
         fprintf(stderr, "client: failed to bind socket in listener\n");
         exit(EXIT_FAILURE);
     }
+}
 
-    freeaddrinfo(server_info);  // the server_info structure is no longer needed
+// Sizes the socket buffers to hold a window of data packets on the way out and of acknowledgements on the way in,
+// and applies the other kernel-side settings (see socket_tuning.h).
+void tune_sockets() {
+
+    socket_buffer_sizes sizes;
+
+    for (size_t path = 0; path < talker.path_fds.size(); path++) {
+        sizes = size_socket_buffers(talker.path_fds[path], config.window_size, config.buffer_length(),
+                                    config.socket_buffer);
+    }
+
+    if (!enable_drop_counter(listener.socket_fd) && state.verbose_flag) {
+        cout << "SO_RXQ_OVFL is not available, kernel drops are not counted" << endl << endl;
+    }
+
+    if (config.busy_poll_us > 0 && !enable_busy_poll(listener.socket_fd, config.busy_poll_us) && state.verbose_flag) {
+        cout << "SO_BUSY_POLL could not be set (it needs CAP_NET_ADMIN above net.core.busy_read)" << endl << endl;
+    }
+
+    batch.offload = config.segmentation_offload;
+
+    if (state.verbose_flag) {
+        cout << "Socket buffers: " << sizes.send_bytes << " bytes to send, " << sizes.receive_bytes;
+        cout << " bytes to receive" << endl << endl;
+    }
 }
 
 int main(int argc, char *argv[]) {
 
-    char *host_name, *port1, *port2, *file_name;
+    parse_arguments(argc, argv, "client", config);
+
+    if (config.interactive_flag) {
+        char user_input;
+        cout << endl << endl << "Verbose? (Yes: y \\ No: n):" << endl;
+        cin >> user_input;
+        cout << endl << endl;
+
+        if (user_input == 'y'){
+            config.verbose_level = 1;
+        }
+    }
+
+    state.verbose_flag = (config.verbose_level > 0);
+
+    initialize_listener((char *) config.receive_port.c_str());
+    initialize_talker((char *) config.host_name.c_str(), (char *) config.send_port.c_str());
+    tune_sockets();
+
+    if (!config.capture_file.empty() && !capture.open(config.capture_file.c_str(), "gbn client", listener.socket_fd)) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (!configure_receivers(receivers, config, talker.address, talker.address_length,
+                             socket_family(listener.socket_fd))) {
+        exit(EXIT_FAILURE);
+    }
 
-    // ensure that required entries are provided at run-time.
-    if (argc != 5) {
-        fprintf(stderr,
-                "usage: client <emulatorName: host address of the emulator> <sendToEmulator: UDP port number-\n");
-        fprintf(stderr,
-                "-used by the emulator to receive data from the client> <receiveFromEmulator: UDP port number-\n");
-        fprintf(stderr,
-                "-by the client to receive ACKs for the emulator><fileName: name of the file to be transferred>\n");
+    // The receivers of a distribution are told apart by the ids they give in the handshake, and are repaired on the
+    // window's timer and their NAKs.
+    if (receivers.active() && (!config.handshake_flag || config.retransmission != RETRANSMIT_GBN ||
+                               config.fec_block > 0 || talker.path_fds.size() > 1)) {
+        fprintf(stderr, "(client) a distribution needs the handshake, --retransmission gbn, no FEC and one "
+                        "interface\n");
         exit(EXIT_FAILURE);
     }
 
-    host_name = argv[1];
-    port1 = argv[2];
-    port2 = argv[3];
-    file_name = argv[4];
+    state.retransmission_timeout_ms = config.timeout_ms;
+
+    // Only the handshake can tell the server to expect a batch.
+    if (!config.handshake_flag && is_directory(config.file_name)) {
+        fprintf(stderr, "(client) a directory can only be sent with the handshake enabled\n");
+        exit(EXIT_FAILURE);
+    }
 
-    char user_input;
-    cout << endl << endl << "Verbose? (Yes: y \\ No: n):" << endl;
-    cin >> user_input;
-    cout << endl << endl;
+    if (config.handshake_flag && perform_handshake() != 0) {
+        fprintf(stderr, "\nTERMINATED\n");
+        exit(EXIT_FAILURE);
+    }
 
-    if (user_input == 'y'){
-        state.verbose_flag = true;
+    // The pacing starts once the handshake has settled the payload, which sets the buckets' least depth.
+    if (!pacing.open(config, config.buffer_length())) {
+        exit(EXIT_FAILURE);
     }
 
-    initialize_listener(port2);
-    initialize_talker(host_name, port1);
+    int transfer_status = driver((char *) config.file_name.c_str());
+    pacing.close();
+    capture.close();
 
-    if (driver(file_name) != 0) {
+    if (transfer_status != 0) {
         fprintf(stderr, "\nTERMINATED\n");
         exit(EXIT_FAILURE);
     } else {
@@ -21,27 +21,67 @@
 #include <fstream>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <netdb.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <sys/mman.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <iostream>
 #include <sys/errno.h>
-#include <list>
+#include <vector>
+#include <algorithm>
+#include <time.h>
 #include <map>
 
+#include "log_sink.h"
+#include "config.h"
+#include "handshake.h"
+#include "checksum.h"
+#include "chunk_store.h"
+#include "checkpoint.h"
+#include "input_source.h"
+#include "batch.h"
+#include "zerocopy.h"
+#include "ack_receiver.h"
+#include "fec.h"
+#include "timer_wheel.h"
+#include "endpoint.h"
+#include "socket_tuning.h"
+#include "gbn_rules.h"
+#include "gbn_engine.h"
+#include "gbn_sender.h"
+#include "distribution.h"
+#include "packet_capture.h"
+#include "rate_scheduler.h"
+
+// Chunks the reader thread may prepare ahead of the sender, at the least.
+#define PIPELINE_MIN_QUEUE_LENGTH 64
+
 using namespace std;
 
-#define WINDOW_SIZE 7
-#define MAX_BUFFER_LENGTH 38
-#define MAX_SEQUENCE_NUMBERS 8
 
 struct talker_variables {
     int socket_fd;
     struct addrinfo *p;
+    struct sockaddr_storage address;  // copy of p->ai_addr, which is freed along with the addrinfo list
+    socklen_t address_length;
+    vector<int> path_fds;  // sockets data packets are striped over; the first is socket_fd
+};
+
+// Data packets held back to leave together in one sendmsg() with UDP_SEGMENT (see socket_tuning.h): a run of
+// equally long datagrams for the same socket, all sent with MSG_ZEROCOPY or all without.
+struct segment_batch {
+    bool offload = false;               // false sends every packet as soon as it is added
+    int socket_fd = -1;
+    int segment_length = 0;
+    int total_length = 0;
+    bool zero_copy_send = false;
+    vector<struct iovec> pieces;        // the header and the data of each packet
+    vector<prepared_chunk *> members;
 };
 
 struct listener_variables {
@@ -52,10 +92,7 @@ struct listener_variables {
 struct client_state {
 
     bool full_window = false;
-    bool resend_window = false;
     bool empty_window = true;
-    bool send_eot = false;
-    bool do_nothing = false;
 
     bool server_sent_eot_flag = false;
     bool eof_encountered_flag = false;
@@ -64,13 +101,26 @@ struct client_state {
     bool clear_instream_error_flag = false;
     bool verbose_flag = false;
 
-    int window_base = 0;
-    int outstanding_acknowledgements = 0;
-    int total_unique_packets_acknowledged = 0;
-    int total_unique_packets_sent = 0;
-    int next_sequence_number = 0;
     int current_file_seek = 0;
     int last_acked_file_seek = -1;
     int total_packets_in_file = 0;
 
-};
\ No newline at end of file
+    int advertised_window = -1;  // packets the server last said it can buffer, -1 until it says
+
+    // The window, its timers and the recovery state are the protocol loop's gbn_sender (see gbn_sender.h), which
+    // starts with the retransmission timeout the handshake sets.
+    double round_trip_time_ms = 0;  // measured by the handshake
+    int retransmission_timeout_ms = 0;
+
+    long long resume_offset = 0;  // where the server asked a resumed transfer to start
+
+};
+
+// The client's protocol loop, specialized by select_sequence_space() (see gbn_engine.h).
+struct client_engine {
+
+    char *file_name;
+
+    template <typename sequence_space, typename trace>
+    int run(const sequence_space &space);
+};
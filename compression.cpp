@@ -0,0 +1,267 @@
+/*
+
+ * Description:
+   Chunk-level payload compression. See compression.h.
+
+ */
+
+#include "compression.h"
+#include "config.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5   // the LZ4 format requires the last 5 bytes to be literals
+#define MATCH_LIMIT 12    // and the last match to start at least 12 bytes before the end
+
+bool compression_supported(int mode) {
+
+    if (mode == COMPRESSION_NONE || mode == COMPRESSION_LZ4) return true;
+
+#ifdef HAVE_ZSTD
+    if (mode == COMPRESSION_ZSTD) return true;
+#endif
+
+    return false;
+}
+
+#ifndef HAVE_LZ4
+
+static inline uint32_t read32(const unsigned char *position) {
+    uint32_t value;
+    memcpy(&value, position, 4);
+    return value;
+}
+
+// Appends an LZ4 length continuation: runs of 255 followed by the remainder.
+static unsigned char *write_length(unsigned char *output, int length) {
+
+    while (length >= 255) {
+        *output++ = 255;
+        length -= 255;
+    }
+    *output++ = (unsigned char) length;
+
+    return output;
+}
+
+// Greedy LZ4 block encoder. Returns the encoded length, or -1 if it would not fit in output_capacity.
+static int lz4_compress_builtin(const char *input, int input_length, char *output, int output_capacity) {
+
+    const unsigned char *source = (const unsigned char *) input;
+    unsigned char *destination = (unsigned char *) output;
+    unsigned char *destination_end = destination + output_capacity;
+
+    // Small chunks get a small hash table so that clearing it does not cost more than the compression itself.
+    int hash_bits = 8;
+    while ((1 << hash_bits) < input_length && hash_bits < 14) hash_bits++;
+
+    uint32_t hash_table[1 << 14];
+    memset(hash_table, 0, sizeof(uint32_t) << hash_bits);  // entries hold position + 1, so 0 means empty
+
+    int position = 0, anchor = 0;
+    int match_limit = input_length - MATCH_LIMIT;
+
+    while (position < match_limit) {
+
+        uint32_t sequence = read32(source + position);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - hash_bits);
+        int candidate = (int) hash_table[hash] - 1;
+        hash_table[hash] = position + 1;
+
+        if (candidate < 0 || position - candidate > 65535 || read32(source + candidate) != sequence) {
+            position++;
+            continue;
+        }
+
+        int match_length = MIN_MATCH;
+        while (position + match_length < input_length - LAST_LITERALS &&
+               source[candidate + match_length] == source[position + match_length]) {
+            match_length++;
+        }
+
+        int literal_length = position - anchor;
+
+        // token + literal length bytes + literals + offset + match length bytes
+        int sequence_length = 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1;
+        if (destination + sequence_length > destination_end) {
+            return -1;
+        }
+
+        unsigned char *token = destination++;
+        int literal_code = literal_length < 15 ? literal_length : 15;
+        int match_code = (match_length - MIN_MATCH) < 15 ? match_length - MIN_MATCH : 15;
+        *token = (unsigned char) ((literal_code << 4) | match_code);
+
+        if (literal_code == 15) destination = write_length(destination, literal_length - 15);
+        memcpy(destination, source + anchor, literal_length);
+        destination += literal_length;
+
+        int offset = position - candidate;
+        *destination++ = (unsigned char) (offset & 0xff);
+        *destination++ = (unsigned char) (offset >> 8);
+
+        if (match_code == 15) destination = write_length(destination, match_length - MIN_MATCH - 15);
+
+        position += match_length;
+        anchor = position;
+    }
+
+    // The last sequence carries only literals.
+    int literal_length = input_length - anchor;
+
+    if (destination + 1 + literal_length / 255 + 1 + literal_length > destination_end) {
+        return -1;
+    }
+
+    int literal_code = literal_length < 15 ? literal_length : 15;
+    *destination++ = (unsigned char) (literal_code << 4);
+    if (literal_code == 15) destination = write_length(destination, literal_length - 15);
+    memcpy(destination, source + anchor, literal_length);
+    destination += literal_length;
+
+    return (int) (destination - (unsigned char *) output);
+}
+
+// Bounds-checked LZ4 block decoder. Returns the decoded length, or -1 if the input is malformed.
+static int lz4_decompress_builtin(const char *input, int input_length, char *output, int output_capacity) {
+
+    const unsigned char *source = (const unsigned char *) input;
+    const unsigned char *source_end = source + input_length;
+    unsigned char *destination = (unsigned char *) output;
+    unsigned char *destination_end = destination + output_capacity;
+
+    while (source < source_end) {
+
+        int token = *source++;
+        int literal_length = token >> 4;
+
+        if (literal_length == 15) {
+            int extra;
+            do {
+                if (source >= source_end) return -1;
+                extra = *source++;
+                literal_length += extra;
+            } while (extra == 255);
+        }
+
+        if (literal_length > source_end - source || literal_length > destination_end - destination) return -1;
+        memcpy(destination, source, literal_length);
+        source += literal_length;
+        destination += literal_length;
+
+        if (source == source_end) break;  // the last sequence has no match
+
+        if (source_end - source < 2) return -1;
+        int offset = source[0] | (source[1] << 8);
+        source += 2;
+
+        if (offset == 0 || offset > destination - (unsigned char *) output) return -1;
+
+        int match_length = token & 15;
+        if (match_length == 15) {
+            int extra;
+            do {
+                if (source >= source_end) return -1;
+                extra = *source++;
+                match_length += extra;
+            } while (extra == 255);
+        }
+        match_length += MIN_MATCH;
+
+        if (match_length > destination_end - destination) return -1;
+
+        // The match may overlap the bytes it produces, so it is copied forwards one byte at a time.
+        const unsigned char *match = destination - offset;
+        for (int index = 0; index < match_length; index++) {
+            destination[index] = match[index];
+        }
+        destination += match_length;
+    }
+
+    return (int) (destination - (unsigned char *) output);
+}
+
+#endif
+
+// Writes the codec byte and the encoded chunk to output, which must have room for input_length + COMPRESSION_OVERHEAD
+// bytes. Chunks that do not shrink are sent raw. Returns the number of bytes written.
+int compress_chunk(int mode, int level, const char *input, int input_length, char *output) {
+
+    int encoded_length = -1;
+    (void) level;  // only zstd has levels
+    char codec = CODEC_RAW;
+
+    if (mode == COMPRESSION_LZ4) {
+        codec = CODEC_LZ4;
+#ifdef HAVE_LZ4
+        encoded_length = LZ4_compress_default(input, output + 1, input_length, input_length - 1);
+        if (encoded_length == 0) encoded_length = -1;
+#else
+        encoded_length = lz4_compress_builtin(input, input_length, output + 1, input_length - 1);
+#endif
+    }
+
+#ifdef HAVE_ZSTD
+    if (mode == COMPRESSION_ZSTD) {
+        static thread_local ZSTD_CCtx *context = ZSTD_createCCtx();
+        codec = CODEC_ZSTD;
+        size_t result = ZSTD_compressCCtx(context, output + 1, input_length - 1, input, input_length, level);
+        encoded_length = ZSTD_isError(result) ? -1 : (int) result;
+    }
+#endif
+
+    if (encoded_length < 0 || encoded_length >= input_length) {
+        output[0] = CODEC_RAW;
+        memcpy(output + 1, input, input_length);
+        return input_length + 1;
+    }
+
+    output[0] = codec;
+    return encoded_length + 1;
+}
+
+// Decodes a chunk written by compress_chunk(). Returns the decoded length, or -1 if the chunk is malformed or uses a
+// codec this build does not have.
+int decompress_chunk(const char *input, int input_length, char *output, int output_capacity) {
+
+    if (input_length < 1) return -1;
+
+    const char *encoded = input + 1;
+    int encoded_length = input_length - 1;
+
+    switch (input[0]) {
+
+        case CODEC_RAW:
+            if (encoded_length > output_capacity) return -1;
+            memcpy(output, encoded, encoded_length);
+            return encoded_length;
+
+        case CODEC_LZ4:
+#ifdef HAVE_LZ4
+            return LZ4_decompress_safe(encoded, output, encoded_length, output_capacity);
+#else
+            return lz4_decompress_builtin(encoded, encoded_length, output, output_capacity);
+#endif
+
+#ifdef HAVE_ZSTD
+        case CODEC_ZSTD: {
+            static thread_local ZSTD_DCtx *context = ZSTD_createDCtx();
+            size_t result = ZSTD_decompressDCtx(context, output, output_capacity, encoded, encoded_length);
+            return ZSTD_isError(result) ? -1 : (int) result;
+        }
+#endif
+
+        default:
+            return -1;
+    }
+}
@@ -0,0 +1,30 @@
+/*
+
+ * Description:
+   Chunk-level payload compression. Every chunk is compressed on its own, so any packet can be decoded without the
+   packets before it and Go-Back-N retransmissions stay independent. An encoded chunk starts with a codec byte:
+
+     'r'  raw, the chunk did not get smaller
+     'l'  LZ4 block format
+     'z'  zstd frame
+
+   LZ4 is always available: liblz4 is used when the build finds it, and a built-in encoder/decoder for the same block
+   format is used otherwise. zstd needs libzstd (HAVE_ZSTD).
+
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#define CODEC_RAW 'r'
+#define CODEC_LZ4 'l'
+#define CODEC_ZSTD 'z'
+
+#define COMPRESSION_OVERHEAD 1  // the codec byte
+
+bool compression_supported(int mode);
+
+int compress_chunk(int mode, int level, const char *input, int input_length, char *output);
+int decompress_chunk(const char *input, int input_length, char *output, int output_capacity);
+
+#endif
@@ -0,0 +1,453 @@
+/*
+
+ * Description:
+   Command line and config file parsing for the client and the server. See config.h.
+
+ */
+
+#include "config.h"
+#include "compression.h"
+#include "distribution.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <fstream>
+
+using namespace std;
+
+static const struct option long_options[] = {
+    {"config",          required_argument, NULL, 'c'},
+    {"verbose",         optional_argument, NULL, 'v'},
+    {"interactive",     no_argument,       NULL, 'i'},
+    {"window",          required_argument, NULL, 'w'},
+    {"payload",         required_argument, NULL, 'p'},
+    {"sequence-space",  required_argument, NULL, 's'},
+    {"timeout",         required_argument, NULL, 't'},
+    {"eot-timeout",     required_argument, NULL, 'e'},
+    {"handshake",       required_argument, NULL, 'H'},
+    {"ack-mode",        required_argument, NULL, 'a'},
+    {"checksum",        required_argument, NULL, 'k'},
+    {"retransmission",  required_argument, NULL, 'r'},
+    {"compression",     required_argument, NULL, 'z'},
+    {"compression-level", required_argument, NULL, 'Z'},
+    {"io-backend",      required_argument, NULL, 'b'},
+    {"sync",            required_argument, NULL, 'D'},
+    {"threads",         required_argument, NULL, 'j'},
+    {"log-mode",        required_argument, NULL, 'l'},
+    {"log-block-size",  required_argument, NULL, 'L'},
+    {"checkpoint-interval", required_argument, NULL, 'C'},
+    {"write-buffers",   required_argument, NULL, 'W'},
+    {"interface",       required_argument, NULL, 'I'},
+    {"socket-buffer",   required_argument, NULL, 'B'},
+    {"busy-poll",       required_argument, NULL, 'P'},
+    {"segmentation-offload", required_argument, NULL, 'G'},
+    {"stream",          required_argument, NULL, 'S'},
+    {"zero-copy",       required_argument, NULL, 'y'},
+    {"fec-block",       required_argument, NULL, 'F'},
+    {"fec-redundancy",  required_argument, NULL, 'R'},
+    {"receivers",       required_argument, NULL, 'M'},
+    {"group-size",      required_argument, NULL, 'N'},
+    {"group",           required_argument, NULL, 'g'},
+    {"nak-backoff",     required_argument, NULL, 'K'},
+    {"rate",            required_argument, NULL, 'T'},
+    {"scheduler",       required_argument, NULL, 'Y'},
+    {"scheduler-rate",  required_argument, NULL, 'U'},
+    {"priority",        required_argument, NULL, 'O'},
+    {"weight",          required_argument, NULL, 'X'},
+    {"capture",         required_argument, NULL, 'q'},
+    {"help",            no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+};
+
+static const char *short_options = "c:v::iw:p:s:t:e:H:a:k:r:z:Z:b:D:j:l:L:C:W:I:B:P:G:S:y:F:R:M:N:g:K:T:Y:U:O:X:q:h";
+
+// Options only one of the binaries reads. The other refuses them on its command line rather than ignore them; a config
+// file may be shared by both, so its entries are applied either way.
+static const char *client_options[] = {"retransmission", "stream", "threads", "receivers", "group-size", "rate",
+                                       "scheduler", "scheduler-rate", "priority", "weight", NULL};
+static const char *server_options[] = {"io-backend", "sync", "checkpoint-interval", "write-buffers", "group",
+                                       "nak-backoff", NULL};
+
+static const char *ack_mode_names[] = {"gbn", "sr", "sack", NULL};
+static const char *checksum_names[] = {"none", "crc32c", NULL};
+static const char *retransmission_names[] = {"gbn", "packet", NULL};
+static const char *sync_policy_names[] = {"none", "flush", "block", NULL};
+static const char *compression_names[] = {"none", "lz4", "zstd", NULL};
+static const char *priority_names[] = {"bulk", "interactive", NULL};
+
+static const char *name_at(const char **names, int index) {
+
+    for (int position = 0; names[position] != NULL; position++) {
+        if (position == index) return names[position];
+    }
+
+    return "unknown";
+}
+
+static int index_of(const char **names, const char *name) {
+
+    for (int position = 0; names[position] != NULL; position++) {
+        if (strcmp(names[position], name) == 0) return position;
+    }
+
+    return -1;
+}
+
+const char *ack_mode_name(int mode) { return name_at(ack_mode_names, mode); }
+int ack_mode_from_name(const char *name) { return index_of(ack_mode_names, name); }
+const char *checksum_name(int mode) { return name_at(checksum_names, mode); }
+int checksum_from_name(const char *name) { return index_of(checksum_names, name); }
+const char *retransmission_name(int mode) { return name_at(retransmission_names, mode); }
+int retransmission_from_name(const char *name) { return index_of(retransmission_names, name); }
+const char *sync_policy_name(int policy) { return name_at(sync_policy_names, policy); }
+int sync_policy_from_name(const char *name) { return index_of(sync_policy_names, name); }
+const char *compression_name(int mode) { return name_at(compression_names, mode); }
+int compression_from_name(const char *name) { return index_of(compression_names, name); }
+const char *priority_name(int priority) { return name_at(priority_names, priority); }
+int priority_from_name(const char *name) { return index_of(priority_names, name); }
+
+static void print_usage(const char *program) {
+
+    fprintf(stderr, "usage: %s [options] <emulatorName> <sendToEmulator> <receiveFromEmulator> <fileName>\n\n", program);
+    fprintf(stderr, "  emulatorName          host address of the emulator\n");
+    fprintf(stderr, "  sendToEmulator        UDP port number used by the emulator to receive data from the %s\n", program);
+    fprintf(stderr, "  receiveFromEmulator   UDP port number used by the %s to receive packets from the emulator\n", program);
+    fprintf(stderr, "  fileName              name of the file to be transferred\n\n");
+    fprintf(stderr, "options (config file keys are the long option names, one `key = value` per line):\n");
+    fprintf(stderr, "  -c, --config FILE           read options from FILE; command line options take precedence\n");
+    fprintf(stderr, "  -v, --verbose[=LEVEL]       print protocol state (default level 1)\n");
+    fprintf(stderr, "  -i, --interactive           ask for the verbose setting on stdin\n");
+    fprintf(stderr, "  -w, --window N              send window size (default %d)\n", DEFAULT_WINDOW_SIZE);
+    fprintf(stderr, "  -p, --payload N             payload bytes per packet (default %d)\n", DEFAULT_PAYLOAD_SIZE);
+    fprintf(stderr, "  -s, --sequence-space N      number of sequence numbers (default %d)\n", DEFAULT_SEQUENCE_SPACE);
+    fprintf(stderr, "  -t, --timeout MS            retransmission timeout, or its upper bound once the handshake has\n");
+    fprintf(stderr, "                              measured the round trip time (default %d)\n", DEFAULT_TIMEOUT_MS);
+    fprintf(stderr, "  -e, --eot-timeout MS        time to wait for the EOT reply (default %d)\n", DEFAULT_TIMEOUT_MS);
+    fprintf(stderr, "  -H, --handshake 0|1         negotiate session parameters with the server first (default 1)\n");
+    fprintf(stderr, "  -a, --ack-mode MODE         acknowledgement mode to request: gbn, sr or sack\n");
+    fprintf(stderr, "  -k, --checksum MODE         payload checksum to request: none or crc32c\n");
+    fprintf(stderr, "  -r, --retransmission MODE   (client) on a timeout resend the whole window (gbn) or, with FEC,\n");
+    fprintf(stderr, "                              only the packets whose own timer expired (packet) (default gbn)\n");
+    fprintf(stderr, "  -z, --compression MODE      payload compression to request: none, lz4 or zstd\n");
+    fprintf(stderr, "  -Z, --compression-level N   zstd compression level (default 1)\n");
+    fprintf(stderr, "  -y, --zero-copy 0|1         send with MSG_ZEROCOPY and receive data straight into the output\n");
+    fprintf(stderr, "                              buffer; both sides must enable it (default 0)\n");
+    fprintf(stderr, "  -F, --fec-block K           send Reed-Solomon repair packets for every K data packets so the\n");
+    fprintf(stderr, "                              server can rebuild lost ones, 0 for none (default 0); the client's\n");
+    fprintf(stderr, "                              K applies, and without the handshake both sides need the same K\n");
+    fprintf(stderr, "  -R, --fec-redundancy PCT    repair packets per block as a percentage of K (default %d)\n",
+            DEFAULT_FEC_REDUNDANCY);
+    fprintf(stderr, "  -S, --stream 0|1            (client) read the input front to back without asking for its length;\n");
+    fprintf(stderr, "                              pipes, sockets and - (stdin) always are (default 0)\n");
+    fprintf(stderr, "  -b, --io-backend NAME       (server) output backend: stream, or direct to write the output with\n");
+    fprintf(stderr, "                              O_DIRECT, bypassing the page cache (default stream)\n");
+    fprintf(stderr, "  -D, --sync POLICY           (server) fdatasync() the output never (none), at every checkpoint and\n");
+    fprintf(stderr, "                              at the end (flush), or after every block (block) (default none)\n");
+    fprintf(stderr, "  -j, --threads N             (client) pipeline threads, 1 runs single-threaded (default 1)\n");
+    fprintf(stderr, "  -l, --log-mode MODE         sequence log writer: buffered, binary or background\n");
+    fprintf(stderr, "  -L, --log-block-size BYTES  sequence log block size (default %d)\n", LOG_SINK_DEFAULT_BLOCK_SIZE);
+    fprintf(stderr, "  -C, --checkpoint-interval N (server) chunks written between checkpoints that let an interrupted\n");
+    fprintf(stderr, "                              transfer resume; 0 disables resuming (default %d)\n",
+            DEFAULT_CHECKPOINT_INTERVAL);
+    fprintf(stderr, "  -W, --write-buffers N       (server) 1 MiB output buffers; with more than one, a thread writes\n");
+    fprintf(stderr, "                              them and their free space is advertised to the client (default %d)\n",
+            DEFAULT_WRITE_BUFFERS);
+    fprintf(stderr, "  -I, --interface LIST        network interfaces to send and receive through, comma-separated; the\n");
+    fprintf(stderr, "                              client stripes data packets over all of them, the server uses the first\n");
+    fprintf(stderr, "  -B, --socket-buffer BYTES   socket send and receive buffer size; 0 sizes them to hold a window of\n");
+    fprintf(stderr, "                              datagrams (default 0)\n");
+    fprintf(stderr, "  -P, --busy-poll USEC        busy-poll the device queue for up to USEC before sleeping on a\n");
+    fprintf(stderr, "                              receive; 0 disables it (default 0)\n");
+    fprintf(stderr, "  -G, --segmentation-offload 0|1  send runs of data packets with UDP GSO (client) and receive them\n");
+    fprintf(stderr, "                              coalesced with UDP GRO (server) (default 0)\n");
+    fprintf(stderr, "  -M, --receivers LIST        (client) also send the file to these servers, comma-separated\n");
+    fprintf(stderr, "                              host[:port] entries, retransmitting to each only what it misses\n");
+    fprintf(stderr, "  -N, --group-size N          (client) servers to wait for when emulatorName is a multicast group\n");
+    fprintf(stderr, "                              (default 1)\n");
+    fprintf(stderr, "  -g, --group ADDR            (server) join the multicast group ADDR to receive a distribution\n");
+    fprintf(stderr, "  -K, --nak-backoff MS        (server) longest random wait before a distribution's receiver\n");
+    fprintf(stderr, "                              reports a lost packet, so one report serves them all (default %d)\n",
+            DEFAULT_NAK_BACKOFF_MS);
+    fprintf(stderr, "  -T, --rate RATE             (client) cap the transfer at RATE bytes per second; k, m and g\n");
+    fprintf(stderr, "                              multiply by a thousand, a million and a billion (default 0, none)\n");
+    fprintf(stderr, "  -Y, --scheduler NAME        (client) share bandwidth with the other clients that name NAME\n");
+    fprintf(stderr, "  -U, --scheduler-rate RATE   (client) cap all of the scheduler's transfers together at RATE\n");
+    fprintf(stderr, "  -O, --priority CLASS        (client) interactive or bulk; a waiting interactive transfer holds\n");
+    fprintf(stderr, "                              the scheduler's bulk transfers back (default bulk)\n");
+    fprintf(stderr, "  -X, --weight N              (client) share of the scheduler's bandwidth within the class\n");
+    fprintf(stderr, "                              (default 1)\n");
+    fprintf(stderr, "  -q, --capture FILE          record every datagram sent and received in FILE, in pcapng\n");
+}
+
+static bool parse_integer(const char *value, int minimum, int maximum, int &result) {
+
+    char *end;
+    errno = 0;
+    long parsed = strtol(value, &end, 10);
+
+    if (errno != 0 || end == value || *end != '\0' || parsed < minimum || parsed > maximum) {
+        return false;
+    }
+
+    result = (int) parsed;
+    return true;
+}
+
+// A rate in bytes per second, with an optional k, m or g suffix.
+static bool parse_rate(const char *value, long long &result) {
+
+    char *end;
+    errno = 0;
+    long long parsed = strtoll(value, &end, 10);
+    long long factor = 1;
+
+    if (end != value) {
+        switch (tolower(*end)) {
+            case 'k': factor = 1000LL; end++; break;
+            case 'm': factor = 1000000LL; end++; break;
+            case 'g': factor = 1000000000LL; end++; break;
+        }
+    }
+
+    if (errno != 0 || end == value || *end != '\0' || parsed < 0 || parsed > (1LL << 40)) {
+        return false;
+    }
+
+    result = parsed * factor;
+    return true;
+}
+
+// Applies a single option, given by its long name. Shared by the command line and the config file so that both accept
+// exactly the same keys and values.
+static bool apply_option(session_config &config, const char *name, const char *value) {
+
+    bool valid = true;
+    bool flag_option = (strcmp(name, "verbose") == 0 || strcmp(name, "interactive") == 0);
+
+    if (value == NULL && !flag_option) {
+        fprintf(stderr, "missing value for %s\n", name);
+        return false;
+    }
+
+    if (strcmp(name, "verbose") == 0) {
+        valid = (value == NULL) ? (config.verbose_level = 1, true) : parse_integer(value, 0, 9, config.verbose_level);
+    } else if (strcmp(name, "interactive") == 0) {
+        config.interactive_flag = (value == NULL || strcmp(value, "0") != 0);
+    } else if (strcmp(name, "window") == 0) {
+        valid = parse_integer(value, 1, 1 << 30, config.window_size);
+    } else if (strcmp(name, "payload") == 0) {
+        valid = parse_integer(value, 1, MAX_PAYLOAD_SIZE, config.payload_size);
+    } else if (strcmp(name, "sequence-space") == 0) {
+        valid = parse_integer(value, 2, 1 << 30, config.sequence_space);
+    } else if (strcmp(name, "timeout") == 0) {
+        valid = parse_integer(value, 1, 3600000, config.timeout_ms);
+    } else if (strcmp(name, "eot-timeout") == 0) {
+        valid = parse_integer(value, 1, 3600000, config.eot_timeout_ms);
+    } else if (strcmp(name, "handshake") == 0) {
+        int enabled = 1;
+        valid = parse_integer(value, 0, 1, enabled);
+        config.handshake_flag = (enabled == 1);
+    } else if (strcmp(name, "ack-mode") == 0) {
+        config.ack_mode = ack_mode_from_name(value);
+        valid = (config.ack_mode != -1);
+    } else if (strcmp(name, "checksum") == 0) {
+        config.checksum = checksum_from_name(value);
+        valid = (config.checksum != -1);
+    } else if (strcmp(name, "retransmission") == 0) {
+        config.retransmission = retransmission_from_name(value);
+        valid = (config.retransmission != -1);
+    } else if (strcmp(name, "compression") == 0) {
+        config.compression = compression_from_name(value);
+        valid = compression_supported(config.compression);
+    } else if (strcmp(name, "compression-level") == 0) {
+        valid = parse_integer(value, 1, 22, config.compression_level);
+    } else if (strcmp(name, "zero-copy") == 0) {
+        int enabled = 0;
+        valid = parse_integer(value, 0, 1, enabled);
+        config.zero_copy = (enabled == 1);
+    } else if (strcmp(name, "fec-block") == 0) {
+        valid = parse_integer(value, 0, FEC_MAX_BLOCK, config.fec_block);
+    } else if (strcmp(name, "fec-redundancy") == 0) {
+        valid = parse_integer(value, 1, 100, config.fec_redundancy);
+    } else if (strcmp(name, "io-backend") == 0) {
+        config.io_backend = value;
+        valid = (config.io_backend == "stream" || config.io_backend == "direct");
+    } else if (strcmp(name, "sync") == 0) {
+        config.sync_policy = sync_policy_from_name(value);
+        valid = (config.sync_policy != -1);
+    } else if (strcmp(name, "threads") == 0) {
+        valid = parse_integer(value, 1, 64, config.thread_count);
+    } else if (strcmp(name, "log-mode") == 0) {
+        if (strcmp(value, "buffered") == 0) config.log_mode = LOG_SINK_BUFFERED;
+        else if (strcmp(value, "binary") == 0) config.log_mode = LOG_SINK_BINARY;
+        else if (strcmp(value, "background") == 0) config.log_mode = LOG_SINK_BACKGROUND;
+        else valid = false;
+    } else if (strcmp(name, "log-block-size") == 0) {
+        valid = parse_integer(value, 1, 1 << 30, config.log_block_size);
+    } else if (strcmp(name, "checkpoint-interval") == 0) {
+        valid = parse_integer(value, 0, 1 << 30, config.checkpoint_interval);
+    } else if (strcmp(name, "write-buffers") == 0) {
+        valid = parse_integer(value, 1, 64, config.write_buffers);
+    } else if (strcmp(name, "interface") == 0) {
+        config.interfaces = value;
+    } else if (strcmp(name, "socket-buffer") == 0) {
+        valid = parse_integer(value, 0, 1 << 30, config.socket_buffer);
+    } else if (strcmp(name, "busy-poll") == 0) {
+        valid = parse_integer(value, 0, 1000000, config.busy_poll_us);
+    } else if (strcmp(name, "segmentation-offload") == 0) {
+        int enabled = 0;
+        valid = parse_integer(value, 0, 1, enabled);
+        config.segmentation_offload = (enabled == 1);
+    } else if (strcmp(name, "receivers") == 0) {
+        config.receivers = value;
+    } else if (strcmp(name, "group-size") == 0) {
+        valid = parse_integer(value, 1, DISTRIBUTION_MAX_RECEIVERS, config.group_size);
+    } else if (strcmp(name, "group") == 0) {
+        config.group = value;
+    } else if (strcmp(name, "nak-backoff") == 0) {
+        valid = parse_integer(value, 0, 60000, config.nak_backoff_ms);
+    } else if (strcmp(name, "rate") == 0) {
+        valid = parse_rate(value, config.rate);
+    } else if (strcmp(name, "scheduler") == 0) {
+        config.scheduler = value;
+        valid = (!config.scheduler.empty() && config.scheduler.size() < 200 && strchr(value, '/') == NULL);
+    } else if (strcmp(name, "scheduler-rate") == 0) {
+        valid = parse_rate(value, config.scheduler_rate);
+    } else if (strcmp(name, "priority") == 0) {
+        config.priority = priority_from_name(value);
+        valid = (config.priority != -1);
+    } else if (strcmp(name, "weight") == 0) {
+        valid = parse_integer(value, 1, 1000, config.weight);
+    } else if (strcmp(name, "capture") == 0) {
+        config.capture_file = value;
+    } else if (strcmp(name, "stream") == 0) {
+        int enabled = 0;
+        valid = parse_integer(value, 0, 1, enabled);
+        config.streaming = (enabled == 1);
+    } else {
+        fprintf(stderr, "unknown option: %s\n", name);
+        return false;
+    }
+
+    if (!valid) {
+        fprintf(stderr, "invalid value for %s: %s\n", name, value ? value : "(none)");
+    }
+
+    return valid;
+}
+
+// Reads `key = value` lines. Blank lines and lines starting with '#' are ignored.
+bool load_config_file(const char *path, session_config &config) {
+
+    ifstream config_file(path);
+    string line;
+    int line_number = 0;
+
+    if (!config_file) {
+        fprintf(stderr, "error when opening config file %s\n", path);
+        return false;
+    }
+
+    while (getline(config_file, line)) {
+
+        line_number++;
+
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') {
+            continue;
+        }
+
+        size_t separator = line.find('=');
+        string key = line.substr(first, (separator == string::npos) ? string::npos : separator - first);
+        string value = (separator == string::npos) ? "" : line.substr(separator + 1);
+
+        key.erase(key.find_last_not_of(" \t\r") + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r") + 1);
+
+        if (!apply_option(config, key.c_str(), (separator == string::npos) ? NULL : value.c_str())) {
+            fprintf(stderr, "%s:%d: bad config entry\n", path, line_number);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void parse_arguments(int argc, char *argv[], const char *program, session_config &config) {
+
+    int option;
+
+    // The config file is loaded first so that anything given on the command line overrides it.
+    opterr = 0;
+    while ((option = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+        if (option == 'c' && !load_config_file(optarg, config)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    optind = 0;  // restart getopt for the second pass
+    opterr = 1;
+
+    while ((option = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+
+        if (option == 'c') {
+            continue;
+        }
+
+        if (option == 'h' || option == '?') {
+            print_usage(program);
+            exit(option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        const char *name = NULL;
+        for (const struct option *entry = long_options; entry->name != NULL; entry++) {
+            if (entry->val == option) {
+                name = entry->name;
+                break;
+            }
+        }
+
+        if (name != NULL && index_of(strcmp(program, "client") == 0 ? server_options : client_options, name) != -1) {
+            fprintf(stderr, "%s: --%s does nothing for the %s\n", program, name, program);
+            exit(EXIT_FAILURE);
+        }
+
+        if (name == NULL || !apply_option(config, name, optarg)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // ensure that required entries are provided at run-time.
+    if (argc - optind != 4) {
+        print_usage(program);
+        exit(EXIT_FAILURE);
+    }
+
+    config.host_name = argv[optind];
+    config.send_port = argv[optind + 1];
+    config.receive_port = argv[optind + 2];
+    config.file_name = argv[optind + 3];
+
+    if (config.window_size >= config.sequence_space) {
+        fprintf(stderr, "%s: the window size (%d) must be smaller than the sequence space (%d)\n", program,
+                config.window_size, config.sequence_space);
+        exit(EXIT_FAILURE);
+    }
+
+    // FEC only uses packets whose checksums match (see fec.h).
+    if (config.fec_block > 0) {
+        config.checksum = CHECKSUM_CRC32C;
+    }
+
+    // The handshake shrinks the window to fit FEC; without it, the settings have to fit already.
+    if (config.fec_block > 0 && !config.handshake_flag && config.window_size > config.sequence_space / 2) {
+        fprintf(stderr, "%s: with FEC the window size (%d) must be at most half the sequence space (%d)\n", program,
+                config.window_size, config.sequence_space);
+        exit(EXIT_FAILURE);
+    }
+}
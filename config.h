@@ -0,0 +1,148 @@
+/*
+
+ * Description:
+   Run-time configuration shared by the client and the server. Every value can be given on the command line or in a
+   config file of `key = value` lines (the keys are the long option names), so unattended runs no longer need the
+   interactive prompt and the protocol constants no longer need a recompile.
+
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include "log_sink.h"
+
+#define DEFAULT_WINDOW_SIZE 7
+#define DEFAULT_PAYLOAD_SIZE 30
+// A datagram delayed until its sequence number comes round again is taken for a new one, and its stale data written
+// or its stale acknowledgement counted. With 65536 numbers that takes 65536 - window packets of reordering, so the
+// default is safe on real paths; a power of two keeps the wrap a mask (see gbn_engine.h).
+#define DEFAULT_SEQUENCE_SPACE 65536
+#define DEFAULT_TIMEOUT_MS 2000
+#define DEFAULT_CHECKPOINT_INTERVAL 256
+#define DEFAULT_WRITE_BUFFERS 4
+#define DEFAULT_FEC_REDUNDANCY 25
+#define DEFAULT_NAK_BACKOFF_MS 10
+#define FEC_MAX_BLOCK 128        // data packets per FEC block; with as many repair packets it stays within GF(256)
+#define MAX_HEADER_LENGTH 40     // room for the "type seqnum length " text header written by packet::serialize
+#define MAX_PAYLOAD_SIZE 65000   // keeps a packet inside a single UDP datagram
+#define FEC_OVERHEAD 16          // what an FEC repair packet carries beyond a data packet's payload (see fec.h)
+#define MAX_ADVERTISED_WINDOW (1 << 30)  // receive window in an acknowledgement's data field, at most ten digits
+
+enum ack_mode {
+    ACK_MODE_GBN = 0,   // cumulative ACKs, receive window of 1
+    ACK_MODE_SR = 1,    // selective repeat
+    ACK_MODE_SACK = 2   // cumulative ACKs with selective acknowledgement blocks
+};
+
+enum checksum_mode {
+    CHECKSUM_NONE = 0,
+    CHECKSUM_CRC32C = 1  // per-packet CRC32C plus a whole-file digest exchanged at EOT (see checksum.h)
+};
+
+enum retransmission_mode {
+    RETRANSMIT_GBN = 0,    // one timer for the oldest outstanding packet; on expiry the whole window is resent
+    RETRANSMIT_PACKET = 1  // a timer for every outstanding packet; on expiry only that packet is resent
+};
+
+enum sync_policy {
+    SYNC_NONE = 0,   // the kernel writes the output back when it sees fit
+    SYNC_FLUSH = 1,  // fdatasync() at every checkpoint and at the end of the file
+    SYNC_BLOCK = 2   // fdatasync() after every output block
+};
+
+enum priority_class {
+    PRIORITY_BULK = 0,
+    PRIORITY_INTERACTIVE = 1  // holds bulk transfers in the same scheduler back while it waits (see rate_scheduler.h)
+};
+
+enum compression_mode {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_LZ4 = 1,
+    COMPRESSION_ZSTD = 2
+};
+
+struct session_config {
+
+    // Positional arguments, in the order the assignment specifies them.
+    std::string host_name;
+    std::string send_port;
+    std::string receive_port;
+    std::string file_name;
+
+    int verbose_level = 0;
+    bool interactive_flag = false;  // ask "Verbose?" on stdin like the original binaries
+
+    int window_size = DEFAULT_WINDOW_SIZE;
+    int payload_size = DEFAULT_PAYLOAD_SIZE;
+    int sequence_space = DEFAULT_SEQUENCE_SPACE;
+    int timeout_ms = DEFAULT_TIMEOUT_MS;
+    int eot_timeout_ms = DEFAULT_TIMEOUT_MS;
+
+    bool handshake_flag = true;  // negotiate the session parameters before sending data
+    int ack_mode = ACK_MODE_GBN;
+    int checksum = CHECKSUM_NONE;
+    int compression = COMPRESSION_NONE;
+    int compression_level = 1;
+    int retransmission = RETRANSMIT_GBN;  // client only (see timer_wheel.h)
+
+    bool zero_copy = false;  // gather sends with MSG_ZEROCOPY and scatter receives (see zerocopy.h)
+
+    int fec_block = 0;                              // data packets per FEC block, 0 disables FEC (see fec.h)
+    int fec_redundancy = DEFAULT_FEC_REDUNDANCY;    // repair packets per block, as a percentage of fec_block
+
+    bool streaming = false;  // client: read the input as a stream of unknown length (see input_source.h)
+
+    std::string io_backend = "stream";  // server: "direct" writes the output with O_DIRECT (see block_writer.h)
+    int sync_policy = SYNC_NONE;        // server
+    int thread_count = 1;
+
+    int log_mode = LOG_SINK_BUFFERED;
+    int log_block_size = LOG_SINK_DEFAULT_BLOCK_SIZE;
+
+    int checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;  // server: chunks written between checkpoints, 0 disables
+    int write_buffers = DEFAULT_WRITE_BUFFERS;  // server: output blocks, more than one writes in the background
+
+    std::string capture_file;  // pcapng file every datagram is recorded in, empty for none (see packet_capture.h)
+
+    std::string interfaces;  // comma-separated network interfaces, empty to let routing decide (see endpoint.h)
+    int socket_buffer = 0;       // socket buffer bytes, 0 sizes them from the window (see socket_tuning.h)
+    int busy_poll_us = 0;        // SO_BUSY_POLL time, 0 disables busy polling
+    bool segmentation_offload = false;  // UDP GSO on the client, UDP GRO on the server
+
+    // One-to-many distribution (see distribution.h).
+    std::string receivers;       // client: further receivers, comma-separated host[:port]
+    int group_size = 0;          // client: receivers in the multicast group the client sends to
+    std::string group;           // server: multicast group to join
+    int nak_backoff_ms = DEFAULT_NAK_BACKOFF_MS;  // server: longest random wait before reporting a gap
+
+    // Pacing of the client's sends (see rate_scheduler.h).
+    long long rate = 0;            // client: bytes per second this transfer may send, 0 for no cap
+    std::string scheduler;         // client: scheduler shared with other transfers, empty for none
+    long long scheduler_rate = 0;  // client: bytes per second for all the scheduler's transfers together
+    int priority = PRIORITY_BULK;  // client
+    int weight = 1;                // client: share of the bandwidth among the scheduler's transfers of its class
+
+    // Size of the datagram buffers needed for the configured payload. The header reserve also covers the checksum field
+    // and the codec byte that can precede the payload, and the FEC reserve the fields of a repair packet.
+    int buffer_length() const { return payload_size + MAX_HEADER_LENGTH + FEC_OVERHEAD; }
+};
+
+void parse_arguments(int argc, char *argv[], const char *program, session_config &config);
+bool load_config_file(const char *path, session_config &config);
+
+const char *ack_mode_name(int mode);
+int ack_mode_from_name(const char *name);
+const char *checksum_name(int mode);
+int checksum_from_name(const char *name);
+const char *retransmission_name(int mode);
+int retransmission_from_name(const char *name);
+const char *sync_policy_name(int policy);
+int sync_policy_from_name(const char *name);
+const char *compression_name(int mode);
+int compression_from_name(const char *name);
+const char *priority_name(int priority);
+int priority_from_name(const char *name);
+
+#endif
@@ -0,0 +1,227 @@
+/*
+
+ * Description:
+   Receiver bookkeeping for one-to-many distribution. See distribution.h.
+
+ */
+
+#include "distribution.h"
+#include "endpoint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+
+using namespace std;
+
+int receiver_set::find(int id) const {
+
+    for (size_t position = 0; position < members.size(); position++) {
+        if (members[position].id == id) return (int) position;
+    }
+
+    return -1;
+}
+
+int receiver_set::live() const {
+
+    int count = 0;
+
+    for (size_t position = 0; position < members.size(); position++) {
+        if (members[position].id != -1 && !members[position].dropped) count++;
+    }
+
+    return count;
+}
+
+// Packets every receiver still taking part has acknowledged; sent once none is left.
+long long receiver_set::slowest(long long sent) const {
+
+    long long lowest = sent;
+
+    for (size_t position = 0; position < members.size(); position++) {
+        const receiver_state &receiver = members[position];
+        if (receiver.id != -1 && !receiver.dropped) lowest = min(lowest, receiver.acknowledged);
+    }
+
+    return lowest;
+}
+
+// The smallest window the receivers advertise, -1 while none has.
+int receiver_set::advertised_window() const {
+
+    int smallest = -1;
+
+    for (size_t position = 0; position < members.size(); position++) {
+
+        const receiver_state &receiver = members[position];
+
+        if (receiver.id != -1 && !receiver.dropped && receiver.advertised_window != -1 &&
+            (smallest == -1 || receiver.advertised_window < smallest)) {
+            smallest = receiver.advertised_window;
+        }
+    }
+
+    return smallest;
+}
+
+// The round trip to the farthest receiver, which the retransmission timeout has to cover.
+double receiver_set::round_trip_time_ms() const {
+
+    double longest = 0;
+
+    for (size_t position = 0; position < members.size(); position++) {
+        if (members[position].id != -1) longest = max(longest, members[position].round_trip_time_ms);
+    }
+
+    return longest;
+}
+
+// Resolves one --receivers entry: a host name or address, optionally followed by :port (an IPv6 address then goes in
+// brackets). Without a port the receiver listens on default_port, like the client's own destination.
+static bool resolve_receiver(const string &entry, const string &default_port, int family, receiver_state &receiver) {
+
+    string host = entry, port = default_port;
+    size_t separator = entry.rfind(':');
+
+    if (!entry.empty() && entry[0] == '[') {
+
+        size_t closing = entry.find(']');
+        if (closing == string::npos) return false;
+
+        host = entry.substr(1, closing - 1);
+        if (closing + 1 < entry.size()) {
+            if (entry[closing + 1] != ':') return false;
+            port = entry.substr(closing + 2);
+        }
+
+    } else if (separator != string::npos && entry.find(':') == separator) {
+        host = entry.substr(0, separator);
+        port = entry.substr(separator + 1);
+    }
+
+    struct addrinfo hints, *receiver_info, *result;
+    int getaddrinfo_call_status;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    if ((getaddrinfo_call_status = getaddrinfo(host.c_str(), port.c_str(), &hints, &receiver_info)) != 0) {
+        fprintf(stderr, "(client) receiver %s: %s\n", entry.c_str(), gai_strerror(getaddrinfo_call_status));
+        return false;
+    }
+
+    for (result = receiver_info; result != NULL; result = result->ai_next) {
+        if (adapt_address(result, family, receiver.address, receiver.address_length)) break;
+    }
+
+    freeaddrinfo(receiver_info);
+
+    if (result == NULL) {
+        fprintf(stderr, "(client) receiver %s cannot be reached from an IPv%d socket\n", entry.c_str(),
+                family == AF_INET6 ? 6 : 4);
+        return false;
+    }
+
+    return true;
+}
+
+// Sets up the receivers from the client's settings: a multicast destination makes a group distribution, a --receivers
+// list a distribution to the destination and every receiver listed. Anything else leaves the set inactive.
+bool configure_receivers(receiver_set &receivers, const session_config &config,
+                         const struct sockaddr_storage &destination, socklen_t destination_length, int family) {
+
+    receivers.group = is_multicast_address(destination);
+    receivers.members.clear();
+
+    if (receivers.group) {
+
+        if (!config.receivers.empty()) {
+            fprintf(stderr, "(client) a multicast destination cannot be combined with --receivers\n");
+            return false;
+        }
+
+        receivers.expected = max(config.group_size, 1);
+        return true;
+    }
+
+    if (config.receivers.empty()) {
+        receivers.expected = 0;
+        return true;
+    }
+
+    receiver_state first;
+    memcpy(&first.address, &destination, sizeof(first.address));
+    first.address_length = destination_length;
+    receivers.members.push_back(first);
+
+    vector<string> entries = split_interfaces(config.receivers);
+
+    for (size_t position = 0; position < entries.size(); position++) {
+
+        receiver_state receiver;
+        if (!resolve_receiver(entries[position], config.send_port, family, receiver)) return false;
+        receivers.members.push_back(receiver);
+    }
+
+    if (receivers.members.size() > DISTRIBUTION_MAX_RECEIVERS) {
+        fprintf(stderr, "(client) at most %d receivers can take part in a distribution\n", DISTRIBUTION_MAX_RECEIVERS);
+        return false;
+    }
+
+    receivers.expected = (int) receivers.members.size();
+    return true;
+}
+
+int receiver_tag(const char *data, int length) {
+
+    string field(data, length);
+    size_t start = field.rfind(' ');
+    start = (start == string::npos) ? 0 : start + 1;
+
+    if (start == field.size()) return -1;
+    return atoi(field.c_str() + start);
+}
+
+void receiver_feedback::start(int receiver_id, int window_size, int nak_backoff_ms) {
+
+    id = receiver_id;
+    stride = max(window_size / 4, 1);
+    backoff_ms = nak_backoff_ms;
+    seed = (unsigned int) receiver_id;
+    unacknowledged = 0;
+    owed = false;
+    gap = -1;
+    deadline_ms = -1;
+}
+
+// An in-order packet arrived, which also fills the gap a NAK may be waiting for. Returns true if it is acknowledged at
+// once; otherwise the acknowledgement is owed until the receive queue drains.
+bool receiver_feedback::delivered() {
+
+    deadline_ms = -1;
+    owed = true;
+    return ++unacknowledged >= stride;
+}
+
+// A packet arrived ahead of the expected one. The first one after a gap schedules the gap's NAK.
+void receiver_feedback::ahead(long long delivered_packets, long long now_ms) {
+
+    if (gap == delivered_packets) return;
+
+    gap = delivered_packets;
+    deadline_ms = now_ms + (backoff_ms > 0 ? rand_r(&seed) % (backoff_ms + 1) : 0);
+}
+
+// Receivers on the same host share the addresses the client sees, so they tell themselves apart by a random id.
+int pick_receiver_id() {
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (int) ((getpid() * 2654435761u ^ (unsigned int) now.tv_nsec ^ (unsigned int) now.tv_sec) & 0x7fffffff);
+}
@@ -0,0 +1,126 @@
+/*
+
+ * Description:
+   One-to-many distribution. One client sends a file to several servers ("receivers") at once, and reads and sends
+   every packet once per receiver at most:
+
+     - to a multicast group: the client's destination is a group address, every receiver's server joins the group
+       (--group), and each data packet, repair and EOT is sent to the group once. --group-size tells the client how
+       many receivers to wait for in the handshake;
+     - to a list of receivers: the client's destination plus the --receivers list, each sent its own unicast copy.
+
+   The SYN says how many receivers take part, and each receiver answers with an id of its own (receiver=<id>), which
+   it appends to the data field of its acknowledgements and of its EOT. The client keeps cumulative-acknowledgement
+   state per receiver: the window's base is the slowest receiver's, and lost packets are resent only from where the
+   receiver that is missing them stands, to that receiver alone in list mode, to the group otherwise.
+
+   So that the client is not flooded as receivers are added, receivers do not acknowledge every packet and do not
+   answer every gap with duplicates:
+
+     - acknowledgements are coalesced: one goes out when the receive queue drains, or every quarter of a window;
+     - a gap is reported with a single NAK (type 7, the cumulative acknowledgement of the last in-order packet), sent
+       after a random backoff of up to --nak-backoff. A receiver whose missing packet arrives in the meantime (sent to
+       the group because another receiver reported the same gap first) cancels its NAK. The client in turn ignores a
+       NAK for packets it has resent to the group within the last retransmission timeout.
+
+   Packets from behind (resent for a slower receiver) are not reported as gaps; they only make the receiver
+   acknowledge again. To tell them from packets ahead, the window is at most half the sequence space, as with FEC.
+   A receiver that stays silent through DISTRIBUTION_DROP_TIMEOUTS timeouts in a row is dropped so that the others
+   can finish, and the client then exits with an error. Distributions are not resumable.
+
+ */
+
+#ifndef DISTRIBUTION_H
+#define DISTRIBUTION_H
+
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include "config.h"
+#include "gbn_rules.h"
+
+#define NAK_PACKET_TYPE 7
+#define DISTRIBUTION_MAX_RECEIVERS 1024  // also the factor that numbers each receiver's SYNs apart in the nonce
+#define DISTRIBUTION_DROP_TIMEOUTS 8
+
+// The client's view of one receiver.
+struct receiver_state {
+
+    int id = -1;                        // picked by the receiver, -1 until it has answered the handshake
+    struct sockaddr_storage address;    // where its unicast packets go, in list mode
+    socklen_t address_length = 0;
+    double round_trip_time_ms = 0;
+
+    long long acknowledged = 0;         // packets it has acknowledged in order
+    int advertised_window = -1;
+    int recovery = RECOVERY_OPEN;
+
+    bool heard = false;                 // anything received from it since the last timeout
+    int silent_timeouts = 0;
+    bool dropped = false;
+    bool finished = false;              // it has answered the EOT
+};
+
+// The receivers of a distribution, on the client.
+struct receiver_set {
+
+    bool group = false;                 // sent to a multicast group rather than to each receiver
+    int expected = 0;                   // receivers the handshake waits for, 0 outside a distribution
+    std::vector<receiver_state> members;
+
+    // Packets last resent to the group, and when; the NAKs they already answer are ignored.
+    long long repair_from = -1, repair_until = -1, repaired_at_ms = 0;
+
+    bool active() const { return expected > 0; }
+    bool fan_out() const { return active() && !group; }
+
+    int find(int id) const;
+    int live() const;
+    long long slowest(long long sent) const;
+    int advertised_window() const;
+    double round_trip_time_ms() const;
+};
+
+bool configure_receivers(receiver_set &receivers, const session_config &config,
+                         const struct sockaddr_storage &destination, socklen_t destination_length, int family);
+
+// The id that ends a receiver's data field (its last word), -1 if there is none.
+int receiver_tag(const char *data, int length);
+
+// The receiving side of a distribution: when a server acknowledges and when it sends a NAK. The NAK is owed for a gap,
+// numbered by the packets delivered before it, and is sent once at most.
+class receiver_feedback {
+
+private:
+
+    int stride = 1;                 // in-order packets after which an acknowledgement goes out even if more are queued
+    int unacknowledged = 0;
+    bool owed = false;
+    int backoff_ms = DEFAULT_NAK_BACKOFF_MS;
+    unsigned int seed = 0;
+
+    long long gap = -1;             // the gap the NAK is for
+    long long deadline_ms = -1;     // when the NAK goes out, -1 if none is waiting
+
+public:
+
+    int id = -1;                    // -1 outside a distribution session
+
+    void start(int receiver_id, int window_size, int nak_backoff_ms);
+    void stop() { id = -1; }
+    bool active() const { return id != -1; }
+
+    bool delivered();
+    void behind() { owed = true; }
+    void ahead(long long delivered_packets, long long now_ms);
+
+    bool acknowledgement_owed() const { return owed; }
+    void acknowledged() { owed = false; unacknowledged = 0; }
+
+    long long nak_deadline() const { return deadline_ms; }
+    void nak_sent() { deadline_ms = -1; }
+};
+
+int pick_receiver_id();
+
+#endif
@@ -0,0 +1,141 @@
+/*
+
+ * Description:
+   Socket addressing shared by the client and the server. See endpoint.h.
+
+ */
+
+#include "endpoint.h"
+
+#include <string.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <errno.h>
+
+using namespace std;
+
+int socket_family(int socket_fd) {
+
+    struct sockaddr_storage local;
+    socklen_t local_length = sizeof(local);
+
+    if (getsockname(socket_fd, (struct sockaddr *) &local, &local_length) == -1) return -1;
+    return local.ss_family;
+}
+
+// Lets an IPv6 socket take IPv4 traffic too. Has to be called before bind().
+bool make_dual_stack(int socket_fd) {
+
+    int no = 0;
+    return setsockopt(socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no)) == 0;
+}
+
+bool bind_to_interface(int socket_fd, const string &interface_name) {
+
+    return setsockopt(socket_fd, SOL_SOCKET, SO_BINDTODEVICE, interface_name.c_str(),
+                      interface_name.size() + 1) == 0;
+}
+
+// Splits a comma-separated list of interface names; empty names are skipped.
+vector<string> split_interfaces(const string &interface_list) {
+
+    vector<string> names;
+    size_t start = 0;
+
+    while (start <= interface_list.size()) {
+
+        size_t end = interface_list.find(',', start);
+        if (end == string::npos) end = interface_list.size();
+
+        if (end > start) names.push_back(interface_list.substr(start, end - start));
+        start = end + 1;
+    }
+
+    return names;
+}
+
+bool adapt_address(const struct addrinfo *result, int family, struct sockaddr_storage &address,
+                   socklen_t &address_length) {
+
+    memset(&address, 0, sizeof(address));
+
+    if (result->ai_family == family) {
+        memcpy(&address, result->ai_addr, result->ai_addrlen);
+        address_length = result->ai_addrlen;
+        return true;
+    }
+
+    if (family != AF_INET6 || result->ai_family != AF_INET) return false;
+
+    const struct sockaddr_in *ipv4 = (const struct sockaddr_in *) result->ai_addr;
+    struct sockaddr_in6 *mapped = (struct sockaddr_in6 *) &address;
+
+    mapped->sin6_family = AF_INET6;
+    mapped->sin6_port = ipv4->sin_port;
+    mapped->sin6_addr.s6_addr[10] = 0xff;
+    mapped->sin6_addr.s6_addr[11] = 0xff;
+    memcpy(&mapped->sin6_addr.s6_addr[12], &ipv4->sin_addr, 4);
+
+    address_length = sizeof(struct sockaddr_in6);
+    return true;
+}
+
+bool is_multicast_address(const struct sockaddr_storage &address) {
+
+    if (address.ss_family == AF_INET) {
+        return IN_MULTICAST(ntohl(((const struct sockaddr_in *) &address)->sin_addr.s_addr));
+    }
+
+    if (address.ss_family != AF_INET6) return false;
+
+    const struct in6_addr *ipv6 = &((const struct sockaddr_in6 *) &address)->sin6_addr;
+    if (IN6_IS_ADDR_MULTICAST(ipv6)) return true;
+
+    return IN6_IS_ADDR_V4MAPPED(ipv6) && (ipv6->s6_addr[12] & 0xf0) == 0xe0;
+}
+
+bool join_group(int socket_fd, const string &group_name, const string &interface_name) {
+
+    struct addrinfo hints, *group_info;
+    unsigned int interface_index = 0;
+
+    if (!interface_name.empty() && (interface_index = if_nametoindex(interface_name.c_str())) == 0) return false;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST;
+
+    if (getaddrinfo(group_name.c_str(), NULL, &hints, &group_info) != 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool joined = false;
+    errno = 0;
+
+    if (group_info->ai_family == AF_INET) {
+
+        struct ip_mreqn request;
+        memset(&request, 0, sizeof(request));
+        request.imr_multiaddr = ((struct sockaddr_in *) group_info->ai_addr)->sin_addr;
+        request.imr_ifindex = interface_index;
+
+        joined = IN_MULTICAST(ntohl(request.imr_multiaddr.s_addr)) &&
+                 setsockopt(socket_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) == 0;
+
+    } else if (group_info->ai_family == AF_INET6) {
+
+        struct ipv6_mreq request;
+        request.ipv6mr_multiaddr = ((struct sockaddr_in6 *) group_info->ai_addr)->sin6_addr;
+        request.ipv6mr_interface = interface_index;
+
+        joined = IN6_IS_ADDR_MULTICAST(&request.ipv6mr_multiaddr) &&
+                 setsockopt(socket_fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &request, sizeof(request)) == 0;
+    }
+
+    if (!joined && errno == 0) errno = EINVAL;
+
+    freeaddrinfo(group_info);
+    return joined;
+}
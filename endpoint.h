@@ -0,0 +1,37 @@
+/*
+
+ * Description:
+   Socket addressing shared by the client and the server. Each side uses one UDP socket per session for both
+   directions. Where the system has IPv6, it is an IPv6 socket with IPV6_V6ONLY off, so it also takes IPv4 traffic
+   (dual-stack), and IPv4 peers are addressed through IPv4-mapped IPv6 addresses (::ffff:a.b.c.d). With --interface,
+   sockets are tied to network interfaces with SO_BINDTODEVICE. A server that takes part in a multicast distribution
+   joins the group on its socket (see distribution.h).
+
+ */
+
+#ifndef ENDPOINT_H
+#define ENDPOINT_H
+
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <netdb.h>
+
+int socket_family(int socket_fd);
+bool make_dual_stack(int socket_fd);
+bool bind_to_interface(int socket_fd, const std::string &interface_name);
+std::vector<std::string> split_interfaces(const std::string &interface_list);
+
+// Copies a getaddrinfo() result into address in the form a socket of the given family sends to. Returns false if
+// such a socket cannot reach it.
+bool adapt_address(const struct addrinfo *result, int family, struct sockaddr_storage &address,
+                   socklen_t &address_length);
+
+// Whether address is an IPv4 or IPv6 multicast group, IPv4-mapped groups included.
+bool is_multicast_address(const struct sockaddr_storage &address);
+
+// Joins the multicast group named group_name on socket_fd, through interface_name or the interface routing picks
+// when it is empty. An IPv4 group is joined at the IPv4 level on a dual-stack socket too.
+bool join_group(int socket_fd, const std::string &group_name, const std::string &interface_name);
+
+#endif
@@ -0,0 +1,254 @@
+/*
+
+ * Description:
+   Reed-Solomon forward error correction. See fec.h.
+
+ */
+
+#include "fec.h"
+#include "gf256.h"
+#include "checksum.h"
+#include "compression.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+// Entry (repair, position) of the Cauchy matrix. Addition in GF(256) is exclusive or.
+static uint8_t cauchy_coefficient(int block_size, int repair, int position) {
+    return gf256_inverse((uint8_t) ((block_size + repair) ^ position));
+}
+
+// The longest data field a data packet can have, plus its two length bytes.
+int fec_symbol_length(const session_config &config) {
+
+    int checksum_length = (config.checksum == CHECKSUM_CRC32C) ? CHECKSUM_FIELD_LENGTH : 0;
+    return 2 + checksum_length + config.payload_size + COMPRESSION_OVERHEAD;
+}
+
+int fec_repair_count(const session_config &config) {
+    return max(1, (config.fec_block * config.fec_redundancy + 99) / 100);
+}
+
+void fec_encoder::configure(const session_config &config) {
+
+    block_size = config.fec_block;
+    repair_count = (block_size > 0) ? fec_repair_count(config) : 0;
+    symbol_length = fec_symbol_length(config);
+    checksum_flag = (config.checksum == CHECKSUM_CRC32C);
+
+    repairs.assign(repair_count, vector<uint8_t>(symbol_length, 0));
+    block = 0;
+    added = 0;
+}
+
+// Adds the data packet with index next_index() to the repair symbols. Its data field is given in two pieces, the
+// checksum field and the payload, the way the client sends it.
+void fec_encoder::add(const char *checksum_field, int checksum_length, const char *data, int data_length) {
+
+    uint8_t length_bytes[2] = {(uint8_t) ((checksum_length + data_length) & 0xff),
+                               (uint8_t) ((checksum_length + data_length) >> 8)};
+
+    for (int repair = 0; repair < repair_count; repair++) {
+
+        uint8_t factor = cauchy_coefficient(block_size, repair, added);
+        uint8_t *symbol = repairs[repair].data();
+
+        gf256_multiply_add(symbol, length_bytes, factor, 2);
+        gf256_multiply_add(symbol + 2, (const uint8_t *) checksum_field, factor, checksum_length);
+        gf256_multiply_add(symbol + 2 + checksum_length, (const uint8_t *) data, factor, data_length);
+    }
+
+    added++;
+}
+
+// Writes repair packet number repair of the current block into datagram and returns its length.
+int fec_encoder::write_repair(int repair, char *datagram) {
+
+    int checksum_length = checksum_flag ? CHECKSUM_FIELD_LENGTH : 0;
+    int data_length = checksum_length + FEC_PREFIX_LENGTH + symbol_length;
+    int header_length = sprintf(datagram, "%d %d %d ", FEC_REPAIR_PACKET_TYPE, block, data_length);
+
+    char *prefix = datagram + header_length + checksum_length;
+    sprintf(prefix, "%03d %03d ", added, repair);
+    memcpy(prefix + FEC_PREFIX_LENGTH, repairs[repair].data(), symbol_length);
+
+    if (checksum_flag) {
+        uint32_t crc = crc32c(prefix, FEC_PREFIX_LENGTH + symbol_length);
+        write_checksum_field(packet_checksum(crc, FEC_REPAIR_PACKET_TYPE, block), datagram + header_length);
+    }
+
+    return header_length + data_length;
+}
+
+void fec_encoder::next_block() {
+
+    for (int repair = 0; repair < repair_count; repair++) {
+        memset(repairs[repair].data(), 0, symbol_length);
+    }
+
+    block++;
+    added = 0;
+}
+
+void fec_decoder::configure(const session_config &config) {
+
+    block_size = config.fec_block;
+    repair_count = (block_size > 0) ? fec_repair_count(config) : 0;
+    symbol_length = fec_symbol_length(config);
+    reset();
+}
+
+void fec_decoder::reset() {
+
+    blocks.clear();
+    next_take = 0;
+    first_needed = 0;
+}
+
+// Keeps the data field of the data packet with the given index, which lies at or ahead of the next one the server
+// expects.
+void fec_decoder::add_data(int index, const char *field, int field_length) {
+
+    if (index < first_needed || field_length > symbol_length - 2) return;
+
+    block_state &state = blocks[index / block_size];
+    int position = index % block_size;
+
+    if (state.data.count(position) != 0) return;
+
+    vector<uint8_t> &symbol = state.data[position];
+    symbol.assign(symbol_length, 0);
+    symbol[0] = (uint8_t) (field_length & 0xff);
+    symbol[1] = (uint8_t) (field_length >> 8);
+    memcpy(symbol.data() + 2, field, field_length);
+
+    decode(state);
+}
+
+// Keeps a repair packet's data (after its checksum field). Returns false if the data is malformed.
+bool fec_decoder::add_repair(int block, const char *data, int data_length) {
+
+    if (data_length != FEC_PREFIX_LENGTH + symbol_length || data[3] != ' ' || data[7] != ' ') return false;
+
+    int size = atoi(data), repair = atoi(data + 4);
+
+    if (block < 0 || size < 1 || size > block_size || repair < 0 || repair >= repair_count) return false;
+    if ((block + 1) * block_size <= first_needed) return true;
+
+    block_state &state = blocks[block];
+    if (state.size != 0 && state.size != size) return false;
+
+    state.size = size;
+
+    if (state.repairs.count(repair) == 0) {
+        state.repairs[repair].assign(data + FEC_PREFIX_LENGTH, data + FEC_PREFIX_LENGTH + symbol_length);
+        decode(state);
+    }
+
+    return true;
+}
+
+// Rebuilds the missing data packets of a block once it holds enough symbols: the known data symbols are taken out of
+// as many repair symbols as packets are missing, which leaves a square Cauchy system in the missing symbols.
+void fec_decoder::decode(block_state &state) {
+
+    vector<int> missing;
+
+    for (int position = 0; position < state.size; position++) {
+        if (state.data.count(position) == 0) missing.push_back(position);
+    }
+
+    int count = missing.size();
+    if (count == 0 || (int) state.repairs.size() < count) return;
+
+    vector<int> used_repairs;
+    vector<vector<uint8_t>> residuals;
+
+    for (map<int, vector<uint8_t>>::iterator repair = state.repairs.begin();
+         (int) used_repairs.size() < count; repair++) {
+
+        used_repairs.push_back(repair->first);
+        residuals.push_back(repair->second);
+
+        for (map<int, vector<uint8_t>>::iterator known = state.data.begin(); known != state.data.end(); known++) {
+            if (known->first >= state.size) continue;
+            gf256_multiply_add(residuals.back().data(), known->second.data(),
+                               cauchy_coefficient(block_size, repair->first, known->first), symbol_length);
+        }
+    }
+
+    // Gauss-Jordan elimination on [matrix | inverse].
+    vector<vector<uint8_t>> matrix(count, vector<uint8_t>(count)), inverse(count, vector<uint8_t>(count, 0));
+
+    for (int row = 0; row < count; row++) {
+        for (int column = 0; column < count; column++) {
+            matrix[row][column] = cauchy_coefficient(block_size, used_repairs[row], missing[column]);
+        }
+        inverse[row][row] = 1;
+    }
+
+    for (int column = 0; column < count; column++) {
+
+        int pivot = column;
+        while (matrix[pivot][column] == 0) pivot++;  // a Cauchy matrix is never singular
+        swap(matrix[pivot], matrix[column]);
+        swap(inverse[pivot], inverse[column]);
+
+        uint8_t scale = gf256_inverse(matrix[column][column]);
+        gf256_scale(matrix[column].data(), scale, count);
+        gf256_scale(inverse[column].data(), scale, count);
+
+        for (int row = 0; row < count; row++) {
+            if (row == column || matrix[row][column] == 0) continue;
+            uint8_t factor = matrix[row][column];
+            gf256_multiply_add(matrix[row].data(), matrix[column].data(), factor, count);
+            gf256_multiply_add(inverse[row].data(), inverse[column].data(), factor, count);
+        }
+    }
+
+    for (int position = 0; position < count; position++) {
+
+        vector<uint8_t> symbol(symbol_length, 0);
+
+        for (int repair = 0; repair < count; repair++) {
+            gf256_multiply_add(symbol.data(), residuals[repair].data(), inverse[position][repair], symbol_length);
+        }
+
+        int field_length = symbol[0] | (symbol[1] << 8);
+        if (field_length > symbol_length - 2) return;  // only a damaged repair packet gets here
+
+        state.data[missing[position]].swap(symbol);
+        recovered_packets++;
+    }
+}
+
+// Hands out the kept or rebuilt data field of the packet with the given index, once, if there is one.
+bool fec_decoder::take(int index, char *field, int &field_length) {
+
+    if (index < next_take) return false;
+
+    map<int, block_state>::iterator block = blocks.find(index / block_size);
+    if (block == blocks.end()) return false;
+
+    map<int, vector<uint8_t>>::iterator symbol = block->second.data.find(index % block_size);
+    if (symbol == block->second.data.end()) return false;
+
+    field_length = symbol->second[0] | (symbol->second[1] << 8);
+    memcpy(field, symbol->second.data() + 2, field_length);
+    next_take = index + 1;
+
+    return true;
+}
+
+// Forgets the blocks whose packets all come before index, which have been delivered.
+void fec_decoder::release_before(int index) {
+
+    first_needed = max(first_needed, index);
+
+    while (!blocks.empty() && (blocks.begin()->first + 1) * block_size <= index) {
+        blocks.erase(blocks.begin());
+    }
+}
@@ -0,0 +1,102 @@
+/*
+
+ * Description:
+   Forward error correction (--fec-block). The client groups the data packets of a transfer into blocks of K, by chunk
+   index, and after the last packet of a block has been sent for the first time it sends R repair packets (type 6)
+   computed with a systematic Reed-Solomon code over GF(256) (see gf256.h). Any K of the block's K + R packets are
+   enough to rebuild the others, so the server can recover lost data packets without waiting for the client's timer.
+
+   Each packet of a block is coded as one symbol: the two-byte length of its data field, then the field itself
+   (checksum field and payload, as sent), padded with zeros to a common length. Repair symbol r is the sum over the
+   block's data symbols j of C[r][j] * symbol j, where C[r][j] = 1 / ((K + r) + j) is a Cauchy matrix, every square
+   part of which is invertible. A repair packet looks like
+
+     6 <block> <length> <checksum field><size> <r> <symbol>
+
+   where size is the number of data packets in the block (the last block may be short), written with three digits
+   like r. The server keeps the data packets that arrive ahead of a lost one, rebuilds the block once it holds as many
+   symbols as the block has data packets, and then delivers the kept and rebuilt packets in order. So that the server
+   can tell which chunk an early packet carries, FEC requires checksums, and a data packet's checksum covers its chunk
+   index rather than its sequence number.
+
+ */
+
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "config.h"
+
+#define FEC_REPAIR_PACKET_TYPE 6
+#define FEC_PREFIX_LENGTH 8  // "<size> <r> " ahead of the repair symbol
+
+int fec_symbol_length(const session_config &config);
+int fec_repair_count(const session_config &config);
+
+class fec_encoder {
+
+private:
+
+    int block_size = 0;
+    int repair_count = 0;
+    int symbol_length = 0;
+    bool checksum_flag = false;
+
+    std::vector<std::vector<uint8_t>> repairs;  // the repair symbols of the current block, built as packets are added
+    int block = 0;
+    int added = 0;                              // data packets of the current block added so far
+
+public:
+
+    void configure(const session_config &config);
+    bool enabled() const { return block_size > 0; }
+
+    int next_index() const { return block * block_size + added; }
+    bool block_full() const { return added == block_size; }
+    bool block_empty() const { return added == 0; }
+    int repairs_per_block() const { return repair_count; }
+
+    void add(const char *checksum_field, int checksum_length, const char *data, int data_length);
+    int write_repair(int repair, char *datagram);
+    void next_block();
+};
+
+class fec_decoder {
+
+private:
+
+    struct block_state {
+        int size = 0;                                  // data packets in the block, known from its repair packets
+        std::map<int, std::vector<uint8_t>> data;      // position in the block -> symbol
+        std::map<int, std::vector<uint8_t>> repairs;   // repair number -> symbol
+    };
+
+    int block_size = 0;
+    int repair_count = 0;
+    int symbol_length = 0;
+
+    std::map<int, block_state> blocks;
+    int next_take = 0;     // packets before it have been handed out by take()
+    int first_needed = 0;  // packets before it have been delivered
+    long recovered_packets = 0;
+
+    void decode(block_state &state);
+
+public:
+
+    void configure(const session_config &config);
+    bool enabled() const { return block_size > 0; }
+    void reset();
+
+    void add_data(int index, const char *field, int field_length);
+    bool add_repair(int block, const char *data, int data_length);
+
+    bool take(int index, char *field, int &field_length);
+    void release_before(int index);
+
+    long recovered() const { return recovered_packets; }
+};
+
+#endif
@@ -0,0 +1,150 @@
+/*
+
+ * Description:
+   Compile-time policies for the client's and the server's protocol loops. Each loop is a template over:
+
+     - a sequence space: fixed_sequence_space<N> for a power of two known at compile time (the default of 65536),
+       masked_sequence_space for any other power of two, and modular_sequence_space for the rest. Wrapping a
+       sequence number is a constant mask, a mask, or a division;
+     - a retransmission policy (client only): window_retransmission, one timer for the window, or
+       packet_retransmission, one timer per packet. The simulator picks either at run time with
+       chosen_retransmission;
+     - a trace policy: silent_trace or verbose_trace. The verbose output of the loops, and of the per-packet helpers
+       they call, is guarded by trace::enabled, so it is compiled out of the silent instantiations.
+
+   There is no acknowledgement policy: the handshake settles every session on cumulative acknowledgements (gbn, see
+   negotiate_parameters in handshake.cpp), so such a parameter would only ever have the one value.
+
+   select_sequence_space() picks the sequence space for the session's settings, and calls the engine's run<>() with
+   it; the engine then picks its other policies the same way. The gbn_rules.h functions are written once here over
+   the sequence space, and the runtime versions use modular_sequence_space.
+
+ */
+
+#ifndef GBN_ENGINE_H
+#define GBN_ENGINE_H
+
+#include "config.h"
+#include "gbn_rules.h"
+
+template <int SIZE>
+struct fixed_sequence_space {
+
+    static_assert(SIZE > 1 && (SIZE & (SIZE - 1)) == 0, "a fixed sequence space is a power of two");
+
+    explicit fixed_sequence_space(int) {}
+
+    static bool fits(int sequence_space) { return sequence_space == SIZE; }
+
+    int size() const { return SIZE; }
+    int wrap(int value) const { return value & (SIZE - 1); }
+};
+
+struct masked_sequence_space {
+
+    int mask;
+
+    explicit masked_sequence_space(int sequence_space) : mask(sequence_space - 1) {}
+
+    static bool fits(int sequence_space) { return (sequence_space & (sequence_space - 1)) == 0; }
+
+    int size() const { return mask + 1; }
+    int wrap(int value) const { return value & mask; }
+};
+
+struct modular_sequence_space {
+
+    int space;
+
+    explicit modular_sequence_space(int sequence_space) : space(sequence_space) {}
+
+    static bool fits(int) { return true; }
+
+    int size() const { return space; }
+    int wrap(int value) const { return value % space; }  // value is never negative
+};
+
+struct window_retransmission {
+    static const bool per_packet = false;
+};
+
+struct packet_retransmission {
+    static const bool per_packet = true;
+};
+
+// A retransmission policy picked at run time, for the simulator.
+struct chosen_retransmission {
+
+    bool per_packet;
+
+    explicit chosen_retransmission(int retransmission) : per_packet(retransmission == RETRANSMIT_PACKET) {}
+};
+
+struct silent_trace {
+    static const bool enabled = false;
+};
+
+struct verbose_trace {
+    static const bool enabled = true;
+};
+
+template <typename sequence_space>
+inline int next_sequence_number(const sequence_space &space, int sequence_number) {
+    return space.wrap(sequence_number + 1);
+}
+
+template <typename sequence_space>
+inline int previous_sequence_number(const sequence_space &space, int sequence_number) {
+    return space.wrap(sequence_number + space.size() - 1);
+}
+
+// How far sequence_number is ahead of base, from 0 to the size of the space minus one.
+template <typename sequence_space>
+inline int sequence_distance(const sequence_space &space, int base, int sequence_number) {
+    return space.wrap(sequence_number - base + space.size());
+}
+
+// See classify_acknowledgement in gbn_rules.cpp.
+template <typename sequence_space>
+inline int classify_acknowledgement(const sequence_space &space, int sequence_number, int window_base,
+                                    int outstanding, int &packets_acknowledged) {
+
+    int distance = sequence_distance(space, window_base, sequence_number);
+    packets_acknowledged = 0;
+
+    if (distance < outstanding) {
+        packets_acknowledged = distance + 1;
+        return ACKNOWLEDGEMENT_ADVANCES;
+    }
+
+    return (distance == space.size() - 1) ? ACKNOWLEDGEMENT_DUPLICATE : ACKNOWLEDGEMENT_LATE;
+}
+
+template <typename sequence_space>
+inline int last_in_order(const sequence_space &space, int expected_sequence_number) {
+    return previous_sequence_number(space, expected_sequence_number);
+}
+
+template <typename engine, typename sequence_space>
+inline int run_with_trace(engine &protocol, const sequence_space &space, bool verbose) {
+
+    if (verbose) return protocol.template run<sequence_space, verbose_trace>(space);
+    return protocol.template run<sequence_space, silent_trace>(space);
+}
+
+// Runs the engine with the cheapest sequence space that holds sequence_space.
+template <typename engine>
+int select_sequence_space(engine &protocol, int sequence_space, bool verbose) {
+
+    if (fixed_sequence_space<DEFAULT_SEQUENCE_SPACE>::fits(sequence_space)) {
+        return run_with_trace(protocol, fixed_sequence_space<DEFAULT_SEQUENCE_SPACE>(sequence_space), verbose);
+    }
+
+    if (masked_sequence_space::fits(sequence_space)) {
+        return run_with_trace(protocol, masked_sequence_space(sequence_space), verbose);
+    }
+
+    return run_with_trace(protocol, modular_sequence_space(sequence_space), verbose);
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+
+ * Description:
+   The receiving side of Go-Back-N, shared by the server and the simulator. The receiver takes the packets in order
+   (server rules 1 to 3): the expected data packet is delivered and acknowledged, the EOT that follows the last one
+   ends the session, and anything else is answered with the acknowledgement of the last packet received in order.
+   Once the session has ended, every retransmitted EOT is answered again and nothing else is. The caller writes the
+   data and sends the answers; the sending side is in gbn_sender.h.
+
+ */
+
+#ifndef GBN_RECEIVER_H
+#define GBN_RECEIVER_H
+
+#include "gbn_engine.h"
+
+#define DATA_PACKET_TYPE 1
+#define CLIENT_EOT_PACKET_TYPE 3
+
+// What the receiver does with a packet (see gbn_receiver::receive).
+enum receive_verdict {
+    RECEIVE_DELIVER = 0,        // the expected data packet: write it, acknowledge it, then call delivered()
+    RECEIVE_FINISH = 1,         // the EOT: answer it, then call finished()
+    RECEIVE_REACKNOWLEDGE = 2,  // out of order: acknowledge the last packet received in order again
+    RECEIVE_IGNORE = 3          // anything else in order, and anything but an EOT after the session has ended
+};
+
+template <typename sequence_space>
+struct gbn_receiver {
+
+    sequence_space space;
+    int expected_sequence_number = 0;
+    int delivered_packets = 0;
+    bool ended = false;
+
+    explicit gbn_receiver(const sequence_space &space) : space(space) {}
+
+    void restart() {
+        expected_sequence_number = 0;
+        delivered_packets = 0;
+        ended = false;
+    }
+
+    int receive(int type, int sequence_number) const {
+
+        if (ended) return (type == CLIENT_EOT_PACKET_TYPE) ? RECEIVE_FINISH : RECEIVE_IGNORE;
+        if (sequence_number != expected_sequence_number) return RECEIVE_REACKNOWLEDGE;
+        if (type == DATA_PACKET_TYPE) return RECEIVE_DELIVER;
+        return (type == CLIENT_EOT_PACKET_TYPE) ? RECEIVE_FINISH : RECEIVE_IGNORE;
+    }
+
+    void delivered() {
+        expected_sequence_number = next_sequence_number(space, expected_sequence_number);
+        delivered_packets++;
+    }
+
+    void finished() { ended = true; }
+
+    // The sequence number acknowledged for a packet out of order (server rule 3).
+    int last_acknowledged() const { return last_in_order(space, expected_sequence_number); }
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*
+
+ * Description:
+   The Go-Back-N decisions both endpoints make. See gbn_rules.h.
+
+ */
+
+#include "gbn_rules.h"
+#include "gbn_engine.h"
+#include "handshake.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// The server acknowledges the last packet it received in order, so an acknowledgement either covers the first packets
+// of the window, repeats the one for the packet just before it, or is a late copy of an older one. The window is
+// smaller than the sequence space, which keeps the three apart. For ACKNOWLEDGEMENT_ADVANCES, packets_acknowledged is
+// the number of packets it covers.
+int classify_acknowledgement(int sequence_number, int window_base, int outstanding, int sequence_space,
+                             int &packets_acknowledged) {
+
+    return classify_acknowledgement(modular_sequence_space(sequence_space), sequence_number, window_base, outstanding,
+                                    packets_acknowledged);
+}
+
+// Whether a run of duplicates calls for resending the start of the window. After a rewind, duplicates are ignored
+// until the window moves.
+bool rewind_due(int recovery, int outstanding, int duplicates) {
+
+    return recovery == RECOVERY_OPEN && outstanding > 0 && duplicates >= DUPLICATE_ACK_THRESHOLD;
+}
+
+// The sequence number the server acknowledges while it waits for expected_sequence_number (server rule 3).
+int last_in_order(int expected_sequence_number, int sequence_space) {
+
+    return last_in_order(modular_sequence_space(sequence_space), expected_sequence_number);
+}
+
+// Packets the client may have in flight: its window, or fewer while the server advertises less room. With a full
+// buffer the server advertises 0; one packet is still sent, and its acknowledgement tells when room frees up.
+int window_limit(int window_size, int advertised_window) {
+
+    if (advertised_window == -1) return window_size;
+    return min(window_size, max(advertised_window, 1));
+}
+
+// Adds a round trip measurement to the estimate, as RFC 6298 (2.2) and (2.3) do: the first one sets SRTT = R and
+// RTTVAR = R / 2, and the next ones move SRTT by 1/8 and RTTVAR by 1/4 of the difference.
+void measure_round_trip(round_trip_estimate &estimate, double round_trip_time_ms) {
+
+    if (!estimate.measured) {
+        estimate.measured = true;
+        estimate.smoothed_ms = round_trip_time_ms;
+        estimate.variation_ms = round_trip_time_ms / 2;
+        return;
+    }
+
+    double difference = estimate.smoothed_ms - round_trip_time_ms;
+    estimate.variation_ms = 0.75 * estimate.variation_ms + 0.25 * (difference < 0 ? -difference : difference);
+    estimate.smoothed_ms = 0.875 * estimate.smoothed_ms + 0.125 * round_trip_time_ms;
+}
+
+// RTO = SRTT + 4 * RTTVAR, bounded by MIN_RETRANSMISSION_TIMEOUT_MS and the configured timeout. Without a measurement
+// it is the configured timeout.
+int retransmission_timeout(const round_trip_estimate &estimate, int timeout_ms) {
+
+    if (!estimate.measured) return timeout_ms;
+
+    int timeout = (int) (estimate.smoothed_ms + 4 * estimate.variation_ms) + 1;
+    timeout = max(timeout, MIN_RETRANSMISSION_TIMEOUT_MS);
+    return min(timeout, timeout_ms);
+}
+
+// The retransmission timeout seeded by the handshake's round trip: RTO = 3 * RTT.
+int retransmission_timeout(double round_trip_time_ms, int timeout_ms) {
+
+    round_trip_estimate estimate;
+    measure_round_trip(estimate, round_trip_time_ms);
+    return retransmission_timeout(estimate, timeout_ms);
+}
+
+// The timeout after a retransmission timer expired: twice the last one, as RFC 6298 (5.5) says, up to the configured
+// timeout. It stays backed off until a new round trip is measured.
+int backed_off_timeout(int retransmission_timeout_ms, int timeout_ms) {
+    return min(2 * retransmission_timeout_ms, timeout_ms);
+}
@@ -0,0 +1,54 @@
+/*
+
+ * Description:
+   The Go-Back-N decisions both endpoints make, kept free of sockets, files and clocks. The sender and the receiver
+   (see gbn_sender.h and gbn_receiver.h) are built on them, and the client, the server and the simulator run those, so
+   a simulated session follows the same rules as the binaries.
+
+ */
+
+#ifndef GBN_RULES_H
+#define GBN_RULES_H
+
+// Duplicate acknowledgements in a row that make the client resend the start of the window without waiting for its
+// timer. A packet overtaken by one or two others does not reach it.
+#define DUPLICATE_ACK_THRESHOLD 3
+
+// EOT packets sent, eot_timeout apart, before the client gives up on the server's EOT.
+#define MAX_EOT_ATTEMPTS 5
+
+// How the client stands with respect to lost packets. A loss is detected by the window's retransmission timer or by
+// DUPLICATE_ACK_THRESHOLD duplicate acknowledgements; either resends at once and enters RECOVERY_REWOUND, where the
+// duplicates still caused by packets sent earlier are ignored. The first acknowledgement that moves the window returns
+// the client to RECOVERY_OPEN.
+enum recovery_phase {
+    RECOVERY_OPEN = 0,
+    RECOVERY_REWOUND = 1
+};
+
+// What a cumulative acknowledgement means for the window (see classify_acknowledgement).
+enum acknowledgement_kind {
+    ACKNOWLEDGEMENT_ADVANCES = 0,
+    ACKNOWLEDGEMENT_DUPLICATE = 1,
+    ACKNOWLEDGEMENT_LATE = 2
+};
+
+// The client's estimate of the round trip, RFC 6298's SRTT and RTTVAR. The handshake gives the first measurement, and
+// the acknowledgement of a packet that was sent only once gives the next ones (Karn's rule).
+struct round_trip_estimate {
+    bool measured = false;
+    double smoothed_ms = 0;
+    double variation_ms = 0;
+};
+
+int classify_acknowledgement(int sequence_number, int window_base, int outstanding, int sequence_space,
+                             int &packets_acknowledged);
+bool rewind_due(int recovery, int outstanding, int duplicates);
+int last_in_order(int expected_sequence_number, int sequence_space);
+int window_limit(int window_size, int advertised_window);
+void measure_round_trip(round_trip_estimate &estimate, double round_trip_time_ms);
+int retransmission_timeout(const round_trip_estimate &estimate, int timeout_ms);
+int retransmission_timeout(double round_trip_time_ms, int timeout_ms);
+int backed_off_timeout(int retransmission_timeout_ms, int timeout_ms);
+
+#endif
@@ -0,0 +1,337 @@
+/*
+
+ * Description:
+   The sending side of Go-Back-N, shared by the client and the simulator: the window of outstanding packets, its
+   retransmission timers, and what an acknowledgement, a run of duplicates or an expired timer does to them. The
+   sender holds no socket, file or clock. Its caller passes the time, and a transport with one member function,
+
+     bool resend(int sequence_number, int chunk_index);    sends a packet of the window again, false if it cannot
+
+   The client's transport resends from its chunk store over its sockets (see client.cpp), the simulator's over its
+   simulated channel (see simulator.h), so a simulated session runs the same sender as the binaries. New packets are
+   sent by the caller, which then adds them to the window with sent(). The receiving side is in gbn_receiver.h.
+
+   The retransmission timeout follows RFC 6298: the handshake's round trip seeds it, one packet at a time is timed to
+   update it, and a packet that was sent again is not timed (Karn's rule). Each expiry doubles it, until the window
+   moves again or the next measurement. A burst of packets queued behind a slow receiver then costs a few timeouts,
+   not a timeout every RTO for every packet.
+
+   Per-packet timers resend only what was lost, which pays off when the server keeps the packets that arrive ahead of
+   a lost one, as it does with FEC on. Otherwise the server drops every packet after a lost one, and the sender runs
+   one timer for the window whichever mode was chosen: every packet after the lost one has to go out again behind it,
+   and timers of packets the server cannot take yet would only resend them to be dropped.
+
+ */
+
+#ifndef GBN_SENDER_H
+#define GBN_SENDER_H
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <vector>
+#include "gbn_engine.h"
+#include "gbn_rules.h"
+#include "timer_wheel.h"
+
+template <typename sequence_space, typename retransmission, typename trace>
+class gbn_sender {
+
+private:
+
+    std::vector<int> expired_timers;
+
+    int timeout_limit_ms;
+    round_trip_estimate round_trip;
+    int timed_chunk = -1;                   // the packet being timed, -1 if none
+    long long timed_at_ms = 0;
+
+    int timer_of(int chunk_index) const { return chunk_index & (timers.capacity() - 1); }
+    bool selective() const { return policy.per_packet && receiver_keeps_out_of_order; }   // per-packet timers
+
+public:
+
+    sequence_space space;
+    retransmission policy;
+
+    int window_base = 0;
+    std::deque<int> sequence_numbers;       // the outstanding packets, oldest first
+    std::deque<int> chunk_indices;
+    long long packets_sent = 0;             // packets sent for the first time
+    long long packets_acknowledged = 0;
+
+    bool receiver_keeps_out_of_order;       // the server keeps packets ahead of a lost one (FEC)
+
+    int recovery = RECOVERY_OPEN;
+    int duplicate_acknowledgements = 0;     // in a row, for the packet just before the window
+    bool resend_window = false;             // the whole window goes out again on the next resend_pending()
+    long packets_retransmitted = 0;
+    long timeouts = 0;
+    long rewinds = 0;                       // on duplicate acknowledgements
+
+    int retransmission_timeout_ms;
+
+    // One timer for the window, or one per outstanding packet with packet_retransmission and a server that keeps
+    // packets ahead of a lost one. The packets in flight are consecutive chunks, so a power of two at least as large
+    // as the window numbers them without collisions.
+    timer_wheel timers;
+
+    gbn_sender(const sequence_space &space, const retransmission &policy, int window_size, int timeout_limit_ms,
+               bool receiver_keeps_out_of_order);
+
+    int outstanding() const { return (int) sequence_numbers.size(); }
+    int next_sequence_number() const { return space.wrap(window_base + outstanding()); }
+    int first_chunk() const { return chunk_indices.front(); }
+
+    void start(long long now_ms) { timers.start(now_ms); }
+    void measured(double round_trip_time_ms);
+    void arm(int chunk_index, bool restart, long long now_ms);
+    void sent(int sequence_number, int chunk_index, long long now_ms);
+    void resent(int chunk_index);
+
+    template <typename transport>
+    int acknowledge(transport &link, int sequence_number, long long now_ms);
+
+    void release(int count, long long now_ms);
+
+    bool expire(long long now_ms);
+
+    template <typename transport>
+    void retransmit_expired(transport &link, long long now_ms);
+
+    template <typename transport>
+    void resend_pending(transport &link, long long now_ms);
+};
+
+// Until a round trip is measured, the retransmission timeout is timeout_limit_ms, which also bounds it afterwards.
+template <typename sequence_space, typename retransmission, typename trace>
+gbn_sender<sequence_space, retransmission, trace>::gbn_sender(const sequence_space &space,
+                                                             const retransmission &policy, int window_size,
+                                                             int timeout_limit_ms, bool receiver_keeps_out_of_order) :
+        timeout_limit_ms(timeout_limit_ms), space(space), policy(policy),
+        receiver_keeps_out_of_order(receiver_keeps_out_of_order), retransmission_timeout_ms(timeout_limit_ms),
+        timers(1) {
+
+    int timer_count = 1;
+    while (selective() && timer_count < window_size) timer_count <<= 1;
+    timers = timer_wheel(timer_count);
+}
+
+// Starts the retransmission timer of a packet that was just sent. With per-packet timers every packet has its own,
+// numbered by chunk index modulo the wheel's capacity. Otherwise the window has one timer, for its oldest packet,
+// which a new packet leaves running unless restart is set.
+template <typename sequence_space, typename retransmission, typename trace>
+void gbn_sender<sequence_space, retransmission, trace>::arm(int chunk_index, bool restart, long long now_ms) {
+
+    long long deadline = now_ms + retransmission_timeout_ms;
+
+    if (selective()) {
+        timers.arm(timer_of(chunk_index), deadline);
+    } else if (restart || !timers.armed(0)) {
+        timers.arm(0, deadline);
+    }
+}
+
+// Adds a round trip measurement, by the handshake or by a timed packet, and sets the retransmission timeout from the
+// estimate. A backed-off timeout ends here.
+template <typename sequence_space, typename retransmission, typename trace>
+void gbn_sender<sequence_space, retransmission, trace>::measured(double round_trip_time_ms) {
+
+    measure_round_trip(round_trip, round_trip_time_ms);
+    retransmission_timeout_ms = retransmission_timeout(round_trip, timeout_limit_ms);
+}
+
+// Adds a packet the caller has just sent for the first time to the end of the window. It is timed unless another
+// packet already is.
+template <typename sequence_space, typename retransmission, typename trace>
+void gbn_sender<sequence_space, retransmission, trace>::sent(int sequence_number, int chunk_index, long long now_ms) {
+
+    sequence_numbers.push_back(sequence_number);
+    chunk_indices.push_back(chunk_index);
+    packets_sent++;
+
+    if (timed_chunk == -1) {
+        timed_chunk = chunk_index;
+        timed_at_ms = now_ms;
+    }
+
+    arm(chunk_index, false, now_ms);
+}
+
+// Counts a packet of the window that was sent again. Its acknowledgement could be for either copy, so it is no longer
+// timed.
+template <typename sequence_space, typename retransmission, typename trace>
+void gbn_sender<sequence_space, retransmission, trace>::resent(int chunk_index) {
+
+    packets_retransmitted++;
+    if (chunk_index == timed_chunk) timed_chunk = -1;
+}
+
+// Applies a cumulative acknowledgement, and returns what it meant for the window (see classify_acknowledgement in
+// gbn_rules.h). One that moves the window releases the packets it covers. A few duplicates in a row mean the
+// window's first packet was lost rather than overtaken, and it is resent at once instead of waiting for its timer:
+// the whole window, as the server dropped the rest of it, unless per-packet timers and a server that keeps packets
+// ahead of a lost one leave only the first packet to resend. Duplicates caused by the packets sent before the rewind
+// are then ignored until the window moves.
+template <typename sequence_space, typename retransmission, typename trace>
+template <typename transport>
+int gbn_sender<sequence_space, retransmission, trace>::acknowledge(transport &link, int sequence_number,
+                                                                   long long now_ms) {
+
+    int packets_acknowledged;
+    int kind = classify_acknowledgement(space, sequence_number, window_base, outstanding(), packets_acknowledged);
+
+    if (kind == ACKNOWLEDGEMENT_ADVANCES) {
+
+        release(packets_acknowledged, now_ms);
+
+    } else if (kind == ACKNOWLEDGEMENT_DUPLICATE) {
+
+        duplicate_acknowledgements++;
+
+        if (rewind_due(recovery, outstanding(), duplicate_acknowledgements)) {
+
+            if (trace::enabled) {
+                std::cout << "[RECOVERY]: " << duplicate_acknowledgements << " duplicate acknowledgements, ";
+                std::cout << "window rewinds to packet " << window_base << std::endl << std::endl;
+            }
+
+            if (!selective()) {
+                resend_window = true;
+            } else if (link.resend(window_base, first_chunk())) {
+                arm(first_chunk(), true, now_ms);
+                resent(first_chunk());
+            }
+
+            recovery = RECOVERY_REWOUND;
+            rewinds++;
+        }
+
+    } else if (trace::enabled) {
+        std::cout << "[STATE]: Late acknowledgement for packet " << sequence_number << " ignored";
+        std::cout << std::endl << std::endl;
+    }
+
+    return kind;
+}
+
+// Slides the window past its first count packets, which have been acknowledged.
+template <typename sequence_space, typename retransmission, typename trace>
+void gbn_sender<sequence_space, retransmission, trace>::release(int count, long long now_ms) {
+
+    for (int counter = 0; counter < count; counter++) {
+
+        if (trace::enabled) {
+            std::cout << "Packet with sequence number " << sequence_numbers.front() << " acknowledged";
+            std::cout << std::endl << std::endl;
+        }
+
+        if (selective()) timers.cancel(timer_of(first_chunk()));
+
+        if (first_chunk() == timed_chunk) {
+            measured((double) (now_ms - timed_at_ms));
+            timed_chunk = -1;
+        }
+
+        window_base = ::next_sequence_number(space, window_base);
+        packets_acknowledged++;
+        sequence_numbers.pop_front();
+        chunk_indices.pop_front();
+    }
+
+    // The window moved, so a rewind has done its work, and the path delivers again: a backed-off timeout ends.
+    // Without this, a window resent in full after a loss would keep the longest timeout, as none of its packets is
+    // timed.
+    retransmission_timeout_ms = retransmission_timeout(round_trip, timeout_limit_ms);
+    duplicate_acknowledgements = 0;
+    if (recovery == RECOVERY_REWOUND) {
+        if (trace::enabled) std::cout << "[RECOVERY]: Window moved, recovery complete" << std::endl << std::endl;
+        recovery = RECOVERY_OPEN;
+    }
+
+    // The window's timer restarts for its new oldest packet, and stops once nothing is outstanding.
+    if (!selective()) {
+        if (outstanding() > 0) {
+            arm(0, true, now_ms);
+        } else {
+            timers.cancel(0);
+        }
+    }
+}
+
+// Moves the timers to now_ms. Returns true if a timer of an outstanding packet ran out, which counts as a timeout and
+// doubles the retransmission timeout. The caller then resends, with retransmit_expired() or, in a distribution, on
+// its own.
+template <typename sequence_space, typename retransmission, typename trace>
+bool gbn_sender<sequence_space, retransmission, trace>::expire(long long now_ms) {
+
+    expired_timers.clear();
+    if (!timers.advance(now_ms, expired_timers) || outstanding() == 0) return false;
+
+    timeouts++;
+    retransmission_timeout_ms = backed_off_timeout(retransmission_timeout_ms, timeout_limit_ms);
+
+    if (trace::enabled) {
+        std::cout << "[STATE]: Retransmission timer expired for " << expired_timers.size() << " packet(s), ";
+        std::cout << "timeout backed off to " << retransmission_timeout_ms << " ms" << std::endl << std::endl;
+    }
+
+    if (!selective()) recovery = RECOVERY_REWOUND;
+    return true;
+}
+
+// Resends what the timers that just expired cover. With one timer for the window, the whole window goes out on the
+// next resend_pending(). With per-packet timers, each expired packet is resent at once, in window order, and an
+// expired first packet rewinds the window.
+template <typename sequence_space, typename retransmission, typename trace>
+template <typename transport>
+void gbn_sender<sequence_space, retransmission, trace>::retransmit_expired(transport &link, long long now_ms) {
+
+    if (!selective()) {
+        resend_window = true;
+        return;
+    }
+
+    // The wheel hands the timers back in no particular order; as offsets into the window they sort into its order.
+    for (size_t position = 0; position < expired_timers.size(); position++) {
+        expired_timers[position] = (expired_timers[position] - first_chunk()) & (timers.capacity() - 1);
+    }
+    std::sort(expired_timers.begin(), expired_timers.end());
+
+    bool first_expired = !expired_timers.empty() && expired_timers.front() == 0;
+
+    for (size_t position = 0; position < expired_timers.size(); position++) {
+
+        int offset = expired_timers[position];
+        if (offset >= outstanding()) break;
+
+        if (link.resend(sequence_numbers[offset], first_chunk() + offset)) {
+            arm(first_chunk() + offset, true, now_ms);
+            resent(first_chunk() + offset);
+        }
+    }
+
+    if (first_expired) recovery = RECOVERY_REWOUND;
+}
+
+// Resends the whole window if a timeout or a run of duplicate acknowledgements asked for it. Called before any new
+// packet is sent, so that the resent packets reach the server ahead of the new ones, which it would drop otherwise.
+template <typename sequence_space, typename retransmission, typename trace>
+template <typename transport>
+void gbn_sender<sequence_space, retransmission, trace>::resend_pending(transport &link, long long now_ms) {
+
+    if (!resend_window) return;
+
+    if (trace::enabled) std::cout << "[STATE]: Window will resend" << std::endl << std::endl;
+
+    for (int offset = 0; offset < outstanding(); offset++) {
+        if (link.resend(sequence_numbers[offset], chunk_indices[offset])) {
+            arm(chunk_indices[offset], true, now_ms);
+            resent(chunk_indices[offset]);
+        }
+    }
+
+    resend_window = false;
+}
+
+#endif
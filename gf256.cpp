@@ -0,0 +1,168 @@
+/*
+
+ * Description:
+   GF(2^8) arithmetic. See gf256.h.
+
+ */
+
+#include "gf256.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define GF256_POLYNOMIAL 0x11d
+
+static uint8_t exponent_table[512];  // doubled so that a sum of two logarithms needs no reduction
+static uint8_t logarithm_table[256];
+
+// low_products[f][n] = f * n and high_products[f][n] = f * (n << 4), the nibble tables of the region operations.
+static uint8_t low_products[256][16];
+static uint8_t high_products[256][16];
+
+static bool has_ssse3 = false;
+static bool has_avx2 = false;
+
+static uint8_t multiply(uint8_t a, uint8_t b) {
+
+    if (a == 0 || b == 0) return 0;
+    return exponent_table[logarithm_table[a] + logarithm_table[b]];
+}
+
+static void initialize_tables() {
+
+    int value = 1;
+
+    for (int power = 0; power < 255; power++) {
+        exponent_table[power] = exponent_table[power + 255] = (uint8_t) value;
+        logarithm_table[value] = (uint8_t) power;
+
+        value <<= 1;
+        if (value & 0x100) value ^= GF256_POLYNOMIAL;
+    }
+
+    for (int factor = 0; factor < 256; factor++) {
+        for (int nibble = 0; nibble < 16; nibble++) {
+            low_products[factor][nibble] = multiply(factor, nibble);
+            high_products[factor][nibble] = multiply(factor, nibble << 4);
+        }
+    }
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    has_ssse3 = __builtin_cpu_supports("ssse3");
+    has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+// The tables are built on first use. A function-local static makes that safe when several threads use them at once.
+static void ensure_tables() {
+    static const bool ready = (initialize_tables(), true);
+    (void) ready;
+}
+
+uint8_t gf256_multiply(uint8_t a, uint8_t b) {
+
+    ensure_tables();
+    return multiply(a, b);
+}
+
+uint8_t gf256_inverse(uint8_t a) {
+
+    ensure_tables();
+    return exponent_table[255 - logarithm_table[a]];
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("ssse3")))
+static size_t multiply_add_ssse3(uint8_t *destination, const uint8_t *source, uint8_t factor, size_t length) {
+
+    const __m128i low_table = _mm_loadu_si128((const __m128i *) low_products[factor]);
+    const __m128i high_table = _mm_loadu_si128((const __m128i *) high_products[factor]);
+    const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    size_t done = 0;
+
+    for (; done + 16 <= length; done += 16) {
+
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (source + done));
+        __m128i low = _mm_shuffle_epi8(low_table, _mm_and_si128(bytes, nibble_mask));
+        __m128i high = _mm_shuffle_epi8(high_table, _mm_and_si128(_mm_srli_epi64(bytes, 4), nibble_mask));
+        __m128i result = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (destination + done)),
+                                       _mm_xor_si128(low, high));
+
+        _mm_storeu_si128((__m128i *) (destination + done), result);
+    }
+
+    return done;
+}
+
+__attribute__((target("avx2")))
+static size_t multiply_add_avx2(uint8_t *destination, const uint8_t *source, uint8_t factor, size_t length) {
+
+    const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) low_products[factor]));
+    const __m256i high_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) high_products[factor]));
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+    size_t done = 0;
+
+    for (; done + 32 <= length; done += 32) {
+
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (source + done));
+        __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(bytes, nibble_mask));
+        __m256i high = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi64(bytes, 4), nibble_mask));
+        __m256i result = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (destination + done)),
+                                          _mm256_xor_si256(low, high));
+
+        _mm256_storeu_si256((__m256i *) (destination + done), result);
+    }
+
+    return done;
+}
+
+#endif
+
+// destination ^= factor * source, byte by byte.
+void gf256_multiply_add(uint8_t *destination, const uint8_t *source, uint8_t factor, size_t length) {
+
+    if (factor == 0) return;
+    ensure_tables();
+
+    size_t done = 0;
+
+    if (factor == 1) {
+        for (; done < length; done++) destination[done] ^= source[done];
+        return;
+    }
+
+#if defined(__x86_64__)
+    if (has_avx2) {
+        done = multiply_add_avx2(destination, source, factor, length);
+    } else if (has_ssse3) {
+        done = multiply_add_ssse3(destination, source, factor, length);
+    }
+#endif
+
+    const uint8_t *low_table = low_products[factor], *high_table = high_products[factor];
+
+    for (; done < length; done++) {
+        destination[done] ^= low_table[source[done] & 0x0f] ^ high_table[source[done] >> 4];
+    }
+}
+
+// region *= factor, byte by byte.
+void gf256_scale(uint8_t *region, uint8_t factor, size_t length) {
+
+    ensure_tables();
+
+    const uint8_t *low_table = low_products[factor], *high_table = high_products[factor];
+
+    for (size_t position = 0; position < length; position++) {
+        region[position] = low_table[region[position] & 0x0f] ^ high_table[region[position] >> 4];
+    }
+}
+
+const char *gf256_implementation() {
+
+    ensure_tables();
+    return has_avx2 ? "avx2" : has_ssse3 ? "ssse3" : "tables";
+}
@@ -0,0 +1,25 @@
+/*
+
+ * Description:
+   Arithmetic in GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11d), for the Reed-Solomon code in fec.h.
+   Single products use log and exponent tables. The region operation that encoding and decoding spend their time in,
+   destination ^= factor * source, splits every byte into two nibbles and looks both up in 16-entry product tables,
+   16 or 32 bytes at a time with PSHUFB where the CPU has SSSE3 or AVX2.
+
+ */
+
+#ifndef GF256_H
+#define GF256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint8_t gf256_multiply(uint8_t a, uint8_t b);
+uint8_t gf256_inverse(uint8_t a);  // a must not be 0
+
+void gf256_multiply_add(uint8_t *destination, const uint8_t *source, uint8_t factor, size_t length);
+void gf256_scale(uint8_t *region, uint8_t factor, size_t length);
+
+const char *gf256_implementation();
+
+#endif
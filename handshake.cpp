@@ -0,0 +1,173 @@
+/*
+
+ * Description:
+   Encoding and negotiation of the session parameters exchanged in the SYN / SYN-ACK handshake. See handshake.h.
+
+ */
+
+#include "handshake.h"
+#include "compression.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+using namespace std;
+
+session_parameters parameters_from_config(const session_config &config) {
+
+    session_parameters parameters;
+
+    parameters.window_size = config.window_size;
+    parameters.payload_size = config.payload_size;
+    parameters.sequence_space = config.sequence_space;
+    parameters.ack_mode = config.ack_mode;
+    parameters.checksum = config.checksum;
+    parameters.compression = config.compression;
+    parameters.zero_copy = config.zero_copy ? 1 : 0;
+    parameters.fec_block = config.fec_block;
+    parameters.fec_redundancy = config.fec_redundancy;
+
+    return parameters;
+}
+
+void apply_parameters(const session_parameters &parameters, session_config &config) {
+
+    config.window_size = parameters.window_size;
+    config.payload_size = parameters.payload_size;
+    config.sequence_space = parameters.sequence_space;
+    config.ack_mode = parameters.ack_mode;
+    config.checksum = parameters.checksum;
+    config.compression = parameters.compression;
+    config.zero_copy = (parameters.zero_copy == 1);
+    config.fec_block = parameters.fec_block;
+    config.fec_redundancy = parameters.fec_redundancy;
+}
+
+// Writes the parameters as space separated `key=value` words and returns the number of characters written.
+int encode_parameters(const session_parameters &parameters, char *text, size_t text_length) {
+
+    int length = snprintf(text, text_length,
+                          "window=%d payload=%d sequence-space=%d ack-mode=%s checksum=%s compression=%s nonce=%d "
+                          "session=%d file-size=%lld file-mtime=%lld resume=%lld batch=%d zero-copy=%d "
+                          "fec-block=%d fec-redundancy=%d receivers=%d receiver=%d",
+                          parameters.window_size, parameters.payload_size, parameters.sequence_space,
+                          ack_mode_name(parameters.ack_mode), checksum_name(parameters.checksum),
+                          compression_name(parameters.compression), parameters.nonce, parameters.session,
+                          parameters.file_size, parameters.file_mtime, parameters.resume_offset, parameters.batch,
+                          parameters.zero_copy, parameters.fec_block, parameters.fec_redundancy, parameters.receivers,
+                          parameters.receiver);
+
+    return (length < (int) text_length) ? length : (int) text_length - 1;
+}
+
+// Parses the words written by encode_parameters(). Unknown keys are skipped so that newer peers can add parameters;
+// unknown values of known keys make the whole packet invalid.
+bool decode_parameters(const char *text, int text_length, session_parameters &parameters) {
+
+    string words(text, text_length);
+    size_t position = 0;
+
+    while (position < words.size()) {
+
+        size_t end = words.find(' ', position);
+        if (end == string::npos) end = words.size();
+
+        string word = words.substr(position, end - position);
+        position = end + 1;
+
+        size_t separator = word.find('=');
+        if (separator == string::npos) continue;
+
+        string key = word.substr(0, separator);
+        const char *value = word.c_str() + separator + 1;
+
+        if (key == "window") {
+            parameters.window_size = atoi(value);
+        } else if (key == "payload") {
+            parameters.payload_size = atoi(value);
+        } else if (key == "sequence-space") {
+            parameters.sequence_space = atoi(value);
+        } else if (key == "ack-mode") {
+            parameters.ack_mode = ack_mode_from_name(value);
+        } else if (key == "checksum") {
+            parameters.checksum = checksum_from_name(value);
+        } else if (key == "compression") {
+            parameters.compression = compression_from_name(value);
+        } else if (key == "nonce") {
+            parameters.nonce = atoi(value);
+        } else if (key == "session") {
+            parameters.session = atoi(value);
+        } else if (key == "file-size") {
+            parameters.file_size = atoll(value);
+        } else if (key == "file-mtime") {
+            parameters.file_mtime = atoll(value);
+        } else if (key == "resume") {
+            parameters.resume_offset = atoll(value);
+        } else if (key == "batch") {
+            parameters.batch = atoi(value);
+        } else if (key == "zero-copy") {
+            parameters.zero_copy = atoi(value);
+        } else if (key == "fec-block") {
+            parameters.fec_block = atoi(value);
+        } else if (key == "fec-redundancy") {
+            parameters.fec_redundancy = atoi(value);
+        } else if (key == "receivers") {
+            parameters.receivers = atoi(value);
+        } else if (key == "receiver") {
+            parameters.receiver = atoi(value);
+        }
+    }
+
+    return parameters.window_size > 0 && parameters.payload_size > 0 && parameters.payload_size <= MAX_PAYLOAD_SIZE &&
+           parameters.sequence_space > parameters.window_size && parameters.ack_mode != -1 &&
+           parameters.checksum != -1 && parameters.compression != -1 && parameters.resume_offset >= 0 &&
+           parameters.fec_block >= 0 && parameters.fec_block <= FEC_MAX_BLOCK &&
+           parameters.fec_redundancy >= 1 && parameters.fec_redundancy <= 100 && parameters.receivers >= 0;
+}
+
+// Picks the parameters for the session from the client's offer and the server's own configuration, which acts as the
+// upper limit. Features the server does not implement fall back to the assignment's behaviour.
+session_parameters negotiate_parameters(const session_parameters &offer, const session_parameters &limits) {
+
+    session_parameters accepted = offer;
+
+    accepted.payload_size = min(offer.payload_size, limits.payload_size);
+    accepted.sequence_space = min(offer.sequence_space, limits.sequence_space);
+    accepted.window_size = min(offer.window_size, limits.window_size);
+
+    // Go-Back-N needs at least one sequence number outside the window.
+    if (accepted.window_size >= accepted.sequence_space) {
+        accepted.window_size = accepted.sequence_space - 1;
+    }
+
+    accepted.ack_mode = ACK_MODE_GBN;
+
+    // A distribution is sent without FEC; its receivers report their gaps instead (see distribution.h).
+    if (accepted.receivers > 0) {
+        accepted.fec_block = 0;
+    }
+
+    // With FEC the server keeps packets that arrive ahead of a lost one, which it can only place if every sequence
+    // number in flight is unambiguous: packets ahead of the expected one and packets behind it must not share numbers.
+    // A distribution's receivers tell the packets resent for slower receivers from those ahead in the same way.
+    if ((accepted.fec_block > 0 || accepted.receivers > 0) && accepted.window_size > accepted.sequence_space / 2) {
+        accepted.window_size = accepted.sequence_space / 2;
+    }
+
+    // FEC only uses packets whose checksums match (see fec.h).
+    if (accepted.fec_block > 0) {
+        accepted.checksum = CHECKSUM_CRC32C;
+    }
+
+    // The zero-copy path changes the header format, so both ends have to want it.
+    accepted.zero_copy = (offer.zero_copy == 1 && limits.zero_copy == 1) ? 1 : 0;
+
+    // Every build has LZ4, so a codec the server lacks falls back to it rather than to no compression at all.
+    if (!compression_supported(offer.compression)) {
+        accepted.compression = COMPRESSION_LZ4;
+    }
+
+    return accepted;
+}
@@ -0,0 +1,56 @@
+/*
+
+ * Description:
+   Connection handshake. Before sending data the client sends a SYN packet (type 4) carrying the session parameters it
+   would like to use; the server answers with a SYN-ACK packet (type 5) carrying the parameters it accepted. Both packets
+   use the ordinary packet class, with the parameters written as `key=value` words in the data field. The client also
+   times the exchange to seed its retransmission timer. The SYN-ACK also tells the client where to resume an interrupted
+   transfer of the same file (see checkpoint.h), and, in a distribution to several servers, which receiver answered.
+
+ */
+
+#ifndef HANDSHAKE_H
+#define HANDSHAKE_H
+
+#include <stddef.h>
+#include "config.h"
+
+#define SYN_PACKET_TYPE 4
+#define SYN_ACK_PACKET_TYPE 5
+
+#define HANDSHAKE_TEXT_LENGTH 512
+#define HANDSHAKE_BUFFER_LENGTH (HANDSHAKE_TEXT_LENGTH + MAX_HEADER_LENGTH)
+#define HANDSHAKE_ATTEMPTS 10
+#define MIN_RETRANSMISSION_TIMEOUT_MS 20
+
+struct session_parameters {
+
+    int window_size = DEFAULT_WINDOW_SIZE;
+    int payload_size = DEFAULT_PAYLOAD_SIZE;
+    int sequence_space = DEFAULT_SEQUENCE_SPACE;
+    int ack_mode = ACK_MODE_GBN;
+    int checksum = CHECKSUM_NONE;
+    int compression = COMPRESSION_NONE;
+    int nonce = 0;  // echoed back in the SYN-ACK so every SYN attempt can be timed on its own
+    int session = 0;  // picked by the client per run; a SYN with a new session starts the transfer over
+
+    long long file_size = -1;  // identity of the file being sent, compared against the server's checkpoint
+    long long file_mtime = -1;
+    long long resume_offset = 0;  // set by the server: the byte of the file to start sending from
+    int batch = 0;                // 1 if the client sends a directory as a batch (see batch.h)
+    int zero_copy = 0;            // 1 if data packets use the fixed-width header of the zero-copy path
+    int fec_block = 0;            // data packets per FEC block, 0 without FEC (see fec.h)
+    int fec_redundancy = DEFAULT_FEC_REDUNDANCY;
+    int receivers = 0;            // servers the client sends to at once, 0 for an ordinary session (see distribution.h)
+    int receiver = -1;            // set by a server in a distribution: the id it tags its answers with
+};
+
+session_parameters parameters_from_config(const session_config &config);
+void apply_parameters(const session_parameters &parameters, session_config &config);
+
+int encode_parameters(const session_parameters &parameters, char *text, size_t text_length);
+bool decode_parameters(const char *text, int text_length, session_parameters &parameters);
+
+session_parameters negotiate_parameters(const session_parameters &offer, const session_parameters &limits);
+
+#endif
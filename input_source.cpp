@@ -0,0 +1,124 @@
+/*
+
+ * Description:
+   The byte stream the client sends. See input_source.h.
+
+ */
+
+#include "input_source.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+using namespace std;
+
+// Whether file_name has to be read as a stream: stdin, or anything that is neither a regular file nor a directory.
+bool is_stream(const string &file_name) {
+
+    struct stat file_status;
+
+    if (file_name == "-") return true;
+    if (stat(file_name.c_str(), &file_status) == -1) return false;
+
+    return !S_ISREG(file_status.st_mode) && !S_ISDIR(file_status.st_mode);
+}
+
+bool file_source::open(const string &file_name) {
+
+    source_file.open(file_name, ios::binary);
+    if (!source_file) return false;
+
+    // Count the total number of characters in the input file.
+    source_file.seekg(0, source_file.end);
+    file_size = source_file.tellg();
+    source_file.seekg(0, source_file.beg);
+
+    return true;
+}
+
+int file_source::read_at(long long offset, char *buffer, int length) {
+
+    // If the failbit or badbit flags are set, remove the flag(s) and allow further operations
+    if (source_file.fail()) {
+        source_file.clear();
+    }
+
+    source_file.seekg(offset);
+    source_file.read(buffer, length);
+
+    return source_file.gcount();
+}
+
+stream_source::~stream_source() {
+
+    if (stream_fd > STDERR_FILENO) close(stream_fd);
+}
+
+bool stream_source::open(const string &file_name) {
+
+    stream_fd = (file_name == "-") ? STDIN_FILENO : ::open(file_name.c_str(), O_RDONLY);
+    return stream_fd != -1;
+}
+
+void stream_source::release_before(long long offset) {
+
+    long long current = released.load();
+    while (offset > current && !released.compare_exchange_weak(current, offset)) {}
+}
+
+// Drops the released bytes. The buffer is only moved down once they take up half of it, so trimming costs O(1) per
+// byte.
+void stream_source::trim() {
+
+    long long release_offset = released.load();
+    if (release_offset <= kept_offset) return;
+
+    size_t dropped = (size_t) min(release_offset - kept_offset, (long long) (kept.size() - kept_start));
+    kept_start += dropped;
+    kept_offset += dropped;
+
+    if (kept_start > kept.size() / 2) {
+        kept.erase(kept.begin(), kept.begin() + kept_start);
+        kept_start = 0;
+    }
+}
+
+int stream_source::read_at(long long offset, char *buffer, int length) {
+
+    trim();
+
+    // Released bytes are gone; the chunk store never asks for them again.
+    if (offset < kept_offset) {
+        fprintf(stderr, "(client) byte %lld of the stream was asked for after it was released\n", offset);
+        exit(EXIT_FAILURE);
+    }
+
+    // Read until the stream holds the bytes asked for, or ends.
+    while (!end_reached && kept_offset + (long long) (kept.size() - kept_start) < offset + length) {
+
+        size_t filled = kept.size();
+        kept.resize(filled + STREAM_READ_LENGTH);
+
+        ssize_t result = read(stream_fd, kept.data() + filled, STREAM_READ_LENGTH);
+        kept.resize(filled + max(result, (ssize_t) 0));
+
+        if (result == -1 && errno != EINTR) {
+            perror("(client) error when reading the input stream");
+            exit(EXIT_FAILURE);
+        }
+
+        if (result == 0) end_reached = true;
+    }
+
+    long long available = kept_offset + (long long) (kept.size() - kept_start) - offset;
+    int copied = (int) max(0LL, min((long long) length, available));
+
+    if (copied > 0) memcpy(buffer, kept.data() + kept_start + (offset - kept_offset), copied);
+    return copied;
+}
@@ -0,0 +1,85 @@
+/*
+
+ * Description:
+   The byte stream the client sends. A transfer is a stream of bytes cut into chunks; for a single file the stream is
+   the file itself, and for a batch (see batch.h) it is a manifest followed by every file of a directory. A pipe, a
+   socket, stdin (`-`) or, with --stream, any file is read as a stream: front to back, without knowing its length up
+   front, keeping only the bytes that may still have to be sent.
+
+ */
+
+#ifndef INPUT_SOURCE_H
+#define INPUT_SOURCE_H
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Bytes a stream_source asks read() for at a time.
+#define STREAM_READ_LENGTH 65536
+
+bool is_stream(const std::string &file_name);
+
+class input_source {
+
+public:
+
+    virtual ~input_source() {}
+
+    // The length of the stream, or -1 while it is not known.
+    virtual long long size() = 0;
+
+    // Copies up to length bytes starting at offset into buffer. Returns the number of bytes copied, which is less than
+    // length only at the end of the stream.
+    virtual int read_at(long long offset, char *buffer, int length) = 0;
+
+    // Tells the source that the bytes before offset will not be asked for again.
+    virtual void release_before(long long offset) {}
+};
+
+class file_source : public input_source {
+
+private:
+
+    std::ifstream source_file;
+    long long file_size = 0;
+
+public:
+
+    bool open(const std::string &file_name);
+
+    long long size() { return file_size; }
+    int read_at(long long offset, char *buffer, int length);
+};
+
+// Reads a stream of unknown length. The bytes from the oldest one that may still be asked for to the newest one read
+// are kept in a buffer, which therefore stays about as large as the data the client has in flight or prepared.
+// read_at() blocks until the stream has enough bytes or ends. release_before() may be called from another thread than
+// read_at(); the buffer itself is only trimmed by read_at().
+class stream_source : public input_source {
+
+private:
+
+    int stream_fd = -1;
+    bool end_reached = false;
+
+    std::vector<char> kept;              // kept[kept_start] is byte kept_offset of the stream
+    size_t kept_start = 0;
+    long long kept_offset = 0;
+    std::atomic<long long> released{0};
+
+    void trim();
+
+public:
+
+    ~stream_source();
+
+    bool open(const std::string &file_name);
+
+    long long size() { return end_reached ? kept_offset + (long long) (kept.size() - kept_start) : -1; }
+    int read_at(long long offset, char *buffer, int length);
+    void release_before(long long offset);
+};
+
+#endif
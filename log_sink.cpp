@@ -0,0 +1,209 @@
+/*
+
+ * Description:
+   Buffered writer for the sequence number logs. See log_sink.h.
+
+ */
+
+#include "log_sink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+using namespace std;
+
+// Appends the decimal representation of value followed by a newline, i.e. exactly what `<< value << endl` produced.
+static void append_record(vector<char> &block, int value) {
+
+    char digits[12];
+    int length = 0;
+    unsigned int magnitude = (value < 0) ? 0u - (unsigned int) value : (unsigned int) value;
+
+    do {
+        digits[length++] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        block.push_back('-');
+    }
+
+    while (length > 0) {
+        block.push_back(digits[--length]);
+    }
+    block.push_back('\n');
+}
+
+log_sink::log_sink() {
+    file_fd = -1;
+    mode = LOG_SINK_BUFFERED;
+    block_size = LOG_SINK_DEFAULT_BLOCK_SIZE;
+    stop_flag = false;
+}
+
+log_sink::~log_sink() {
+    close();
+}
+
+bool log_sink::open(const char *path, int sink_mode, size_t sink_block_size) {
+
+    close();
+
+    if ((file_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        perror("error when opening log file");
+        return false;
+    }
+
+    mode = sink_mode;
+    block_size = (sink_block_size > 0) ? sink_block_size : LOG_SINK_DEFAULT_BLOCK_SIZE;
+    stop_flag = false;
+
+    text_block.clear();
+    text_block.reserve(block_size + 16);
+    pending_records.clear();
+    pending_records.reserve(block_size / sizeof(int));
+
+    if (mode == LOG_SINK_BACKGROUND) {
+        flush_thread = thread(&log_sink::background_flusher, this);
+    }
+
+    return true;
+}
+
+void log_sink::record(int value) {
+
+    if (file_fd == -1) {
+        return;
+    }
+
+    if (mode == LOG_SINK_BUFFERED) {
+
+        append_record(text_block, value);
+
+        if (text_block.size() >= block_size) {
+            write_block(text_block.data(), text_block.size());
+            text_block.clear();
+        }
+
+    } else if (mode == LOG_SINK_BINARY) {
+
+        pending_records.push_back(value);
+
+        // Every record formats to at most 12 characters, so this bounds the size of the block written.
+        if (pending_records.size() * 12 >= block_size) {
+            write_records(pending_records, text_block);
+            pending_records.clear();
+        }
+
+    } else {
+
+        bool wake_flusher;
+        {
+            lock_guard<mutex> lock(records_mutex);
+            pending_records.push_back(value);
+            wake_flusher = pending_records.size() * 12 >= block_size;
+        }
+
+        if (wake_flusher) {
+            records_ready.notify_one();
+        }
+    }
+}
+
+void log_sink::flush() {
+
+    if (file_fd == -1) {
+        return;
+    }
+
+    if (mode == LOG_SINK_BUFFERED) {
+        write_block(text_block.data(), text_block.size());
+        text_block.clear();
+    } else if (mode == LOG_SINK_BINARY) {
+        write_records(pending_records, text_block);
+        pending_records.clear();
+    } else {
+        vector<int> records;
+        {
+            lock_guard<mutex> lock(records_mutex);
+            records.swap(pending_records);
+        }
+        write_records(records, text_block);
+    }
+}
+
+void log_sink::close() {
+
+    if (file_fd == -1) {
+        return;
+    }
+
+    if (mode == LOG_SINK_BACKGROUND && flush_thread.joinable()) {
+        {
+            lock_guard<mutex> lock(records_mutex);
+            stop_flag = true;
+        }
+        records_ready.notify_one();
+        flush_thread.join();
+    }
+
+    flush();
+    ::close(file_fd);
+    file_fd = -1;
+}
+
+void log_sink::write_block(const char *data, size_t length) {
+
+    while (length > 0) {
+
+        ssize_t written = ::write(file_fd, data, length);
+
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            perror("error when writing log file");
+            return;
+        }
+
+        data += written;
+        length -= written;
+    }
+}
+
+void log_sink::write_records(const vector<int> &records, vector<char> &scratch) {
+
+    scratch.clear();
+
+    for (size_t index = 0; index < records.size(); index++) {
+        append_record(scratch, records[index]);
+    }
+
+    write_block(scratch.data(), scratch.size());
+    scratch.clear();
+}
+
+// Runs on flush_thread in LOG_SINK_BACKGROUND mode. The record vector is swapped out under the lock so the protocol
+// thread only ever pays for a push_back; formatting and the write syscall happen here.
+void log_sink::background_flusher() {
+
+    vector<int> records;
+    vector<char> scratch;
+    scratch.reserve(block_size + 16);
+
+    unique_lock<mutex> lock(records_mutex);
+
+    while (!stop_flag) {
+
+        records_ready.wait(lock, [this] { return stop_flag || pending_records.size() * 12 >= block_size; });
+
+        records.swap(pending_records);
+        lock.unlock();
+
+        write_records(records, scratch);
+        records.clear();
+
+        lock.lock();
+    }
+}
@@ -0,0 +1,58 @@
+/*
+
+ * Description:
+   Buffered writer for the sequence number logs (clientseqnum.log, clientack.log and arrival.log). Records are kept
+   in memory and written out in large blocks instead of flushing the stream after every packet. The file contents are
+   identical to the old `<< endl` output: one decimal number per line.
+
+ */
+
+#ifndef LOG_SINK_H
+#define LOG_SINK_H
+
+#include <stddef.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define LOG_SINK_DEFAULT_BLOCK_SIZE 65536
+
+enum log_sink_mode {
+    LOG_SINK_BUFFERED = 0,   // records are formatted immediately and written when the block fills up
+    LOG_SINK_BINARY = 1,     // records are kept as raw integers and only formatted when the block is written
+    LOG_SINK_BACKGROUND = 2  // like binary, but formatting and writing happen on a background thread
+};
+
+class log_sink {
+
+private:
+
+    int file_fd;
+    int mode;
+    size_t block_size;
+
+    std::vector<char> text_block;      // formatted records waiting to be written (LOG_SINK_BUFFERED)
+    std::vector<int> pending_records;  // raw records waiting to be formatted (LOG_SINK_BINARY, LOG_SINK_BACKGROUND)
+
+    std::thread flush_thread;
+    std::mutex records_mutex;
+    std::condition_variable records_ready;
+    bool stop_flag;
+
+    void write_block(const char *data, size_t length);
+    void write_records(const std::vector<int> &records, std::vector<char> &scratch);
+    void background_flusher();
+
+public:
+
+    log_sink();
+    ~log_sink();
+
+    bool open(const char *path, int sink_mode = LOG_SINK_BUFFERED, size_t sink_block_size = LOG_SINK_DEFAULT_BLOCK_SIZE);
+    void record(int value);
+    void flush();
+    void close();
+};
+
+#endif
@@ -0,0 +1,348 @@
+/*
+
+ * Description:
+   pcapng writing and reading for the datagram capture. See packet_capture.h.
+
+ */
+
+#include "packet_capture.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+
+#define PCAPNG_SECTION_HEADER 0x0A0D0D0A
+#define PCAPNG_INTERFACE_DESCRIPTION 1
+#define PCAPNG_ENHANCED_PACKET 6
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+#define PCAPNG_OPTION_END 0
+#define PCAPNG_OPTION_COMMENT 1
+#define PCAPNG_OPTION_EPB_FLAGS 2
+#define PCAPNG_OPTION_SHB_USERAPPL 4
+#define PCAPNG_OPTION_IF_TSRESOL 9
+
+#define LINKTYPE_RAW 101                 // the packet starts with its IPv4 or IPv6 header
+#define CAPTURE_BUFFER_SIZE (1 << 20)
+
+static void append(vector<char> &block, const void *bytes, size_t length) {
+
+    block.insert(block.end(), (const char *) bytes, (const char *) bytes + length);
+}
+
+static void append_u16(vector<char> &block, uint16_t value) { append(block, &value, sizeof(value)); }
+static void append_u32(vector<char> &block, uint32_t value) { append(block, &value, sizeof(value)); }
+
+static void pad(vector<char> &block) {
+
+    while (block.size() % 4 != 0) block.push_back(0);
+}
+
+static void append_option(vector<char> &block, uint16_t code, const void *value, size_t length) {
+
+    append_u16(block, code);
+    append_u16(block, (uint16_t) length);
+    append(block, value, length);
+    pad(block);
+}
+
+// Closes a block that was started with its type and a placeholder for its length.
+static void finish_block(vector<char> &block) {
+
+    uint32_t total_length = block.size() + sizeof(uint32_t);
+    memcpy(block.data() + sizeof(uint32_t), &total_length, sizeof(total_length));
+    append_u32(block, total_length);
+}
+
+static void start_block(vector<char> &block, uint32_t type) {
+
+    block.clear();
+    append_u32(block, type);
+    append_u32(block, 0);
+}
+
+// The address and port of an endpoint as they go in an IP header. A v4-mapped IPv6 address is an IPv4 one.
+static bool version4_address(const struct sockaddr_storage &address, unsigned char bytes[16], uint16_t &port) {
+
+    if (address.ss_family == AF_INET) {
+        const struct sockaddr_in &ipv4 = (const struct sockaddr_in &) address;
+        memcpy(bytes, &ipv4.sin_addr, 4);
+        port = ipv4.sin_port;
+        return true;
+    }
+
+    const struct sockaddr_in6 &ipv6 = (const struct sockaddr_in6 &) address;
+    port = ipv6.sin6_port;
+
+    if (IN6_IS_ADDR_V4MAPPED(&ipv6.sin6_addr)) {
+        memcpy(bytes, ipv6.sin6_addr.s6_addr + 12, 4);
+        return true;
+    }
+
+    memcpy(bytes, ipv6.sin6_addr.s6_addr, 16);
+    return false;
+}
+
+// Adds up big-endian 16-bit words for the Internet checksum.
+static uint32_t add_words(const unsigned char *bytes, size_t length, uint32_t sum) {
+
+    for (size_t position = 0; position + 1 < length; position += 2) sum += (bytes[position] << 8) | bytes[position + 1];
+    if (length % 2 != 0) sum += bytes[length - 1] << 8;
+
+    return sum;
+}
+
+static uint16_t fold_checksum(uint32_t sum) {
+
+    while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t) ~sum;
+}
+
+bool packet_capture::open(const char *path, const char *application, int socket_fd) {
+
+    socklen_t local_length = sizeof(local);
+    memset(&local, 0, sizeof(local));
+
+    if (getsockname(socket_fd, (struct sockaddr *) &local, &local_length) == -1) {
+        perror("(capture) error when calling getsockname");
+        return false;
+    }
+
+    if ((file = fopen(path, "wb")) == NULL) {
+        perror("(capture) error when opening the capture file");
+        return false;
+    }
+
+    setvbuf(file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+
+    start_block(frame, PCAPNG_SECTION_HEADER);
+    append_u32(frame, PCAPNG_BYTE_ORDER_MAGIC);
+    append_u16(frame, 1);
+    append_u16(frame, 0);
+    int64_t section_length = -1;
+    append(frame, &section_length, sizeof(section_length));
+    append_option(frame, PCAPNG_OPTION_SHB_USERAPPL, application, strlen(application));
+    append_option(frame, PCAPNG_OPTION_END, NULL, 0);
+    finish_block(frame);
+    fwrite(frame.data(), 1, frame.size(), file);
+
+    unsigned char nanoseconds = 9;
+    start_block(frame, PCAPNG_INTERFACE_DESCRIPTION);
+    append_u16(frame, LINKTYPE_RAW);
+    append_u16(frame, 0);
+    append_u32(frame, 0);
+    append_option(frame, PCAPNG_OPTION_IF_TSRESOL, &nanoseconds, 1);
+    append_option(frame, PCAPNG_OPTION_END, NULL, 0);
+    finish_block(frame);
+    fwrite(frame.data(), 1, frame.size(), file);
+
+    return !ferror(file);
+}
+
+void packet_capture::close() {
+
+    if (file == NULL) return;
+
+    if (fclose(file) != 0) perror("(capture) error when writing the capture file");
+    file = NULL;
+}
+
+void packet_capture::write_block(int direction, const struct sockaddr_storage &peer, const struct iovec *pieces,
+                                 int count, const char *note) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t timestamp = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+    unsigned char local_address[16], peer_address[16];
+    uint16_t local_port, peer_port;
+    bool version4 = version4_address(peer, peer_address, peer_port);
+
+    // A local IPv6 socket talking to an IPv4 peer shows as the IPv4 wildcard.
+    if (version4_address(local, local_address, local_port) != version4) memset(local_address, 0, 16);
+
+    size_t payload_length = 0;
+    for (int piece = 0; piece < count; piece++) payload_length += pieces[piece].iov_len;
+
+    int address_length = version4 ? 4 : 16, ip_header_length = version4 ? 20 : 40;
+    size_t packet_length = ip_header_length + 8 + payload_length;
+    const unsigned char *source = (direction == CAPTURE_OUTBOUND) ? local_address : peer_address;
+    const unsigned char *destination = (direction == CAPTURE_OUTBOUND) ? peer_address : local_address;
+    uint16_t source_port = (direction == CAPTURE_OUTBOUND) ? local_port : peer_port;
+    uint16_t destination_port = (direction == CAPTURE_OUTBOUND) ? peer_port : local_port;
+
+    start_block(frame, PCAPNG_ENHANCED_PACKET);
+    append_u32(frame, 0);
+    append_u32(frame, (uint32_t) (timestamp >> 32));
+    append_u32(frame, (uint32_t) timestamp);
+    append_u32(frame, packet_length);
+    append_u32(frame, packet_length);
+
+    size_t packet_start = frame.size();
+    frame.resize(packet_start + ip_header_length + 8);
+    for (int piece = 0; piece < count; piece++) append(frame, pieces[piece].iov_base, pieces[piece].iov_len);
+
+    unsigned char *ip = (unsigned char *) frame.data() + packet_start, *udp = ip + ip_header_length;
+    memset(ip, 0, ip_header_length + 8);
+
+    if (version4) {
+        ip[0] = 0x45;
+        ip[2] = packet_length >> 8;
+        ip[3] = packet_length & 0xff;
+        ip[6] = 0x40;  // don't fragment
+        ip[8] = 64;
+        ip[9] = IPPROTO_UDP;
+        memcpy(ip + 12, source, 4);
+        memcpy(ip + 16, destination, 4);
+        uint16_t header_checksum = fold_checksum(add_words(ip, 20, 0));
+        ip[10] = header_checksum >> 8;
+        ip[11] = header_checksum & 0xff;
+    } else {
+        ip[0] = 0x60;
+        ip[4] = (packet_length - 40) >> 8;
+        ip[5] = (packet_length - 40) & 0xff;
+        ip[6] = IPPROTO_UDP;
+        ip[7] = 64;
+        memcpy(ip + 8, source, 16);
+        memcpy(ip + 24, destination, 16);
+    }
+
+    size_t udp_length = 8 + payload_length;
+    memcpy(udp, &source_port, 2);
+    memcpy(udp + 2, &destination_port, 2);
+    udp[4] = udp_length >> 8;
+    udp[5] = udp_length & 0xff;
+
+    // The pseudo-header: both addresses, the protocol and the UDP length.
+    uint32_t sum = add_words(source, address_length, 0);
+    sum = add_words(destination, address_length, sum);
+    sum += IPPROTO_UDP + (uint32_t) udp_length;
+    uint16_t udp_checksum = fold_checksum(add_words(udp, udp_length, sum));
+    if (udp_checksum == 0) udp_checksum = 0xffff;
+    udp[6] = udp_checksum >> 8;
+    udp[7] = udp_checksum & 0xff;
+
+    pad(frame);
+
+    uint32_t flags = direction;
+    append_option(frame, PCAPNG_OPTION_EPB_FLAGS, &flags, sizeof(flags));
+    if (note != NULL && note[0] != '\0') append_option(frame, PCAPNG_OPTION_COMMENT, note, strlen(note));
+    append_option(frame, PCAPNG_OPTION_END, NULL, 0);
+    finish_block(frame);
+
+    fwrite(frame.data(), 1, frame.size(), file);
+}
+
+static uint32_t read_u32(const string &bytes, size_t offset) {
+
+    uint32_t value;
+    memcpy(&value, bytes.data() + offset, sizeof(value));
+    return value;
+}
+
+static uint16_t read_u16(const string &bytes, size_t offset) {
+
+    uint16_t value;
+    memcpy(&value, bytes.data() + offset, sizeof(value));
+    return value;
+}
+
+bool read_capture(const char *path, vector<captured_datagram> &datagrams) {
+
+    ifstream capture_file(path, ios::binary);
+
+    if (!capture_file) {
+        fprintf(stderr, "error when opening capture %s\n", path);
+        return false;
+    }
+
+    string bytes((istreambuf_iterator<char>(capture_file)), istreambuf_iterator<char>());
+    long long nanoseconds_per_unit = 1000;  // microseconds, unless the interface says otherwise
+    size_t offset = 0;
+
+    if (bytes.size() < 28 || read_u32(bytes, 0) != PCAPNG_SECTION_HEADER ||
+        read_u32(bytes, 8) != PCAPNG_BYTE_ORDER_MAGIC) {
+        fprintf(stderr, "%s is not a pcapng capture written on a machine of this byte order\n", path);
+        return false;
+    }
+
+    while (offset + 12 <= bytes.size()) {
+
+        uint32_t type = read_u32(bytes, offset), length = read_u32(bytes, offset + 4);
+
+        if (length < 12 || length % 4 != 0 || offset + length > bytes.size()) {
+            fprintf(stderr, "%s: damaged block at byte %zu\n", path, offset);
+            return false;
+        }
+
+        size_t options = offset + length - 4;  // the options end here; where they start depends on the block
+
+        if (type == PCAPNG_INTERFACE_DESCRIPTION) {
+
+            if (read_u16(bytes, offset + 8) != LINKTYPE_RAW) {
+                fprintf(stderr, "%s: only captures of raw IP packets can be read\n", path);
+                return false;
+            }
+
+            for (size_t option = offset + 16; option + 4 <= options;) {
+
+                uint16_t code = read_u16(bytes, option), option_length = read_u16(bytes, option + 2);
+                if (code == PCAPNG_OPTION_END) break;
+
+                if (code == PCAPNG_OPTION_IF_TSRESOL && option_length == 1) {
+                    nanoseconds_per_unit = 1;
+                    for (int digits = (unsigned char) bytes[option + 4]; digits < 9; digits++) {
+                        nanoseconds_per_unit *= 10;
+                    }
+                }
+
+                option += 4 + ((option_length + 3) & ~3);
+            }
+
+        } else if (type == PCAPNG_ENHANCED_PACKET && length >= 32) {
+
+            uint64_t timestamp = ((uint64_t) read_u32(bytes, offset + 12) << 32) | read_u32(bytes, offset + 16);
+            uint32_t captured_length = read_u32(bytes, offset + 20);
+            size_t packet = offset + 28;
+
+            if (packet + captured_length > options || captured_length < 28) {
+                fprintf(stderr, "%s: damaged packet at byte %zu\n", path, offset);
+                return false;
+            }
+
+            int headers_length = ((bytes[packet] >> 4) == 4) ? (bytes[packet] & 0x0f) * 4 + 8 : 48;
+
+            captured_datagram datagram;
+            datagram.time_ns = (long long) timestamp * nanoseconds_per_unit;
+            datagram.direction = 0;
+            if ((int) captured_length >= headers_length) {
+                datagram.data.assign(bytes, packet + headers_length, captured_length - headers_length);
+            }
+
+            for (size_t option = packet + ((captured_length + 3) & ~3); option + 4 <= options;) {
+
+                uint16_t code = read_u16(bytes, option), option_length = read_u16(bytes, option + 2);
+                if (code == PCAPNG_OPTION_END) break;
+
+                if (code == PCAPNG_OPTION_EPB_FLAGS && option_length == 4) {
+                    datagram.direction = read_u32(bytes, option + 4) & 3;
+                } else if (code == PCAPNG_OPTION_COMMENT) {
+                    datagram.note.assign(bytes, option + 4, option_length);
+                }
+
+                option += 4 + ((option_length + 3) & ~3);
+            }
+
+            datagrams.push_back(datagram);
+        }
+
+        offset += length;
+    }
+
+    return true;
+}
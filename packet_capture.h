@@ -0,0 +1,74 @@
+/*
+
+ * Description:
+   Capture of the datagrams a client or a server sends and receives, in pcapng, so that a slow transfer can be looked
+   at in Wireshark and replayed offline (see trace_replay.h). Each datagram is written as it leaves or is taken off
+   the socket, in an Enhanced Packet Block with:
+
+     - a nanosecond timestamp from the real-time clock, so that the captures of both ends can be lined up;
+     - its direction (the inbound/outbound epb_flags);
+     - a comment that says what the endpoint made of it: a new or a retransmitted data packet, a packet that arrived
+       in order, ahead of a gap or as a duplicate, an acknowledgement that moved the window or repeated the last one.
+
+   The UDP payload is written as it was on the wire, behind IPv4 or IPv6 and UDP headers rebuilt from the session's
+   addresses (link type RAW), so dissectors find it where they expect it. The local address is the one the socket is
+   bound to, and the peer's is where the endpoint sends; a wildcard local address is written as such. Only the thread
+   that runs the protocol records, so the capture takes no lock.
+
+ */
+
+#ifndef PACKET_CAPTURE_H
+#define PACKET_CAPTURE_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define CAPTURE_INBOUND 1               // the epb_flags direction values
+#define CAPTURE_OUTBOUND 2
+
+// A datagram read back from a capture.
+struct captured_datagram {
+    long long time_ns;
+    int direction;
+    std::string data;                   // the UDP payload
+    std::string note;
+};
+
+class packet_capture {
+
+private:
+
+    FILE *file = NULL;
+    struct sockaddr_storage local;
+    std::vector<char> frame;
+
+    void write_block(int direction, const struct sockaddr_storage &peer, const struct iovec *pieces, int count,
+                     const char *note);
+
+public:
+
+    // Starts the capture file at path. socket_fd is the socket whose address stands for this endpoint.
+    bool open(const char *path, const char *application, int socket_fd);
+    void close();
+
+    bool enabled() const { return file != NULL; }
+
+    void record(int direction, const struct sockaddr_storage &peer, const struct iovec *pieces, int count,
+                const char *note) {
+        if (file != NULL) write_block(direction, peer, pieces, count, note);
+    }
+
+    void record(int direction, const struct sockaddr_storage &peer, const char *data, int length, const char *note) {
+        struct iovec piece = {(void *) data, (size_t) length};
+        if (file != NULL) write_block(direction, peer, &piece, 1, note);
+    }
+};
+
+// Reads the datagrams of a capture written by packet_capture, in file order. Returns false, with a message, if the
+// file cannot be read or is not such a capture.
+bool read_capture(const char *path, std::vector<captured_datagram> &datagrams);
+
+#endif
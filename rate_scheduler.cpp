@@ -0,0 +1,304 @@
+/*
+
+ * Description:
+   Token buckets and the shared scheduler that pace the client's sends. See rate_scheduler.h.
+
+ */
+
+#include "rate_scheduler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+#define RATE_SCHEDULER_MAGIC 0x47424e53  // "GBNS"
+#define RATE_SCHEDULER_ATTACH_MS 1000    // how long a client waits for another to finish creating the scheduler
+
+static long long monotonic_us() {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// Adds the tokens earned since the last refill, up to the bucket's depth.
+static void refill(double &tokens, long long &refilled_us, long long rate, double depth, long long now_us) {
+
+    tokens = min(depth, tokens + (double) rate * (now_us - refilled_us) / 1000000.0);
+    refilled_us = now_us;
+}
+
+// The depth of a bucket that fills at rate, for datagrams of datagram_length bytes.
+static double bucket_depth(long long rate, int datagram_length) {
+
+    return max((double) rate * RATE_BURST_MS / 1000.0, 2.0 * datagram_length);
+}
+
+// Milliseconds until a bucket in debt is out of it again, at least 1.
+static int debt_ms(double tokens, long long rate) {
+
+    return (int) max(1.0, min(1000.0, -tokens * 1000.0 / rate + 1));
+}
+
+// Maps the scheduler named name, creating it if no client has yet.
+static shared_schedule *attach(const string &name) {
+
+    string path = "/gbn-" + name;
+    bool creator = true;
+    int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd == -1 && errno == EEXIST) {
+        creator = false;
+        fd = shm_open(path.c_str(), O_RDWR, 0600);
+    }
+
+    if (fd == -1) {
+        perror("(client) error when opening the scheduler");
+        return NULL;
+    }
+
+    if (creator && ftruncate(fd, sizeof(shared_schedule)) == -1) {
+        perror("(client) error when sizing the scheduler");
+        ::close(fd);
+        return NULL;
+    }
+
+    // Another client may have created the scheduler but not sized it yet.
+    struct stat status;
+    for (int waited_ms = 0; !creator && waited_ms < RATE_SCHEDULER_ATTACH_MS; waited_ms++) {
+        if (fstat(fd, &status) == 0 && status.st_size >= (off_t) sizeof(shared_schedule)) break;
+        usleep(1000);
+    }
+
+    void *memory = mmap(NULL, sizeof(shared_schedule), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (memory == MAP_FAILED) {
+        perror("(client) error when mapping the scheduler");
+        return NULL;
+    }
+
+    shared_schedule *schedule = (shared_schedule *) memory;
+
+    if (creator) {
+
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&schedule->lock, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+
+        schedule->rate = 0;
+        schedule->tokens = 0;
+        schedule->refilled_us = monotonic_us();
+        for (int position = 0; position < RATE_SCHEDULER_MAX_FLOWS; position++) {
+            schedule->flows[position] = scheduled_flow();
+        }
+
+        __atomic_store_n(&schedule->magic, RATE_SCHEDULER_MAGIC, __ATOMIC_RELEASE);
+        return schedule;
+    }
+
+    for (int waited_ms = 0; __atomic_load_n(&schedule->magic, __ATOMIC_ACQUIRE) != RATE_SCHEDULER_MAGIC; waited_ms++) {
+
+        if (waited_ms == RATE_SCHEDULER_ATTACH_MS) {
+            fprintf(stderr, "(client) the scheduler %s was never set up\n", name.c_str());
+            munmap(memory, sizeof(shared_schedule));
+            return NULL;
+        }
+
+        usleep(1000);
+    }
+
+    return schedule;
+}
+
+bool rate_scheduler::lock() {
+
+    int lock_status = pthread_mutex_lock(&shared->lock);
+
+    // The previous holder died; the schedule is only ever left with a refill or a charge half done.
+    if (lock_status == EOWNERDEAD) {
+        pthread_mutex_consistent(&shared->lock);
+        lock_status = 0;
+    }
+
+    return lock_status == 0;
+}
+
+void rate_scheduler::unlock() {
+
+    pthread_mutex_unlock(&shared->lock);
+}
+
+// Sets up the transfer's bucket and joins the shared scheduler, if the configuration asks for them. longest_datagram is
+// the longest datagram the transfer sends, which the buckets must hold at least twice.
+bool rate_scheduler::open(const session_config &config, int longest_datagram) {
+
+    long long now_us = monotonic_us();
+
+    datagram_length = longest_datagram;
+    rate = config.rate;
+    depth = bucket_depth(rate, datagram_length);
+    tokens = depth;
+    refilled_us = now_us;
+
+    if (!config.scheduler.empty()) {
+
+        if ((shared = attach(config.scheduler)) == NULL || !lock()) {
+            shared = NULL;
+            return false;
+        }
+
+        if (config.scheduler_rate > 0 && shared->rate != config.scheduler_rate) {
+            shared->rate = config.scheduler_rate;
+            shared->tokens = min(shared->tokens, bucket_depth(shared->rate, datagram_length));
+        }
+
+        // Entries of clients that ended without leaving are taken back.
+        for (int position = 0; position < RATE_SCHEDULER_MAX_FLOWS; position++) {
+
+            scheduled_flow &flow = shared->flows[position];
+
+            if (flow.pid != 0 && kill(flow.pid, 0) == -1 && errno == ESRCH) flow.pid = 0;
+            if (flow.pid == 0 && slot == -1) slot = position;
+        }
+
+        if (slot != -1) {
+            scheduled_flow &flow = shared->flows[slot];
+            flow = scheduled_flow();
+            flow.pid = getpid();
+            flow.priority = config.priority;
+            flow.weight = config.weight;
+        }
+
+        unlock();
+
+        if (slot == -1) {
+            fprintf(stderr, "(client) the scheduler %s already has %d transfers\n", config.scheduler.c_str(),
+                    RATE_SCHEDULER_MAX_FLOWS);
+            munmap(shared, sizeof(shared_schedule));
+            shared = NULL;
+            return false;
+        }
+    }
+
+    limited = (rate > 0 || shared != NULL);
+    return true;
+}
+
+void rate_scheduler::close() {
+
+    if (shared != NULL) {
+
+        if (lock()) {
+            shared->flows[slot].pid = 0;
+            unlock();
+        }
+
+        munmap(shared, sizeof(shared_schedule));
+        shared = NULL;
+        slot = -1;
+    }
+
+    limited = false;
+}
+
+// Leaves the transfers waiting for the shared tokens, when the transfer has nothing to send or its own cap holds it.
+void rate_scheduler::stop_waiting() {
+
+    if (lock()) {
+        shared->flows[slot].waiting = false;
+        unlock();
+    }
+
+    waiting = false;
+}
+
+bool rate_scheduler::try_admit() {
+
+    long long now_us = monotonic_us();
+    holding = true;
+
+    // The transfer's own cap comes first: a transfer it holds back does not wait for the shared tokens either.
+    if (rate > 0) {
+
+        refill(tokens, refilled_us, rate, depth, now_us);
+
+        if (tokens <= 0) {
+            hold_ms = debt_ms(tokens, rate);
+            held_by_rate++;
+            if (waiting) stop_waiting();
+            return false;
+        }
+    }
+
+    if (shared == NULL || !lock()) {
+        holding = false;
+        return true;
+    }
+
+    scheduled_flow &self = shared->flows[slot];
+    double lowest_finish = -1;
+    bool outranked = false;
+
+    for (int position = 0; position < RATE_SCHEDULER_MAX_FLOWS; position++) {
+
+        const scheduled_flow &flow = shared->flows[position];
+
+        if (position == slot || flow.pid == 0 || !flow.waiting || now_us - flow.asked_us > RATE_WAITING_US) continue;
+
+        if (flow.priority > self.priority) outranked = true;
+        if (flow.priority == self.priority && (lowest_finish < 0 || flow.finish < lowest_finish)) {
+            lowest_finish = flow.finish;
+        }
+    }
+
+    // A transfer that starts to wait takes up the virtual time of those already waiting.
+    if (!self.waiting && lowest_finish >= 0) self.finish = max(self.finish, lowest_finish);
+    self.waiting = waiting = true;
+    self.asked_us = now_us;
+
+    // The turn passes once the transfer is a bucket's depth ahead of the others, rather than after every packet, so
+    // that the transfers waiting do not take turns at the pace of their wake-ups.
+    double shared_depth = bucket_depth(shared->rate, datagram_length);
+    if (shared->rate > 0) refill(shared->tokens, shared->refilled_us, shared->rate, shared_depth, now_us);
+
+    if (outranked || (lowest_finish >= 0 && lowest_finish + shared_depth < self.finish)) {
+        hold_ms = 1;
+        held_by_turn++;
+    } else if (shared->rate > 0 && shared->tokens <= 0) {
+        hold_ms = debt_ms(shared->tokens, shared->rate);
+        held_by_scheduler++;
+    } else {
+        holding = false;
+    }
+
+    unlock();
+    return !holding;
+}
+
+void rate_scheduler::account(int bytes) {
+
+    if (rate > 0) tokens -= bytes;
+
+    if (shared != NULL && lock()) {
+
+        shared->flows[slot].finish += (double) bytes / shared->flows[slot].weight;
+        if (shared->rate > 0) shared->tokens -= bytes;
+
+        unlock();
+    }
+}
@@ -0,0 +1,101 @@
+/*
+
+ * Description:
+   Pacing of the client's sends. Without it the send loops go as fast as sendto() returns, and transfers that run at
+   the same time compete for the link with nothing to arbitrate between them. Two token buckets hold a transfer back:
+
+     - its own (--rate), which caps the transfer alone;
+     - a scheduler shared by the client processes that name it (--scheduler), kept in POSIX shared memory, which caps
+       all of them together (--scheduler-rate) and decides whose turn it is when they wait for the same tokens.
+
+   A bucket fills at its rate up to RATE_BURST_MS worth of bytes (two datagrams at the least). A new data packet may go
+   out while neither bucket is in debt, and every datagram sent is charged to both afterwards, so retransmissions and
+   repair packets, which cannot wait, count too and delay the packets after them.
+
+   Transfers in the scheduler belong to a priority class. An interactive transfer that is waiting for tokens holds
+   every bulk transfer back, so background copies never starve latency-sensitive ones; a transfer that is not waiting
+   (its window is full) holds back nobody. Within a class the tokens are shared by weighted fair queuing: each transfer
+   has a virtual finish time, the bytes it has sent divided by its --weight, and among the transfers waiting, the one
+   that is furthest behind goes first, until it is a bucket's depth ahead. A transfer that starts to wait after a pause
+   catches up with the virtual time of those already waiting, so it cannot claim the bandwidth it did not use.
+
+ */
+
+#ifndef RATE_SCHEDULER_H
+#define RATE_SCHEDULER_H
+
+#include <pthread.h>
+#include "config.h"
+
+#define RATE_BURST_MS 10                 // bucket depth, in milliseconds at the bucket's rate
+#define RATE_SCHEDULER_MAX_FLOWS 64      // transfers in one shared scheduler
+#define RATE_WAITING_US 20000            // a transfer that has not asked for this long is no longer waiting
+
+// A transfer's entry in a shared scheduler.
+struct scheduled_flow {
+    int pid = 0;                         // 0 for a free entry
+    int priority = PRIORITY_BULK;
+    int weight = 1;
+    bool waiting = false;                // it has packets to send and asks for tokens
+    long long asked_us = 0;
+    double finish = 0;                   // virtual finish time: bytes sent divided by the weight
+};
+
+// The shared memory of a scheduler. Its creator fills it in and then sets magic.
+struct shared_schedule {
+    int magic;
+    pthread_mutex_t lock;                // process-shared and robust, so a client that dies holding it does no harm
+    long long rate;                      // bytes per second, 0 for no common cap
+    double tokens;
+    long long refilled_us;
+    scheduled_flow flows[RATE_SCHEDULER_MAX_FLOWS];
+};
+
+class rate_scheduler {
+
+private:
+
+    bool limited = false;                // any bucket to wait for
+    int datagram_length = 0;
+
+    long long rate = 0;                  // the transfer's own cap, bytes per second, 0 for none
+    double depth = 0;
+    double tokens = 0;
+    long long refilled_us = 0;
+
+    shared_schedule *shared = NULL;
+    int slot = -1;
+    bool waiting = false;                // this transfer's entry is waiting
+    bool holding = false;
+    int hold_ms = 0;
+
+    bool lock();
+    void unlock();
+    void stop_waiting();
+    bool try_admit();
+    void account(int bytes);
+
+public:
+
+    // Times a new packet was held back, by the bucket that held it.
+    long long held_by_rate = 0, held_by_scheduler = 0, held_by_turn = 0;
+
+    bool open(const session_config &config, int longest_datagram);
+    void close();
+
+    bool enabled() const { return limited; }
+    bool shared_scheduler() const { return shared != NULL; }
+
+    // Whether a new data packet may be sent now. A refusal also says how long to wait before asking again.
+    bool admit() { return !limited || try_admit(); }
+    void charge(int bytes) { if (limited) account(bytes); }
+
+    // The sender stopped asking for another reason than the pacing, its window being full. Until it asks again, the
+    // transfers it was ahead of in the scheduler no longer wait for it.
+    void idle() { if (waiting) stop_waiting(); }
+
+    bool held() const { return limited && holding; }
+    int delay_ms() const { return hold_ms; }
+};
+
+#endif
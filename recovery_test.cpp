@@ -0,0 +1,244 @@
+/*
+
+ * Description:
+   A property-based test of loss recovery, run by `make test`. It drives the sender and receiver of the binaries
+   (gbn_sender.h and gbn_receiver.h) through random simulated sessions (see simulator.h): random windows, payloads,
+   sequence spaces, loss, reordering, delays, link rates and queues, with either retransmission mode and with or
+   without the handshake. Every session must deliver every chunk once and in order, count its retransmissions
+   consistently, and resend at most a window for each lost datagram, or where the path's delay varies, for each
+   timeout and rewind. A few fixed sessions check what random ones would rarely hit: reordering with the default
+   sequence space, and per-packet timers against going back N, on lossy paths and on a large window behind a short
+   queue, where they must not cost more.
+
+   Usage: ./recovery_test [sessions [seed]]
+
+   A failing session is printed with the simulator command line that replays it.
+
+ */
+
+#include "simulator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+
+using namespace std;
+
+#define DEFAULT_TEST_SESSIONS 500
+#define DEFAULT_TEST_SEED 1
+
+static int failures = 0;
+
+static double uniform(mt19937_64 &random, double minimum, double maximum) {
+    return uniform_real_distribution<double>(minimum, maximum)(random);
+}
+
+static int pick(mt19937_64 &random, int minimum, int maximum) {
+    return uniform_int_distribution<int>(minimum, maximum)(random);
+}
+
+static int total_packets(const simulation_settings &settings) {
+    return (int) ((settings.file_size + settings.payload_size - 1) / settings.payload_size);
+}
+
+static void print_session(const simulation_settings &settings) {
+
+    fprintf(stderr, "  ./simulator -w %d -p %d", settings.window_size, settings.payload_size);
+    if (settings.sequence_space != 0) fprintf(stderr, " -s %d", settings.sequence_space);
+    fprintf(stderr, " -r %s -H %d -f %lld -d %.17g -D %.17g -b %.17g -q %.17g -o %.17g -O %.17g -S %llu\n",
+            settings.retransmission == RETRANSMIT_PACKET ? "packet" : "gbn", settings.handshake_flag ? 1 : 0,
+            settings.file_size, settings.drop_rate, settings.delay_ms, settings.bandwidth, settings.queue_limit,
+            settings.reorder_rate, settings.reorder_delay_ms, (unsigned long long) settings.seed);
+}
+
+static void expect(bool holds, const char *property, const simulation_settings &settings,
+                   const simulation_result &result) {
+
+    if (holds) return;
+
+    failures++;
+    fprintf(stderr, "FAILED: %s\n", property);
+    fprintf(stderr, "  completed %d, delivered %lld (%lld misdelivered) of %d, sent %lld, retransmitted %lld, ",
+            result.completed ? 1 : 0, result.packets_delivered, result.misdelivered, total_packets(settings),
+            result.packets_sent, result.packets_retransmitted);
+    fprintf(stderr, "%lld timeouts, %lld rewinds, %lld datagrams lost\n", result.timeouts, result.rewinds,
+            result.datagrams_lost);
+    print_session(settings);
+}
+
+// A session on a random path. An explicit sequence space is only picked on a path that does not reorder, as a small
+// one cannot tell a late datagram from a new one there; reordering runs with the default.
+static simulation_settings random_session(mt19937_64 &random) {
+
+    simulation_settings settings;
+
+    settings.retransmission = pick(random, 0, 1) ? RETRANSMIT_PACKET : RETRANSMIT_GBN;
+    settings.window_size = pick(random, 0, 9) ? pick(random, 1, 64) : pick(random, 65, 2000);
+    settings.payload_size = pick(random, 1, 1400);
+    settings.file_size = pick(random, 0, 100000);
+    settings.handshake_flag = pick(random, 0, 4) != 0;
+    settings.delay_ms = uniform(random, 0.01, 5);
+
+    if (pick(random, 0, 3)) settings.drop_rate = uniform(random, 0, 0.2);
+
+    if (pick(random, 0, 3)) {
+        settings.reorder_rate = uniform(random, 0, 0.1);
+        settings.reorder_delay_ms = uniform(random, 0, 10);
+    } else if (pick(random, 0, 1)) {
+        int choice = pick(random, 0, 2);
+        settings.sequence_space = settings.window_size + 1;
+        if (choice == 1) settings.sequence_space = 2 * settings.window_size + 1;
+        if (choice == 2) while (settings.sequence_space & (settings.sequence_space - 1)) settings.sequence_space++;
+    }
+
+    // A rate-limited link queues a bounded number of bytes, like a socket buffer. Without a bound, a window far above
+    // the link's rate would queue resends without end, and the EOT behind them.
+    if (pick(random, 0, 1)) {
+        settings.bandwidth = uniform(random, 1e5, 1e8);
+        settings.queue_limit = uniform(random, 20000, 1000000);
+    }
+
+    settings.seed = random() >> 11;    // 53 bits, which ./simulator -S reads back exactly
+    return settings;
+}
+
+static void check_session(const simulation_settings &settings) {
+
+    simulation_result result = gbn_simulation(settings).run();
+    int packets = total_packets(settings);
+    bool started = result.packets_sent > 0;     // false when every SYN or SYN-ACK was lost
+
+    expect(result.misdelivered == 0, "every chunk is written where it belongs", settings, result);
+    expect(!started || result.packets_delivered == packets, "every chunk is delivered once", settings, result);
+    expect(result.completed || settings.drop_rate > 0, "a lossless session completes", settings, result);
+    expect(!started || result.packets_sent == packets + result.packets_retransmitted,
+           "every send is a first send or a counted retransmission", settings, result);
+
+    // On a path with a fixed delay, only a lost datagram makes the client resend, and at most its window for it. A
+    // late datagram or a long queue can cost a window as well, through a rewind or a timeout that was not needed.
+    bool fixed_delay = settings.reorder_rate == 0 && settings.bandwidth == 0;
+    if (fixed_delay) {
+        expect(result.packets_retransmitted <= settings.window_size * result.datagrams_lost,
+               "retransmissions stay within a window per lost datagram", settings, result);
+    } else {
+        expect(result.packets_retransmitted <= settings.window_size * (result.timeouts + result.rewinds),
+               "retransmissions stay within a window per timeout and rewind", settings, result);
+    }
+
+    bool quiet = settings.drop_rate == 0 && settings.reorder_rate == 0 && settings.bandwidth == 0;
+    expect(!quiet || result.packets_retransmitted == 0, "a path without loss, reordering or queues needs no resend",
+           settings, result);
+}
+
+// 5% of datagrams held back by up to 10 ms: with a sequence space of 8, stale packets are written in place of new
+// ones, which this test must see, and with the default, never.
+static void check_reordering() {
+
+    simulation_settings settings;
+    settings.file_size = 50481;
+    settings.reorder_rate = 0.05;
+    settings.reorder_delay_ms = 10;
+
+    long long small_space_misdelivered = 0;
+
+    for (int run = 0; run < 20; run++) {
+
+        settings.seed = DEFAULT_TEST_SEED + run;
+        settings.sequence_space = 0;
+        check_session(settings);
+
+        settings.sequence_space = 8;
+        small_space_misdelivered += gbn_simulation(settings).run().misdelivered;
+    }
+
+    if (small_space_misdelivered == 0) {
+        failures++;
+        fprintf(stderr, "FAILED: stale packets written with a sequence space of 8 go unnoticed\n");
+    }
+}
+
+// Runs a session with either retransmission mode. Per-packet timers must not resend more or finish later than going
+// back N, give or take 10%: the server drops every packet after a lost one, so resending the packets one at a time,
+// or ahead of the one it waits for, only adds timeouts.
+static void compare_retransmission(simulation_settings settings) {
+
+    settings.retransmission = RETRANSMIT_GBN;
+    check_session(settings);
+    simulation_result go_back_n = gbn_simulation(settings).run();
+
+    settings.retransmission = RETRANSMIT_PACKET;
+    check_session(settings);
+    simulation_result result = gbn_simulation(settings).run();
+
+    expect(result.packets_retransmitted <= go_back_n.packets_retransmitted * 11 / 10,
+           "per-packet timers resend no more than going back N", settings, result);
+    expect(result.completion_s <= go_back_n.completion_s * 1.1,
+           "per-packet timers finish no later than going back N", settings, result);
+}
+
+// A 1 MB transfer with a window of 64 over 5 ms each way, losing 0.1% to 5% of datagrams.
+static void check_lossy_window() {
+
+    double drops[] = {0.001, 0.01, 0.02, 0.05};
+
+    for (size_t position = 0; position < sizeof(drops) / sizeof(drops[0]); position++) {
+        for (int run = 0; run < 5; run++) {
+
+            simulation_settings settings;
+            settings.window_size = 64;
+            settings.payload_size = 1000;
+            settings.file_size = 1000000;
+            settings.delay_ms = 5;
+            settings.drop_rate = drops[position];
+            settings.seed = DEFAULT_TEST_SEED + run;
+
+            compare_retransmission(settings);
+        }
+    }
+}
+
+// A 2 MB transfer with a window of 20000 behind queues of 30 KB to 1 MB and no loss.
+static void check_large_window() {
+
+    double queues[] = {30000, 100000, 200000, 1000000};
+
+    for (size_t position = 0; position < sizeof(queues) / sizeof(queues[0]); position++) {
+
+        simulation_settings settings;
+        settings.window_size = 20000;
+        settings.sequence_space = 65536;
+        settings.payload_size = 1400;
+        settings.file_size = 2000000;
+        settings.bandwidth = 1e8;
+        settings.queue_limit = queues[position];
+
+        compare_retransmission(settings);
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    int sessions = (argc > 1) ? atoi(argv[1]) : DEFAULT_TEST_SESSIONS;
+    unsigned long long seed = (argc > 2) ? strtoull(argv[2], NULL, 10) : DEFAULT_TEST_SEED;
+
+    if (argc > 3 || sessions < 0) {
+        fprintf(stderr, "Usage: ./recovery_test [sessions [seed]]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mt19937_64 random(seed);
+
+    for (int session = 0; session < sessions; session++) check_session(random_session(random));
+
+    check_reordering();
+    check_lossy_window();
+    check_large_window();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("recovery_test: %d random sessions and the fixed ones passed\n", sessions);
+    return 0;
+}
@@ -22,7 +22,13 @@
 struct listener_variables listener;
 struct talker_variables talker;
 
+struct session_config config;
+
 bool verbose_flag = false;
+copy_counters copies;
+receiver_feedback feedback;  // active while the session is part of a distribution
+packet_capture capture;
+int receiver_id;
 
 
 /*
@@ -42,132 +48,801 @@ bool verbose_flag = false;
 
  */
 
-int driver(char *file_name) {
+// Opens the output file for a session. If the checkpoint of an interrupted transfer describes the same source file and
+// the output file still holds the committed bytes, the file is kept up to that offset and the digest is picked up from
+// its contents; otherwise the file is truncated. Returns the offset the client should resume from.
+long long open_destination(block_writer &destination_file, const string &file_name, const session_parameters &offer,
+                           uint32_t &file_digest) {
+
+    transfer_checkpoint checkpoint;
+    long long output_size, output_mtime, resume_offset = 0;
+
+    if (config.checkpoint_interval > 0 && offer.file_size >= 0 && offer.receivers == 0 &&
+        load_checkpoint(checkpoint_path(file_name), checkpoint) &&
+        checkpoint.file_size == offer.file_size && checkpoint.file_mtime == offer.file_mtime &&
+        file_identity(file_name, output_size, output_mtime) && output_size >= checkpoint.committed_offset) {
+        resume_offset = checkpoint.committed_offset;
+    }
+
+    // Anything written after the checkpoint is dropped; the client sends it again. The size the SYN announced is
+    // reserved for the rest of the file.
+    destination_file.configure(config.io_backend == "direct", config.sync_policy);
+
+    if (!destination_file.open(file_name, resume_offset, config.write_buffers, offer.file_size)) {
+        perror("(server) error when opening output file");
+        exit(EXIT_FAILURE);
+    }
+
+    if (verbose_flag && config.io_backend == "direct" && !destination_file.direct_io()) {
+        cout << "O_DIRECT is not available for " << file_name << ", it is written through the page cache" << endl;
+        cout << endl;
+    }
+
+    file_digest = 0;
+
+    if (resume_offset > 0 && config.checksum == CHECKSUM_CRC32C) {
+        digest_file_prefix(file_name, resume_offset, file_digest);
+    }
+
+    return resume_offset;
+}
+
+// CLOCK_MONOTONIC in milliseconds, the clock of the NAK backoff.
+static long long monotonic_ms() {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+// Builds an acknowledgement (or, in a distribution, a NAK) for sequence_number in payload. Its data field advertises
+// the receive window: how many more packets the output buffers can take before the server has to wait for the disk.
+// Batches are written through their own files and advertise no limit beyond the window. In a distribution the
+// receiver's id follows the window.
+void serialize_acknowledgement(int type, int sequence_number, const block_writer &destination_file, bool batch_flag,
+                               char *payload) {
+
+    long long free_packets = config.window_size;
+    if (!batch_flag && destination_file.is_open()) free_packets = destination_file.free_space() / config.payload_size;
+
+    char window_field[32];
+    int window_length = sprintf(window_field, "%d", (int) min(free_packets, (long long) MAX_ADVERTISED_WINDOW));
+    if (feedback.active()) window_length += sprintf(window_field + window_length, " %d", feedback.id);
+
+    packet *acknowledgement = new packet(type, sequence_number, window_length, window_field);
+    acknowledgement->serialize(payload);
+    delete acknowledgement;
+}
+
+// Sends an acknowledgement, or a NAK, to the client. note says what it is in the capture.
+void send_acknowledgement(int type, int sequence_number, const block_writer &destination_file, bool batch_flag,
+                          char *payload, const char *note) {
+
+    serialize_acknowledgement(type, sequence_number, destination_file, batch_flag, payload);
+
+    capture.record(CAPTURE_OUTBOUND, talker.address, payload, strlen(payload), note);
+
+    // Send a message to the client socket using UDP datagrams.
+    if (sendto(talker.socket_fd, payload, strlen(payload), 0, (struct sockaddr *) &talker.address,
+               talker.address_length) == -1) {
+        perror("(server) error when calling sendto\n");
+        exit(1);
+    }
+}
+
+// In a distribution, waits until a datagram can be received. The acknowledgement owed for the packets received so far
+// goes out once the receive queue is empty, and a gap's NAK once its backoff has run out, unless the missing packet
+// arrives first (see distribution.h).
+template <typename trace>
+static void await_datagram(int last_in_order_number, const block_writer &destination_file, bool batch_flag,
+                           char *payload) {
+
+    struct pollfd event;
+    event.fd = listener.socket_fd;
+    event.events = POLLIN;
+
+    while (poll(&event, 1, 0) == 0) {
+
+        if (feedback.acknowledgement_owed()) {
+            send_acknowledgement(0, last_in_order_number, destination_file, batch_flag, payload, "acknowledgement");
+            feedback.acknowledged();
+        }
+
+        long long deadline = feedback.nak_deadline();
+        int ready = poll(&event, 1, (deadline == -1) ? -1 : (int) max(0LL, deadline - monotonic_ms()));
+
+        if (ready == -1 && errno != EINTR) {
+            perror("(server) error when calling poll");
+            exit(EXIT_FAILURE);
+        }
+
+        if (ready == 0 && deadline != -1) {
+            send_acknowledgement(NAK_PACKET_TYPE, last_in_order_number, destination_file, batch_flag, payload, "NAK");
+            feedback.nak_sent();
+            if (trace::enabled) {
+                cout << "[DISTRIBUTION]: NAK sent for the packet after " << last_in_order_number << endl << endl;
+            }
+        }
+
+        if (ready > 0) return;
+    }
+}
+
+// The client only succeeds once the server has answered its EOT, so a server that exits after the first answer fails
+// the transfer whenever that answer is lost: the client's retransmitted EOTs reach nobody. Like TCP's TIME_WAIT, the
+// server stays for as long as the client may send the EOT again, and answers every retransmitted one (see
+// gbn_receiver.h).
+template <typename sequence_space, typename trace>
+static void linger_after_eot(const gbn_receiver<sequence_space> &receiver, const char *answer, char *buffer,
+                             int buffer_length) {
+
+    struct pollfd event;
+    event.fd = listener.socket_fd;
+    event.events = POLLIN;
+
+    long long now, give_up = monotonic_ms() + (long long) MAX_EOT_ATTEMPTS * config.eot_timeout_ms;
+
+    while ((now = monotonic_ms()) < give_up) {
+
+        int ready = poll(&event, 1, (int) (give_up - now));
+
+        if (ready == -1 && errno != EINTR) {
+            perror("(server) error when calling poll");
+            exit(EXIT_FAILURE);
+        }
+
+        if (ready <= 0) continue;
+
+        int num_bytes = receive_datagram(listener.socket_fd, buffer, buffer_length - 1, 0, NULL, NULL, NULL);
+        if (num_bytes <= 0) continue;
+
+        buffer[num_bytes] = '\0';
+
+        int type = -1, sequence_number = -1;
+        sscanf(buffer, "%d %d", &type, &sequence_number);
+        bool answered = (receiver.receive(type, sequence_number) == RECEIVE_FINISH);
+
+        capture.record(CAPTURE_INBOUND, talker.address, buffer, num_bytes, answered ? "EOT, again" : "after the EOT");
+        if (!answered) continue;
+
+        capture.record(CAPTURE_OUTBOUND, talker.address, answer, strlen(answer), "EOT");
+
+        if (sendto(talker.socket_fd, answer, strlen(answer), 0, (struct sockaddr *) &talker.address,
+                   talker.address_length) == -1) {
+            perror("(server) error when calling sendto\n");
+            exit(1);
+        }
+
+        if (trace::enabled) cout << "[STATE]: Retransmitted EOT answered" << endl;
+    }
+}
+
+// The zero-copy receive. recvmsg() puts the first header_length bytes of the datagram (the fixed-width header and the
+// checksum field) in buffer, the next payload_size bytes at block_space, and anything beyond that back in buffer. A
+// data packet whose header matches what arrived is left that way, with its data in the block; any other datagram is
+// put back together in buffer and handled like one received with recvfrom(). Returns the datagram's length.
+int receive_into_block(char *buffer, int buffer_length, char *block_space, int header_length, bool &data_in_block) {
+
+    int payload_size = config.payload_size;
+    int overflow_length = max(buffer_length - 1 - header_length - payload_size, 0);
+    struct iovec pieces[3] = {{buffer, (size_t) header_length}, {block_space, (size_t) payload_size},
+                              {buffer + header_length + payload_size, (size_t) overflow_length}};
+    char control[RECEIVE_CONTROL_LENGTH];
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = pieces;
+    message.msg_iovlen = 3;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    int num_bytes = recvmsg(listener.socket_fd, &message, 0);
+    if (num_bytes == -1) return -1;
+
+    read_receive_control(message);
+
+    int type, sequence_number, length;
+    data_in_block = num_bytes > header_length && parse_fixed_header(buffer, type, sequence_number, length) &&
+                    type == 1 && length == num_bytes - FIXED_HEADER_LENGTH && !(message.msg_flags & MSG_TRUNC);
+
+    if (!data_in_block && num_bytes > header_length) {
+        int block_length = min(num_bytes - header_length, payload_size);
+        memcpy(buffer + header_length, block_space, block_length);
+        copies.bytes_copied += block_length;
+    }
+
+    return num_bytes;
+}
 
-    ofstream destination_file(file_name), arrlog_file("arrival.log");
-    int num_bytes, expected_sequence_number = 0;
-    char buffer[MAX_BUFFER_LENGTH], payload[MAX_BUFFER_LENGTH], send_payload[30];
+// What a datagram the server received is, as the capture notes it: for a data packet, where it falls against the
+// expected sequence number. buffer holds at least the datagram's header, NUL-terminated.
+template <typename sequence_space>
+static const char *arrival_note(const sequence_space &space, const char *buffer, int expected_sequence_number) {
+
+    int type, sequence_number;
+    if (sscanf(buffer, "%d %d", &type, &sequence_number) != 2) return "malformed";
+
+    switch (type) {
+        case 1:
+            if (sequence_number == expected_sequence_number) return "data, in order";
+            if (sequence_distance(space, expected_sequence_number, sequence_number) < config.window_size) {
+                return "data ahead of the expected packet: a gap";
+            }
+            return "data behind the expected packet: a duplicate";
+        case 3: return "EOT";
+        case SYN_PACKET_TYPE: return "SYN";
+        case FEC_REPAIR_PACKET_TYPE: return "FEC repair";
+        default: return "malformed";
+    }
+}
+
+// The server's protocol loop, specialized for the session's sequence space and tracing (see gbn_engine.h). Returns
+// ENGINE_RESELECT when a client negotiates a sequence space that space does not hold. It starts with config holding
+// the server's own settings, the upper limits of every session's.
+template <typename sequence_space, typename trace>
+static int run_driver(char *file_name, const sequence_space &space, server_engine &engine) {
+
+    block_writer destination_file;  // opened by the handshake, which decides whether to resume, or by the first packet
+    batch_writer batch;         // used instead when the client sends a directory
+    bool batch_flag = false;
+    log_sink &arrlog_file = engine.arrival_log;
+    int num_bytes;
+    int buffer_length = max(config.buffer_length(), HANDSHAKE_BUFFER_LENGTH);
+    vector<char> buffer_storage(buffer_length), payload_storage(buffer_length);
+    vector<char> send_payload_storage(CHECKSUM_FIELD_LENGTH + 16);  // the digest and a receiver id
+    char *buffer = buffer_storage.data(), *payload = payload_storage.data();
+    char *send_payload = send_payload_storage.data();
+    vector<char> decoded_storage(config.payload_size);  // the negotiated payload size can only be smaller
+    char send_buffer[HANDSHAKE_BUFFER_LENGTH];
     struct sockaddr_storage client_addr;
-    socklen_t addr_len;
+    socklen_t addr_len = sizeof(client_addr);
+
+    // With UDP GRO, one receive can return several data packets coalesced. They are handed out one per iteration.
+    bool coalescing = config.segmentation_offload && !config.zero_copy;
+    vector<char> coalesced_storage(coalescing ? GSO_MAX_BYTES : 0);
+    int coalesced_offset = 0, coalesced_length = 0, coalesced_segment = 0;
 
     packet *received_packet = new packet(-1, -1, -1, payload);
-    bool first_iteration = true, termination_flag = false;
+    bool first_iteration = true, termination_flag = false, negotiated_flag = false, transfer_failed = false;
+    uint32_t file_digest = 0;
+    long corrupted_packets = 0;
+
+    // Progress of the transfer, saved every checkpoint_interval chunks once the handshake has identified the file.
+    string checkpoint_file_name = checkpoint_path(file_name);
+    transfer_checkpoint progress;
+    int chunks_since_checkpoint = 0;
+
+    // With FEC on, data packets that arrive ahead of a lost one are kept, and lost ones are rebuilt from repair
+    // packets; both are then delivered as if they had just arrived.
+    fec_decoder fec;
+    fec.configure(config);
+    int replay_length;
+    vector<char> replay_storage(buffer_length);
+
+    // The server's own settings are the upper limits for whatever the client asks for in its SYN.
+    session_parameters limits = engine.limits, accepted = limits;
+
+    // Which packets are taken in order and which are answered with the last acknowledgement (see gbn_receiver.h).
+    gbn_receiver<sequence_space> receiver(space);
 
     while (!termination_flag) {
 
-        if (verbose_flag)
-        {
+        if (trace::enabled) {
+
             if (!first_iteration) {
                 cout << "===================================================" << endl << endl << endl << endl;
             }
 
-            if (verbose_flag) cout << "===================================================" << endl << endl;
+            cout << "===================================================" << endl << endl;
             first_iteration = false;
         }
 
-        if (verbose_flag) cout << "[STATE]: Server is listening" << endl << endl;
-        if (verbose_flag) cout << "Expected Sequence Number: " << expected_sequence_number << endl << endl;
+        if (trace::enabled) cout << "[STATE]: Server is listening" << endl << endl;
+        if (trace::enabled) cout << "Expected Sequence Number: " << receiver.expected_sequence_number << endl << endl;
 
-        // Wait for the first packet to arrive.
-        if ((num_bytes = recvfrom(listener.socket_fd, buffer, sizeof(buffer), 0,
-                                  (struct sockaddr *) &client_addr,
-                                  &addr_len)) == -1) {
-            perror("(server) error when calling recvfrom\n");
-            exit(EXIT_FAILURE);
+        // With the zero-copy path negotiated, data packets are received straight into the output file's block.
+        bool zero_copy_receive = config.zero_copy && !batch_flag && config.compression == COMPRESSION_NONE &&
+                                 !fec.enabled() && destination_file.is_open();
+        int header_length = FIXED_HEADER_LENGTH + (config.checksum == CHECKSUM_CRC32C ? CHECKSUM_FIELD_LENGTH : 0);
+        bool data_in_block = false, from_socket = true;  // not from the socket: a SYN taken over or a kept packet
+        char *block_space = NULL;
+
+        // In a distribution, acknowledgements and NAKs go out while the server waits for the next datagram.
+        if (feedback.active() && engine.pending_length == 0 && !(coalescing && coalesced_offset < coalesced_length)) {
+            await_datagram<trace>(receiver.last_acknowledged(), destination_file, batch_flag, payload);
         }
 
-        received_packet->deserialize(buffer);
+        // Wait for the first packet to arrive, unless FEC already holds the expected one or the loop takes over a SYN.
+        if (engine.pending_length > 0) {
+
+            memcpy(buffer, engine.pending.data(), engine.pending_length);
+            num_bytes = engine.pending_length;
+            engine.pending_length = 0;
+            from_socket = false;
+
+        } else if (fec.enabled() && fec.take(receiver.delivered_packets, replay_storage.data(), replay_length)) {
 
-        if (verbose_flag) cout << "[STATE]: Packet with sequence number " <<  received_packet->getSeqNum() << " received" << endl << endl;
+            int header_length = sprintf(buffer, "%d %d %d ", 1, receiver.expected_sequence_number, replay_length);
+            memcpy(buffer + header_length, replay_storage.data(), replay_length);
+            num_bytes = header_length + replay_length;
+            from_socket = false;
 
-        // Check if the packet is received in the correct order.
-        if (received_packet->getSeqNum() == expected_sequence_number) {
+            if (trace::enabled) cout << "[FEC]: Kept or rebuilt packet delivered" << endl << endl;
 
-            if (verbose_flag) cout << "Packet in the correct order" << endl << endl;
+        } else if (zero_copy_receive) {
 
-            // Check if its a data packet, and perform the appropriate actions if it is.
-            if (received_packet->getType() == 1) {
+            if ((block_space = destination_file.reserve(config.payload_size)) == NULL) {
+                perror("(server) error when writing output file");
+                exit(EXIT_FAILURE);
+            }
+
+            num_bytes = receive_into_block(buffer, buffer_length, block_space, header_length, data_in_block);
+        } else if (coalescing) {
 
-                destination_file << received_packet->getData();
-                arrlog_file << received_packet->getSeqNum() << endl;
+            if (coalesced_offset == coalesced_length) {
 
-                packet *acknowledgement = new packet(0, received_packet->getSeqNum(), 0, NULL);
-                acknowledgement->serialize(payload);
-                delete acknowledgement;
+                addr_len = sizeof(client_addr);
+                coalesced_length = receive_datagram(listener.socket_fd, coalesced_storage.data(), GSO_MAX_BYTES, 0,
+                                                    &client_addr, &addr_len, &coalesced_segment);
+                coalesced_offset = 0;
 
-                // Send a message to the client socket using UDP datagrams.
-                if ((num_bytes = sendto(talker.socket_fd, payload, strlen(payload), 0, talker.p->ai_addr,
-                                        talker.p->ai_addrlen)) == -1) {
-                    perror("(server) error when calling sendto\n");
-                    exit(1);
+                if (coalesced_length == -1) {
+                    perror("(server) error when calling recvmsg\n");
+                    exit(EXIT_FAILURE);
                 }
 
-                if (verbose_flag) cout << "[STATE]: Acknowledgement of packet sent to Client" << endl << endl;
+                if (coalesced_segment == 0) coalesced_segment = coalesced_length;
+            }
 
-                expected_sequence_number = (expected_sequence_number + 1) % MAX_SEQUENCE_NUMBERS;
+            num_bytes = min(min(coalesced_segment, coalesced_length - coalesced_offset), buffer_length - 1);
+            memcpy(buffer, coalesced_storage.data() + coalesced_offset, num_bytes);
+            coalesced_offset += min(coalesced_segment, coalesced_length - coalesced_offset);
+            copies.bytes_copied += num_bytes;
+
+        } else {
+            addr_len = sizeof(client_addr);
+            num_bytes = receive_datagram(listener.socket_fd, buffer, buffer_length - 1, 0, &client_addr, &addr_len,
+                                         NULL);
+        }
+
+        if (num_bytes == -1) {
+            perror("(server) error when calling recvfrom\n");
+            exit(EXIT_FAILURE);
+        }
 
+        buffer[data_in_block ? header_length : num_bytes] = '\0';
+
+        if (from_socket && capture.enabled()) {
+            const char *note = arrival_note(space, buffer, receiver.expected_sequence_number);
+
+            if (data_in_block) {
+                struct iovec pieces[2] = {{buffer, (size_t) header_length},
+                                          {block_space, (size_t) (num_bytes - header_length)}};
+                capture.record(CAPTURE_INBOUND, talker.address, pieces, 2, note);
             } else {
+                capture.record(CAPTURE_INBOUND, talker.address, buffer, num_bytes, note);
+            }
+        }
+
+        // packet::deserialize copies as many bytes as the length field says, so a damaged length is dropped here.
+        // The packet is also reset, because deserializing a packet with no data leaves its data pointer NULL.
+        int declared_type, declared_sequence_number, declared_length, header_end;
+
+        if (data_in_block) {
+            // The header and the checksum field are in buffer, the data is in the block.
+            *received_packet = packet(1, atoi(buffer + 2), num_bytes - header_length, block_space);
+        } else if (sscanf(buffer, "%d %d %d%n", &declared_type, &declared_sequence_number, &declared_length,
+                          &header_end) != 3 || declared_length < 0 || declared_length > num_bytes) {
+            if (trace::enabled) cout << "[STATE]: Malformed packet dropped" << endl << endl;
+            continue;
+        } else if ((declared_type == 1 || declared_type == FEC_REPAIR_PACKET_TYPE) && declared_length > 0 &&
+                   header_end + 1 + declared_length <= num_bytes) {
+            // Data and repair packets are used where they lie in the receive buffer; packet::deserialize() would copy
+            // them.
+            *received_packet = packet(declared_type, declared_sequence_number, declared_length,
+                                      buffer + header_end + 1);
+        } else {
+            *received_packet = packet(-1, -1, -1, payload);
+            received_packet->deserialize(buffer);
+        }
 
-                // If the incoming packet is an EOT packet, send an EOT back and close connection.
-                if (received_packet->getType() == 3) {
+        // A SYN asks for the session parameters. The first one is negotiated; retransmitted SYNs are answered with the
+        // same parameters and the nonce of the SYN being answered, so the client can time each attempt.
+        if (received_packet->getType() == SYN_PACKET_TYPE) {
 
-                    if (verbose_flag) cout << "[STATE]: Server received an EOT packet" << endl << endl;
+            session_parameters offer;
+            char text[HANDSHAKE_TEXT_LENGTH];
 
-                    arrlog_file << received_packet->getSeqNum() << endl;
+            if (!decode_parameters(received_packet->getData(), received_packet->getLength(), offer)) {
+                if (trace::enabled) cout << "[HANDSHAKE]: Invalid SYN dropped" << endl << endl;
+                continue;
+            }
 
-                    packet *acknowledgement = new packet(2, received_packet->getSeqNum(), 0, send_payload);
-                    acknowledgement->serialize(payload);
-                    delete acknowledgement;
+            // A SYN from a new session (the client was restarted) ends the current one: its progress is saved and the
+            // new session resumes from it if it sends the same file.
+            if (!negotiated_flag || offer.session != accepted.session) {
 
-                    // Send a message to the client socket using UDP datagrams.
-                    if ((num_bytes = sendto(talker.socket_fd, payload, strlen(payload), 0, talker.p->ai_addr,
-                                            talker.p->ai_addrlen)) == -1) {
-                        perror("(server) error when calling sendto\n");
-                        exit(1);
+                if (destination_file.is_open()) {
+                    if (destination_file.flush() && progress.file_size >= 0) {
+                        save_checkpoint(checkpoint_file_name, progress);
                     }
+                    destination_file.close();
+                }
 
-                    if (verbose_flag) cout << "[STATE]: Acknowledgement of EOT sent to Client" << endl;
+                accepted = negotiate_parameters(offer, limits);
+
+                // A loop specialized for another sequence space takes over, and starts with this SYN. It sizes its
+                // buffers from config, which gets the server's own settings back from an earlier session's.
+                if (!sequence_space::fits(accepted.sequence_space)) {
+                    apply_parameters(limits, config);
+                    engine.session_sequence_space = accepted.sequence_space;
+                    engine.pending.assign(buffer, buffer + num_bytes);
+                    engine.pending_length = num_bytes;
+                    delete received_packet;
+                    return ENGINE_RESELECT;
+                }
 
-                    if (verbose_flag) cout << endl << "===================================================" << endl;
-                    termination_flag = true;
+                apply_parameters(accepted, config);
+                negotiated_flag = true;
+
+                // In a distribution, the answers are tagged with the receiver's id and paced (see distribution.h). The
+                // NAK backoff only pays off in a group, where another receiver's repair can make a NAK unnecessary.
+                if (offer.receivers > 0) {
+                    accepted.receiver = receiver_id;
+                    feedback.start(receiver_id, accepted.window_size, config.group.empty() ? 0 : config.nak_backoff_ms);
+                } else {
+                    feedback.stop();
                 }
+
+                // A batch is written below the output path, which becomes a directory, and is not resumable.
+                batch_flag = (offer.batch == 1);
+
+                if (batch_flag) {
+                    batch.configure(config.io_backend == "direct", config.sync_policy);
+                    batch.start(file_name);
+                    file_digest = 0;
+                    accepted.resume_offset = 0;
+                } else {
+                    accepted.resume_offset = open_destination(destination_file, file_name, offer, file_digest);
+                }
+
+                progress.committed_offset = accepted.resume_offset;
+                progress.file_size = (batch_flag || feedback.active()) ? -1 : offer.file_size;
+                progress.file_mtime = offer.file_mtime;
+                chunks_since_checkpoint = 0;
+                receiver.restart();
+                fec.configure(config);
+
+                if (trace::enabled && accepted.resume_offset > 0) {
+                    cout << "[HANDSHAKE]: Resuming the transfer at byte " << accepted.resume_offset << endl << endl;
+                }
+            }
+
+            accepted.nonce = offer.nonce;
+            int text_length = encode_parameters(accepted, text, sizeof(text));
+
+            packet *syn_ack = new packet(SYN_ACK_PACKET_TYPE, 0, text_length, text);
+            syn_ack->serialize(send_buffer);
+            delete syn_ack;
+
+            capture.record(CAPTURE_OUTBOUND, talker.address, send_buffer, strlen(send_buffer), "SYN-ACK");
+
+            if ((num_bytes = sendto(talker.socket_fd, send_buffer, strlen(send_buffer), 0,
+                                    (struct sockaddr *) &talker.address, talker.address_length)) == -1) {
+                perror("(server) error when calling sendto\n");
+                exit(1);
+            }
+
+            if (trace::enabled) cout << "[HANDSHAKE]: Server sent SYN-ACK: " << text << endl << endl;
+            continue;
+        }
+
+        if (trace::enabled) cout << "[STATE]: Packet with sequence number " <<  received_packet->getSeqNum() << " received" << endl << endl;
+
+        char *data = received_packet->getData();
+        int data_length = received_packet->getLength();
+        bool protected_packet = (received_packet->getType() == 1 ||
+                                 received_packet->getType() == FEC_REPAIR_PACKET_TYPE);
+
+        // With FEC on, a data packet is placed by the index of its chunk. Sequence numbers are unambiguous over twice
+        // the window (see handshake.cpp), so one less than a window ahead of the expected packet is taken to be ahead
+        // of it and any other one behind it. The checksum covers the index, which catches a packet that was sent with
+        // the sequence number of another chunk.
+        int chunk_index = -1, checksum_identity = received_packet->getSeqNum();
+
+        if (fec.enabled() && received_packet->getType() == 1) {
+
+            int ahead = sequence_distance(space, receiver.expected_sequence_number, received_packet->getSeqNum());
+            chunk_index = receiver.delivered_packets + (ahead < config.window_size ? ahead : ahead - space.size());
+            checksum_identity = chunk_index;
+        }
+
+        // With checksums on, a data packet whose checksum does not match is treated as lost: it is neither written nor
+        // acknowledged, and the client's timer recovers it.
+        if (config.checksum == CHECKSUM_CRC32C && protected_packet) {
+
+            // The checksum field leads the data, except on the zero-copy path, where it stays behind with the header.
+            char *checksum_field = data_in_block ? buffer + FIXED_HEADER_LENGTH : data;
+            uint32_t packet_crc;
+
+            if (!data_in_block) {
+                data += CHECKSUM_FIELD_LENGTH;
+                data_length -= CHECKSUM_FIELD_LENGTH;
+            }
+
+            if (data_length < 0 || !read_checksum_field(checksum_field, packet_crc) ||
+                packet_checksum(crc32c(data, data_length), received_packet->getType(), checksum_identity) !=
+                packet_crc) {
+                corrupted_packets++;
+                if (trace::enabled) cout << "[STATE]: Checksum mismatch, packet dropped" << endl << endl;
+                continue;
+            }
+        }
+
+        // Repair packets only feed the FEC decoder. Data packets are given to it too, including ones that arrive ahead
+        // of the expected packet.
+        if (received_packet->getType() == FEC_REPAIR_PACKET_TYPE) {
+            if (fec.enabled() && !fec.add_repair(received_packet->getSeqNum(), data, data_length) && trace::enabled) {
+                cout << "[FEC]: Malformed repair packet dropped" << endl << endl;
             }
+            continue;
         }
-        // If the incoming packet is out of order, then resend an acknowledgement for the last in-order packet.
-        else {
 
-            if (verbose_flag) cout << "[STATE]: Packet is out of order" << endl << endl;
+        if (chunk_index >= receiver.delivered_packets) {
+            fec.add_data(chunk_index, received_packet->getData(), received_packet->getLength());
+        }
+
+        // Without a handshake the output file is started over when the first packet arrives.
+        if (!batch_flag && !destination_file.is_open()) {
+            open_destination(destination_file, file_name, session_parameters(), file_digest);
+        }
+
+        // The packet is taken in order, ends the session, or is answered with the last acknowledgement (see
+        // gbn_receiver.h).
+        int verdict = receiver.receive(received_packet->getType(), received_packet->getSeqNum());
+
+        if (verdict == RECEIVE_DELIVER) {
+
+            if (trace::enabled) cout << "Packet in the correct order" << endl << endl;
+
+            // The bare protocol carries text, which ends at the first NUL. Checksummed packets and batches carry
+            // binary data of exactly the given length.
+            const char *chunk = data;
+            int chunk_length = data_length;
+            if (!batch_flag && config.checksum == CHECKSUM_NONE) chunk_length = strnlen(data, data_length);
+
+            // With compression on, the chunk is decoded here, when it is written, so out-of-order packets are never
+            // decoded. It is decoded straight into the output block, except in a batch. A chunk that does not decode
+            // is dropped like a corrupt packet.
+            if (config.compression != COMPRESSION_NONE) {
+
+                char *decoded = batch_flag ? decoded_storage.data() : destination_file.reserve(config.payload_size);
+
+                if (decoded == NULL) {
+                    perror("(server) error when writing output file");
+                    exit(EXIT_FAILURE);
+                }
+
+                chunk = decoded;
+                chunk_length = decompress_chunk(data, data_length, decoded, config.payload_size);
+
+                if (chunk_length < 0) {
+                    corrupted_packets++;
+                    if (trace::enabled) cout << "[STATE]: Undecodable chunk, packet dropped" << endl << endl;
+                    continue;
+                }
+            }
+
+            // Data that is already in the output block only has to be kept there; anything else is copied in.
+            if (batch_flag) {
+
+                if (!batch.write(chunk, chunk_length)) {
+                    fprintf(stderr, "(server) the batch could not be written\n");
+                    exit(EXIT_FAILURE);
+                }
+
+                copies.bytes_copied += chunk_length;
+
+            } else if (data_in_block || chunk != data) {
+
+                destination_file.commit(chunk_length);
+                copies.bytes_in_place += chunk_length;
+
+            } else {
+
+                if (!destination_file.write(chunk, chunk_length)) {
+                    perror("(server) error when writing output file");
+                    exit(EXIT_FAILURE);
+                }
+
+                copies.bytes_copied += chunk_length;
+            }
+
+            if (config.checksum == CHECKSUM_CRC32C) {
+                file_digest = crc32c_update(file_digest, chunk, chunk_length);
+            }
+
+            // Periodically record how much of the file is complete. The data is flushed first, so the checkpoint
+            // never claims bytes the file does not have.
+            progress.committed_offset += chunk_length;
+            if (config.checkpoint_interval > 0 && progress.file_size >= 0 &&
+                ++chunks_since_checkpoint >= config.checkpoint_interval) {
+                if (!destination_file.flush()) {
+                    perror("(server) error when writing output file");
+                    exit(EXIT_FAILURE);
+                }
+
+                save_checkpoint(checkpoint_file_name, progress);
+                chunks_since_checkpoint = 0;
+            }
+            arrlog_file.record(received_packet->getSeqNum());
+
+            // In a distribution, the acknowledgement may wait for the packets queued behind this one.
+            if (!feedback.active() || feedback.delivered()) {
+                send_acknowledgement(0, received_packet->getSeqNum(), destination_file, batch_flag, payload,
+                                     "acknowledgement");
+                feedback.acknowledged();
+                if (trace::enabled) cout << "[STATE]: Acknowledgement of packet sent to Client" << endl << endl;
+            }
+
+            receiver.delivered();
+            fec.release_before(receiver.delivered_packets);
+
+        } else if (verdict == RECEIVE_FINISH) {
+
+            if (trace::enabled) cout << "[STATE]: Server received an EOT packet" << endl << endl;
+
+            // The transfer is complete, so there is nothing left to resume. The output is finished before the answer
+            // goes out, as the server lingers after it.
+            remove_checkpoint(checkpoint_file_name);
+
+            if (!destination_file.close()) {
+                perror("(server) error when writing output file");
+                transfer_failed = true;
+            }
+
+            if (batch_flag && !batch.finished()) {
+                fprintf(stderr, "(server) the batch ended before all of its files were received\n");
+                transfer_failed = true;
+            }
+
+            arrlog_file.record(received_packet->getSeqNum());
+
+            // With checksums on, the client's EOT carries the CRC32C of the file it sent. The server answers with the
+            // CRC32C of what it wrote so both ends can tell whether the copy is intact.
+            int digest_length = 0;
+            if (config.checksum == CHECKSUM_CRC32C) {
+
+                uint32_t client_digest;
+
+                if (data_length != CHECKSUM_FIELD_LENGTH || !read_checksum_field(data, client_digest) ||
+                    client_digest != file_digest) {
+                    fprintf(stderr, "(server) file digest mismatch: the received file is corrupt\n");
+                    transfer_failed = true;
+                } else if (trace::enabled) {
+                    cout << "File digest verified" << endl << endl;
+                }
+
+                write_checksum_field(file_digest, send_payload);
+                digest_length = CHECKSUM_FIELD_LENGTH;
+            }
 
-            packet *acknowledgement = new packet(0, expected_sequence_number, 0, NULL);
+            // In a distribution, the client counts the EOTs by receiver.
+            if (feedback.active()) {
+                digest_length += sprintf(send_payload + digest_length, digest_length > 0 ? " %d" : "%d", feedback.id);
+            }
+
+            packet *acknowledgement = new packet(2, received_packet->getSeqNum(), digest_length, send_payload);
             acknowledgement->serialize(payload);
             delete acknowledgement;
 
+            capture.record(CAPTURE_OUTBOUND, talker.address, payload, strlen(payload), "EOT");
+
             // Send a message to the client socket using UDP datagrams.
-            if ((num_bytes = sendto(talker.socket_fd, payload, strlen(payload), 0, talker.p->ai_addr,
-                                    talker.p->ai_addrlen)) == -1) {
+            if ((num_bytes = sendto(talker.socket_fd, payload, strlen(payload), 0,
+                                    (struct sockaddr *) &talker.address, talker.address_length)) == -1) {
                 perror("(server) error when calling sendto\n");
                 exit(1);
             }
 
-            if (verbose_flag) cout << "[STATE]: Acknowledgement of the last in-order packet sent" << endl;
+            if (trace::enabled) cout << "[STATE]: Acknowledgement of EOT sent to Client" << endl;
+
+            receiver.finished();
+            linger_after_eot<sequence_space, trace>(receiver, payload, buffer, buffer_length);
+
+            if (trace::enabled) cout << endl << "===================================================" << endl;
+            termination_flag = true;
+
+        } else if (verdict == RECEIVE_REACKNOWLEDGE) {
+
+            if (trace::enabled) cout << "[STATE]: Packet is out of order" << endl << endl;
+
+            // In a distribution, a packet ahead of the expected one means a gap, reported by one NAK after a backoff.
+            // A packet from behind was resent for a slower receiver; it is only acknowledged once the queue drains.
+            if (feedback.active()) {
+
+                if (received_packet->getType() == 1 &&
+                    sequence_distance(space, receiver.expected_sequence_number, received_packet->getSeqNum()) <
+                    config.window_size) {
+                    feedback.ahead(receiver.delivered_packets, monotonic_ms());
+                } else {
+                    feedback.behind();
+                }
+
+                continue;
+            }
+
+            send_acknowledgement(0, receiver.last_acknowledged(), destination_file, batch_flag, payload,
+                                 "duplicate acknowledgement");
+
+            if (trace::enabled) cout << "[STATE]: Acknowledgement of the last in-order packet sent" << endl;
 
         }
     }
 
+    if (!destination_file.close()) {
+        perror("(server) error when writing output file");
+        transfer_failed = true;
+    }
+
+    if (trace::enabled && corrupted_packets > 0) {
+        cout << corrupted_packets << " corrupted packets dropped" << endl;
+    }
+
+    if (trace::enabled) {
+        cout << "Packets dropped by the kernel (socket buffer full): " << kernel_drops() << endl;
+    }
+
+    if (trace::enabled && fec.enabled()) {
+        cout << fec.recovered() << " lost packets rebuilt from repair packets (GF(256) " << gf256_implementation();
+        cout << ")" << endl;
+    }
+
+    if (trace::enabled) {
+        cout << "Payload bytes copied in user space: " << copies.bytes_copied << ", received in place: ";
+        cout << copies.bytes_in_place << endl;
+    }
+
     delete received_packet;
-    arrlog_file.close();
-    return 0;
+    return transfer_failed ? 1 : 0;
+}
+
+template <typename sequence_space, typename trace>
+int server_engine::run(const sequence_space &space) {
+    return run_driver<sequence_space, trace>(file_name, space, *this);
+}
+
+// Runs the protocol loop specialized for the server's settings, and again for each sequence space a client negotiates.
+int driver(char *file_name) {
+
+    server_engine engine;
+    engine.file_name = file_name;
+    engine.limits = parameters_from_config(config);
+    engine.session_sequence_space = config.sequence_space;
+
+    // The arrival log is buffered in memory and written out in blocks rather than flushed per packet.
+    if (!engine.arrival_log.open("arrival.log", config.log_mode, config.log_block_size)) {
+        exit(EXIT_FAILURE);
+    }
+
+    int result = ENGINE_RESELECT;
+    while (result == ENGINE_RESELECT) {
+        result = select_sequence_space(engine, engine.session_sequence_space, verbose_flag);
+    }
+
+    engine.arrival_log.close();
+    return result;
 }
 
 void initialize_talker(char *host_name, char *server_port) {
 
     int getaddrinfo_call_status;
-    int counter = 0;
+    int family = socket_family(listener.socket_fd);
     struct addrinfo hints, *server_info;
 
     // loading up address structs with getaddrinfo():
     memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_INET;    // use IPv4
+    hints.ai_family = AF_UNSPEC;    // IPv4 or IPv6, whichever the host name has
     hints.ai_socktype = SOCK_DGRAM;    // UDP sockets
 
     // get information about a host name and/or service and load up a struct sockaddr with the result.
@@ -176,23 +851,20 @@ void initialize_talker(char *host_name, char *server_port) {
         exit(EXIT_FAILURE);
     }
 
-    // loop through all the results and make a socket
+    // The listener's socket sends too, so the first address it can reach is used (see endpoint.h).
     for (talker.p = server_info; talker.p != NULL; talker.p = talker.p->ai_next) {
-
-        // make a socket using socket call and ensure that it has run error-free
-        if ((talker.socket_fd = socket(talker.p->ai_family, (talker.p)->ai_socktype, talker.p->ai_protocol)) == -1) {
-            perror("(client) error during socket creation");
-            continue;
+        if (adapt_address(talker.p, family, talker.address, talker.address_length)) {
+            break;
         }
-
-        break;
     }
 
     if (talker.p == NULL) {
-        fprintf(stderr, "client: failed to create datagram socket\n");
+        fprintf(stderr, "server: %s cannot be reached from an IPv%d socket\n", host_name, family == AF_INET6 ? 6 : 4);
         exit(EXIT_FAILURE);
     }
 
+    talker.socket_fd = listener.socket_fd;
+
     freeaddrinfo(server_info);  // the server_info structure is no longer needed
 }
 
@@ -201,95 +873,157 @@ void initialize_listener(char *listen_port) {
     int getaddrinfo_call_status;
     struct addrinfo hints, *server_info;
     int yes = 1;
+    vector<string> interfaces = split_interfaces(config.interfaces);
+    bool bound = false;
 
-    // loading up address structs with getaddrinfo():
-    memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_INET;  // use IPv4
-    hints.ai_socktype = SOCK_DGRAM;  // UDP sockets
-    hints.ai_flags = AI_PASSIVE;  // fill in my IP for me
+    // An IPv6 socket also takes IPv4 traffic, so it is tried first; without IPv6, an IPv4 socket is used.
+    int families[2] = {AF_INET6, AF_INET};
 
-    // get information about a host name and/or service and load up a struct sockaddr with the result.
-    if ((getaddrinfo_call_status = getaddrinfo(NULL, listen_port, &hints, &server_info)) != 0) {
-        fprintf(stderr, "(client) error when calling getaddrinfo in listener: %s\n",
-                gai_strerror(getaddrinfo_call_status));
-        exit(EXIT_FAILURE);
-    }
+    for (int attempt = 0; attempt < 2 && !bound; attempt++) {
 
-    // loop through all the results and bind to the first we can
-    for (listener.p = server_info; listener.p != NULL; listener.p = listener.p->ai_next) {
+        // loading up address structs with getaddrinfo():
+        memset(&hints, 0, sizeof hints);
+        hints.ai_family = families[attempt];
+        hints.ai_socktype = SOCK_DGRAM;  // UDP sockets
+        hints.ai_flags = AI_PASSIVE;  // fill in my IP for me
 
-        // make a socket using socket() call, and ensure that it ran error-free
-        if ((listener.socket_fd = socket(listener.p->ai_family, listener.p->ai_socktype,
-                                         listener.p->ai_protocol)) == -1) {
-            perror("(client) error during listener's socket creation");
-            continue;
-        }
+        // get information about a host name and/or service and load up a struct sockaddr with the result.
+        if ((getaddrinfo_call_status = getaddrinfo(NULL, listen_port, &hints, &server_info)) != 0) {
+
+            if (families[attempt] == AF_INET6) continue;
 
-        // helps avoid the "Address already in use" error message.
-        if (setsockopt(listener.socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
-            perror("(client) error when calling setsockopt in listener");
+            fprintf(stderr, "(server) error when calling getaddrinfo in listener: %s\n",
+                    gai_strerror(getaddrinfo_call_status));
             exit(EXIT_FAILURE);
         }
 
-        // associate a socket with an IP address and port number using the bind() call, and make sure it ran error-free.
-        if (bind(listener.socket_fd, listener.p->ai_addr, listener.p->ai_addrlen) == -1) {
-            close(listener.socket_fd);
-            perror("(client) error when binding socket in listener");
-            continue;
-        }
+        // loop through all the results and bind to the first we can
+        for (listener.p = server_info; listener.p != NULL; listener.p = listener.p->ai_next) {
 
+            // make a socket using socket() call, and ensure that it ran error-free
+            if ((listener.socket_fd = socket(listener.p->ai_family, listener.p->ai_socktype,
+                                             listener.p->ai_protocol)) == -1) {
+                if (errno != EAFNOSUPPORT) perror("(server) error during listener's socket creation");
+                continue;
+            }
+
+            if (listener.p->ai_family == AF_INET6 && !make_dual_stack(listener.socket_fd)) {
+                perror("(server) error when calling setsockopt (IPV6_V6ONLY) in listener");
+                exit(EXIT_FAILURE);
+            }
+
+            // helps avoid the "Address already in use" error message.
+            if (setsockopt(listener.socket_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1) {
+                perror("(server) error when calling setsockopt (SO_REUSEADDR) in listener");
+                exit(EXIT_FAILURE);
+            }
+
+            // With --interface, the session's traffic goes through the first interface given.
+            if (!interfaces.empty() && !bind_to_interface(listener.socket_fd, interfaces[0])) {
+                fprintf(stderr, "(server) error when binding the listener to %s: %s\n", interfaces[0].c_str(),
+                        strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+
+            // associate a socket with an IP address and port number using the bind() call, and make sure it ran
+            // error-free.
+            if (bind(listener.socket_fd, listener.p->ai_addr, listener.p->ai_addrlen) == -1) {
+                close(listener.socket_fd);
+                perror("(server) error when binding socket in listener");
+                continue;
+            }
 
-        break;
+            bound = true;
+            break;
+        }
+
+        freeaddrinfo(server_info);  // the server_info structure is no longer needed
     }
 
-    if (listener.p == NULL) {
-        fprintf(stderr, "client: failed to bind socket in listener\n");
+    if (!bound) {
+        fprintf(stderr, "server: failed to bind socket in listener\n");
         exit(EXIT_FAILURE);
     }
+}
 
-    freeaddrinfo(server_info);  // the server_info structure is no longer needed
+// Sizes the socket buffers to hold a window of data packets, and applies the other kernel-side settings (see
+// socket_tuning.h). The window is the server's own, the largest the handshake can settle on.
+void tune_sockets() {
+
+    socket_buffer_sizes sizes = size_socket_buffers(listener.socket_fd, config.window_size, config.buffer_length(),
+                                                    config.socket_buffer);
+
+    if (!enable_drop_counter(listener.socket_fd) && verbose_flag) {
+        cout << "SO_RXQ_OVFL is not available, kernel drops are not counted" << endl << endl;
+    }
+
+    if (config.busy_poll_us > 0 && !enable_busy_poll(listener.socket_fd, config.busy_poll_us) && verbose_flag) {
+        cout << "SO_BUSY_POLL could not be set (it needs CAP_NET_ADMIN above net.core.busy_read)" << endl << endl;
+    }
+
+    // Coalesced packets cannot be split across the zero-copy receive's pieces, so GRO is left off with it.
+    if (config.segmentation_offload && !config.zero_copy && !enable_receive_offload(listener.socket_fd)) {
+        config.segmentation_offload = false;
+        if (verbose_flag) cout << "UDP GRO is not available, packets are received one by one" << endl << endl;
+    }
+
+    if (verbose_flag) {
+        cout << "Socket buffers: " << sizes.send_bytes << " bytes to send, " << sizes.receive_bytes;
+        cout << " bytes to receive" << endl << endl;
+    }
 }
 
 int main(int argc, char *argv[]) {
 
-    char *host_name, *port1, *port2, *file_name;
+    parse_arguments(argc, argv, "server", config);
 
-    // ensure that entries required are provided at run-time.
-    if (argc != 5) {
-        fprintf(stderr,
-                "usage: server <emulatorName: host address of the emulator> <sendToEmulator: UDP port number-\n");
-        fprintf(stderr,
-                "-used by the emulator to receive data from the server> <receiveFromEmulator: UDP port number-\n");
-        fprintf(stderr,
-                "-by the server to receive ACKs for the emulator> <fileName: name of the file to be transferred>\n");
-        exit(EXIT_FAILURE);
+    if (config.interactive_flag) {
+        char user_input;
+        cout << endl << "Verbose? (Yes: y \\ No: n):" << endl;
+        cin >> user_input;
+
+        if (user_input == 'y'){
+            config.verbose_level = 1;
+        }
+        cout << endl;
     }
 
-    host_name = argv[1];
-    port1 = argv[2];
-    port2 = argv[3];
-    file_name = argv[4];
+    verbose_flag = (config.verbose_level > 0);
+    receiver_id = pick_receiver_id();
+
+    initialize_listener((char *) config.send_port.c_str());
 
-    char user_input;
-    cout << endl << "Verbose? (Yes: y \\ No: n):" << endl;
-    cin >> user_input;
+    // Servers on the same host can all join the group: the listener's port is shared (SO_REUSEADDR).
+    if (!config.group.empty()) {
 
-    if (user_input == 'y'){
-        verbose_flag = true;
+        vector<string> interfaces = split_interfaces(config.interfaces);
+
+        if (!join_group(listener.socket_fd, config.group, interfaces.empty() ? string() : interfaces[0])) {
+            fprintf(stderr, "(server) error when joining the multicast group %s: %s\n", config.group.c_str(),
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        if (verbose_flag) cout << "Joined the multicast group " << config.group << endl << endl;
+    }
+
+    initialize_talker((char *) config.host_name.c_str(), (char *) config.receive_port.c_str());
+    tune_sockets();
+
+    if (!config.capture_file.empty() && !capture.open(config.capture_file.c_str(), "gbn server", listener.socket_fd)) {
+        exit(EXIT_FAILURE);
     }
-    cout << endl;
 
-    initialize_listener(port1);
-    initialize_talker(host_name, port2);
+    int transfer_status = driver((char *) config.file_name.c_str());
+    capture.close();
 
-    if (driver(file_name) != 0) {
+    if (transfer_status != 0) {
         fprintf(stderr, "TERMINATED\n");
         exit(EXIT_FAILURE);
     } else {
         exit(EXIT_SUCCESS);
     }
-    close(listener.socket_fd);
-    close(talker.socket_fd);
+    close(listener.socket_fd);  // the talker shares this socket
 
     return 0;
 
@@ -23,23 +23,46 @@
 #include <string.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/time.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <netdb.h>
 #include <iostream>
 #include <sys/errno.h>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <poll.h>
+
+#include "log_sink.h"
+#include "config.h"
+#include "handshake.h"
+#include "checksum.h"
+#include "compression.h"
+#include "checkpoint.h"
+#include "batch.h"
+#include "block_writer.h"
+#include "zerocopy.h"
+#include "fec.h"
+#include "gf256.h"
+#include "endpoint.h"
+#include "socket_tuning.h"
+#include "gbn_rules.h"
+#include "gbn_engine.h"
+#include "gbn_receiver.h"
+#include "distribution.h"
+#include "packet_capture.h"
 
 using namespace std;
 
-#define WINDOW_SIZE 7
-#define MAX_BUFFER_LENGTH 38
-#define MAX_SEQUENCE_NUMBERS 8
 
 struct talker_variables
 {
     int socket_fd;
     struct addrinfo* p;
+    struct sockaddr_storage address;  // copy of p->ai_addr, which is freed along with the addrinfo list
+    socklen_t address_length;
 };
 
 struct listener_variables
@@ -48,3 +71,20 @@ struct listener_variables
     struct addrinfo *p;
 };
 
+// Returned by the protocol loop when a client negotiates a sequence space it is not specialized for.
+#define ENGINE_RESELECT -1
+
+// What the server keeps when one specialization of its protocol loop hands the session to another (see gbn_engine.h):
+// its own limits, the arrival log, and the SYN that asked for the new sequence space.
+struct server_engine {
+
+    char *file_name;
+    session_parameters limits;
+    int session_sequence_space;  // of the session the next loop takes over
+    log_sink arrival_log;
+    vector<char> pending;
+    int pending_length = 0;
+
+    template <typename sequence_space, typename trace>
+    int run(const sequence_space &space);
+};
@@ -0,0 +1,320 @@
+/*
+
+ * Description:
+   A discrete-event simulator of a Go-Back-N session. See simulator.h. The simulator binary's command line is in
+   simulator_main.cpp, and recovery_test.cpp runs random sessions through it.
+
+ */
+
+#include "simulator.h"
+
+#include <algorithm>
+
+using namespace std;
+
+#define HANDSHAKE_BACKOFF_LIMIT_MS 60000
+
+bool simulated_link::transmit(long long now, int length, mt19937_64 &random, long long &arrival) {
+
+    long long delay = delay_ns;
+
+    if (replay != NULL) {
+        const replayed_datagram &fate = (*replay)[replayed++ % replay->size()];
+        if (!fate.delivered) {
+            lost++;
+            return false;
+        }
+        delay = fate.delay_ns;
+    } else if (drop_rate > 0 && uniform_real_distribution<double>(0, 1)(random) < drop_rate) {
+        lost++;
+        return false;
+    }
+
+    if (queue_limit > 0 && (busy_until - now) / nanoseconds_per_byte > queue_limit) {
+        lost++;
+        return false;
+    }
+
+    long long departure = max(now, busy_until) + (long long) (length * nanoseconds_per_byte);
+    busy_until = departure;
+    arrival = max(departure + delay, last_arrival);
+    last_arrival = arrival;
+
+    // A held-back datagram does not hold back the ones after it, which overtake it.
+    if (reorder_rate > 0 && uniform_real_distribution<double>(0, 1)(random) < reorder_rate) {
+        arrival += (long long) (uniform_real_distribution<double>(0, 1)(random) * reorder_delay_ns);
+    }
+
+    return true;
+}
+
+// The sequence space of a session: the one given, or the smallest power of two above the window, at least the default.
+static int session_sequence_space(const simulation_settings &settings) {
+
+    if (settings.sequence_space != 0) return settings.sequence_space;
+
+    int sequence_space = DEFAULT_SEQUENCE_SPACE;
+    while (sequence_space <= settings.window_size) sequence_space <<= 1;
+    return sequence_space;
+}
+
+gbn_simulation::gbn_simulation(const simulation_settings &settings) :
+        settings(settings), random(settings.seed),
+        sender(modular_sequence_space(session_sequence_space(settings)),
+               chosen_retransmission(settings.retransmission), settings.window_size, settings.timeout_ms, false),
+        receiver(modular_sequence_space(session_sequence_space(settings))) {
+
+    forward.drop_rate = backward.drop_rate = settings.drop_rate;
+    forward.delay_ns = backward.delay_ns = (long long) (settings.delay_ms * NANOSECONDS_PER_MS);
+    forward.reorder_rate = backward.reorder_rate = settings.reorder_rate;
+    forward.reorder_delay_ns = backward.reorder_delay_ns = (long long) (settings.reorder_delay_ms * NANOSECONDS_PER_MS);
+
+    if (settings.replay != NULL) {
+        forward.replay = &settings.replay->forward;
+        backward.replay = &settings.replay->backward;
+    }
+
+    if (settings.bandwidth > 0) {
+        forward.nanoseconds_per_byte = backward.nanoseconds_per_byte = 1e9 / settings.bandwidth;
+        forward.queue_limit = backward.queue_limit = settings.queue_limit;
+    }
+
+    total_packets = (int) ((settings.file_size + settings.payload_size - 1) / settings.payload_size);
+    first_sent.assign(total_packets, 0);
+    latencies_ms.reserve(total_packets);
+}
+
+// Puts a datagram on a link, and schedules its arrival unless the link drops it.
+void gbn_simulation::schedule(simulated_link &link, int length, int kind, int sequence_number, int chunk_index) {
+
+    long long arrival;
+    result.events++;
+
+    if (!link.transmit(now, length, random, arrival)) return;
+
+    simulated_event event = {arrival, next_order++, kind, sequence_number, chunk_index};
+    events.push(event);
+}
+
+static int decimal_digits(int value) {
+
+    int digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+// The length of a data packet as the client sends it: the "1 <seq> <length> " header and the chunk.
+int gbn_simulation::data_length(int sequence_number, int chunk_index) const {
+
+    long long remaining = settings.file_size - (long long) chunk_index * settings.payload_size;
+    int length = (int) min(remaining, (long long) settings.payload_size);
+
+    return 4 + decimal_digits(sequence_number) + decimal_digits(length) + length;
+}
+
+// The SYN exchange of perform_handshake(): every attempt waits twice as long as the one before, and the round trip
+// of the attempt that is answered is the sender's first measurement. A SYN-ACK that arrives after its attempt timed
+// out is ignored, as its nonce no longer matches.
+bool gbn_simulation::handshake() {
+
+    if (!settings.handshake_flag) return true;
+
+    long long wait_ms = settings.timeout_ms;
+
+    for (int attempt = 1; attempt <= HANDSHAKE_ATTEMPTS; attempt++) {
+
+        long long syn_arrival, syn_ack_arrival;
+        long long sent_at = now;
+
+        result.events += 2;
+
+        if (forward.transmit(now, HANDSHAKE_TEXT_LENGTH / 2, random, syn_arrival)) {
+
+            now = syn_arrival;
+            bool answered = backward.transmit(now, HANDSHAKE_TEXT_LENGTH / 2, random, syn_ack_arrival) &&
+                            syn_ack_arrival - sent_at <= wait_ms * NANOSECONDS_PER_MS;
+
+            if (answered) {
+                now = syn_ack_arrival;
+                double round_trip_time_ms = (double) (now - sent_at) / NANOSECONDS_PER_MS;
+                sender.measured(round_trip_time_ms);
+                return true;
+            }
+        }
+
+        now = sent_at + wait_ms * NANOSECONDS_PER_MS;
+        wait_ms = min(wait_ms * 2, (long long) HANDSHAKE_BACKOFF_LIMIT_MS);
+    }
+
+    return false;
+}
+
+void gbn_simulation::send_data(int sequence_number, int chunk_index) {
+
+    result.packets_sent++;
+    schedule(forward, data_length(sequence_number, chunk_index), EVENT_DATA_AT_SERVER, sequence_number, chunk_index);
+}
+
+bool gbn_simulation::resend(int sequence_number, int chunk_index) {
+
+    send_data(sequence_number, chunk_index);
+    return true;
+}
+
+// [Event 1] of the client: the window again if it is to be resent, then new packets while the window has room. Once
+// everything is acknowledged, the EOT exchange starts.
+void gbn_simulation::client_send() {
+
+    int limit = window_limit(settings.window_size, -1);
+
+    sender.resend_pending(*this, now_ms());
+
+    while (next_chunk < total_packets && sender.outstanding() < limit) {
+
+        int sequence_number = sender.next_sequence_number();
+
+        first_sent[next_chunk] = now;
+        send_data(sequence_number, next_chunk);
+        sender.sent(sequence_number, next_chunk, now_ms());
+        next_chunk++;
+    }
+
+    if (next_chunk == total_packets && sender.packets_acknowledged == total_packets && eot_attempts == 0) {
+        client_eot();
+    }
+}
+
+// [Event 2] of the client.
+void gbn_simulation::client_acknowledgement(int sequence_number) {
+    sender.acknowledge(*this, sequence_number, now_ms());
+}
+
+// [Event 3] of the client.
+void gbn_simulation::client_timers() {
+
+    if (!sender.expire(now_ms())) return;
+
+    result.events++;
+    sender.retransmit_expired(*this, now_ms());
+}
+
+// Sends the EOT, or gives up once MAX_EOT_ATTEMPTS have gone unanswered.
+void gbn_simulation::client_eot() {
+
+    if (eot_attempts == MAX_EOT_ATTEMPTS) {
+        client_done = true;
+        return;
+    }
+
+    eot_attempts++;
+    eot_deadline = now + settings.eot_timeout_ms * NANOSECONDS_PER_MS;
+    schedule(forward, 4 + decimal_digits(sender.window_base) + 1, EVENT_EOT_AT_SERVER, sender.window_base, -1);
+}
+
+// The server's loop: it writes and acknowledges a packet received in order, and acknowledges the last in-order packet
+// again for any other. Once it has answered the EOT it lingers, answering every retransmitted EOT and nothing else
+// (see linger_after_eot in server.cpp).
+void gbn_simulation::server_receive(const simulated_event &event) {
+
+    int type = (event.kind == EVENT_EOT_AT_SERVER) ? CLIENT_EOT_PACKET_TYPE : DATA_PACKET_TYPE;
+    int verdict = receiver.receive(type, event.sequence_number);
+
+    if (verdict == RECEIVE_DELIVER) {
+
+        // The server writes the packet as the next chunk of the file, whichever chunk it carries.
+        if (event.chunk_index != receiver.delivered_packets) result.misdelivered++;
+
+        latencies_ms.push_back((float) ((double) (now - first_sent[event.chunk_index]) / NANOSECONDS_PER_MS));
+        receiver.delivered();
+        schedule(backward, SIMULATED_ACK_LENGTH, EVENT_ACK_AT_CLIENT, event.sequence_number, -1);
+
+    } else if (verdict == RECEIVE_FINISH) {
+
+        receiver.finished();
+        schedule(backward, 4 + decimal_digits(event.sequence_number) + 1, EVENT_EOT_AT_CLIENT, event.sequence_number,
+                 -1);
+
+    } else if (verdict == RECEIVE_REACKNOWLEDGE) {
+        schedule(backward, SIMULATED_ACK_LENGTH, EVENT_ACK_AT_CLIENT, receiver.last_acknowledged(), -1);
+    }
+}
+
+simulation_result gbn_simulation::run() {
+
+    if (!handshake()) {
+        result.completion_s = (double) now / 1e9;
+        return result;
+    }
+
+    sender.start(now_ms());
+    client_send();
+
+    while (!client_done) {
+
+        // The client sleeps until its next deadline unless a datagram arrives first.
+        long long wake = -1;
+        if (eot_attempts > 0) wake = eot_deadline;
+        else if (!sender.timers.empty()) wake = sender.timers.next_deadline() * NANOSECONDS_PER_MS;
+
+        if (!events.empty() && (wake == -1 || events.top().time <= wake)) {
+
+            simulated_event event = events.top();
+            events.pop();
+
+            now = max(now, event.time);
+            result.events++;
+
+            if (event.kind == EVENT_DATA_AT_SERVER || event.kind == EVENT_EOT_AT_SERVER) {
+                server_receive(event);
+            } else if (event.kind == EVENT_EOT_AT_CLIENT) {
+                result.completed = (eot_attempts > 0);
+                client_done = result.completed;
+            } else if (eot_attempts == 0) {
+                client_acknowledgement(event.sequence_number);
+                client_timers();
+                client_send();
+            }
+
+        } else if (wake != -1) {
+
+            now = max(now, wake);
+
+            if (eot_attempts > 0) {
+                client_eot();
+            } else {
+                client_timers();
+                client_send();
+            }
+
+        } else {
+            break;  // nothing left in flight and no timer armed: the session is stuck
+        }
+    }
+
+    result.packets_delivered = receiver.delivered_packets;
+    result.packets_retransmitted = sender.packets_retransmitted;
+    result.timeouts = sender.timeouts;
+    result.rewinds = sender.rewinds;
+    result.datagrams_lost = forward.lost + backward.lost;
+
+    result.completion_s = (double) now / 1e9;
+    if (result.completed && result.completion_s > 0) result.goodput = settings.file_size / result.completion_s;
+
+    if (!latencies_ms.empty()) {
+
+        double total = 0;
+        for (size_t position = 0; position < latencies_ms.size(); position++) total += latencies_ms[position];
+        result.latency_mean_ms = total / latencies_ms.size();
+
+        size_t middle = latencies_ms.size() / 2, high = latencies_ms.size() * 99 / 100;
+        nth_element(latencies_ms.begin(), latencies_ms.begin() + middle, latencies_ms.end());
+        result.latency_p50_ms = latencies_ms[middle];
+        nth_element(latencies_ms.begin(), latencies_ms.begin() + high, latencies_ms.end());
+        result.latency_p99_ms = latencies_ms[high];
+    }
+
+    return result;
+}
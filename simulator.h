@@ -0,0 +1,170 @@
+/*
+
+ * Description:
+   A discrete-event simulator of a Go-Back-N session. The client and the server run as two actors on a virtual clock,
+   joined by a simulated channel with a propagation delay, an optional bandwidth limit, and independent random loss and
+   reordering in both directions, like the emulator's drop rate. The client's window, timers and recovery are the
+   gbn_sender the client binary runs, and the server's in-order rule is the server binary's gbn_receiver (see
+   gbn_sender.h and gbn_receiver.h); the simulation only replaces their sockets and clock. A simulated session
+   therefore follows the binaries packet for packet: the handshake's round trip sets the retransmission timeout,
+   duplicates rewind the window, per-packet or whole-window timers resend, and the EOT exchange is retried. It only
+   leaves out what costs time without changing the protocol (files, checksums, sockets), and what the binaries add
+   around the window: FEC, pacing, distributions. Each data packet still carries its chunk index, so a packet the
+   server writes in place of another one is counted. No event waits on a real clock, so a session that takes minutes
+   runs in milliseconds. Instead of random loss, the channel can replay the losses and delays captured on both ends of
+   a real transfer (see trace_replay.h).
+
+ */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdint.h>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "gbn_engine.h"
+#include "gbn_receiver.h"
+#include "gbn_rules.h"
+#include "gbn_sender.h"
+#include "handshake.h"
+#include "trace_replay.h"
+
+#define DEFAULT_SIMULATED_FILE_SIZE (1 << 20)
+#define DEFAULT_SIMULATED_DELAY_MS 0.05
+
+// Bytes of an acknowledgement on the wire: its header and the advertised window.
+#define SIMULATED_ACK_LENGTH 16
+
+#define NANOSECONDS_PER_MS 1000000LL
+
+struct simulation_settings {
+    int window_size = DEFAULT_WINDOW_SIZE;
+    int payload_size = DEFAULT_PAYLOAD_SIZE;
+    int sequence_space = 0;         // 0 picks the smallest power of two above the window, at least the default
+    int timeout_ms = DEFAULT_TIMEOUT_MS;
+    int eot_timeout_ms = DEFAULT_TIMEOUT_MS;
+    int retransmission = RETRANSMIT_GBN;
+    bool handshake_flag = true;
+
+    long long file_size = DEFAULT_SIMULATED_FILE_SIZE;
+    double drop_rate = 0;           // probability that a datagram is lost, in each direction
+    double delay_ms = DEFAULT_SIMULATED_DELAY_MS;  // one-way propagation delay
+    double reorder_rate = 0;        // probability that a datagram is held back, in each direction
+    double reorder_delay_ms = 0;    // how long at most, as later datagrams overtake it
+    double bandwidth = 0;           // bytes per second in each direction, 0 for no limit
+    double queue_limit = 0;         // bytes that may wait for the link before it drops datagrams, 0 for no limit
+    uint64_t seed = 1;
+
+    const replay_trace *replay = NULL;  // losses and delays of a captured transfer, instead of drop_rate and delay_ms
+};
+
+struct simulation_result {
+    bool completed = false;         // the client received the server's EOT
+    double completion_s = 0;        // virtual time from the first SYN to the server's EOT
+    double goodput = 0;             // file bytes per virtual second
+    double latency_mean_ms = 0;     // first transmission of a packet to its in-order arrival at the server
+    double latency_p50_ms = 0;
+    double latency_p99_ms = 0;
+    long long packets_sent = 0;     // data packets, retransmissions included
+    long long packets_delivered = 0;    // data packets the server wrote
+    long long misdelivered = 0;     // of which carried another chunk than the one due, a stale copy mistaken for it
+    long long packets_retransmitted = 0;
+    long long timeouts = 0;
+    long long rewinds = 0;
+    long long datagrams_lost = 0;   // in either direction: dropped, or turned away by a full queue
+    long long events = 0;           // datagrams sent or delivered, and timer expiries
+};
+
+// One direction of the channel. A datagram leaves once the ones before it have (with a bandwidth limit) and arrives
+// delay later, unless it is dropped, or finds queue_limit bytes waiting, like a full socket buffer. It arrives up to
+// reorder_delay_ns later when it is held back. When a capture is replayed,
+// each datagram is dropped or delayed like the datagram sent in its place in the capture (see trace_replay.h).
+struct simulated_link {
+    double drop_rate = 0;
+    long long delay_ns = 0;
+    double reorder_rate = 0;
+    long long reorder_delay_ns = 0;
+    double nanoseconds_per_byte = 0;
+    double queue_limit = 0;
+    long long busy_until = 0;
+
+    const std::vector<replayed_datagram> *replay = NULL;  // the captured fates, in place of drop_rate and delay_ns
+    size_t replayed = 0;
+    long long last_arrival = 0;     // a replayed link delivers in order, like the fixed delay does
+    long long lost = 0;
+
+    bool transmit(long long now, int length, std::mt19937_64 &random, long long &arrival);
+};
+
+enum simulated_event_kind {
+    EVENT_DATA_AT_SERVER = 0,
+    EVENT_EOT_AT_SERVER = 1,
+    EVENT_ACK_AT_CLIENT = 2,
+    EVENT_EOT_AT_CLIENT = 3
+};
+
+struct simulated_event {
+    long long time;
+    long long order;                // ties are delivered in the order they were scheduled
+    int kind;
+    int sequence_number;
+    int chunk_index;
+
+    bool operator>(const simulated_event &other) const {
+        return time != other.time ? time > other.time : order > other.order;
+    }
+};
+
+class gbn_simulation {
+
+private:
+
+    simulation_settings settings;
+    simulation_result result;
+    std::mt19937_64 random;
+
+    std::priority_queue<simulated_event, std::vector<simulated_event>, std::greater<simulated_event>> events;
+    long long now = 0;
+    long long next_order = 0;
+    simulated_link forward, backward;
+
+    // The client: the binaries' sender, with the simulation as its transport.
+    gbn_sender<modular_sequence_space, chosen_retransmission, silent_trace> sender;
+    int total_packets = 0;
+    int next_chunk = 0;
+    std::vector<long long> first_sent;          // per chunk, for the latency
+
+    int eot_attempts = 0;
+    long long eot_deadline = -1;
+    bool client_done = false;
+
+    // The server: the binaries' receiver.
+    gbn_receiver<modular_sequence_space> receiver;
+    std::vector<float> latencies_ms;
+
+    long long now_ms() const { return now / NANOSECONDS_PER_MS; }
+    void schedule(simulated_link &link, int length, int kind, int sequence_number, int chunk_index);
+    int data_length(int sequence_number, int chunk_index) const;
+
+    bool handshake();
+    void send_data(int sequence_number, int chunk_index);
+    void client_send();
+    void client_acknowledgement(int sequence_number);
+    void client_timers();
+    void client_eot();
+    void server_receive(const simulated_event &event);
+
+public:
+
+    explicit gbn_simulation(const simulation_settings &settings);
+
+    simulation_result run();
+
+    // The sender's transport (see gbn_sender.h).
+    bool resend(int sequence_number, int chunk_index);
+};
+
+#endif
@@ -0,0 +1,227 @@
+/*
+
+ * Description:
+   The simulator's command line (see simulator.h). For every combination of the windows and drop rates given, it runs
+   --runs sessions with different seeds and prints one CSV line with their averages.
+
+ */
+
+#include "simulator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+
+using namespace std;
+
+static const struct option long_options[] = {
+    {"window",          required_argument, NULL, 'w'},
+    {"drop",            required_argument, NULL, 'd'},
+    {"payload",         required_argument, NULL, 'p'},
+    {"sequence-space",  required_argument, NULL, 's'},
+    {"timeout",         required_argument, NULL, 't'},
+    {"eot-timeout",     required_argument, NULL, 'e'},
+    {"handshake",       required_argument, NULL, 'H'},
+    {"retransmission",  required_argument, NULL, 'r'},
+    {"file-size",       required_argument, NULL, 'f'},
+    {"delay",           required_argument, NULL, 'D'},
+    {"bandwidth",       required_argument, NULL, 'b'},
+    {"queue",           required_argument, NULL, 'q'},
+    {"reorder",         required_argument, NULL, 'o'},
+    {"reorder-delay",   required_argument, NULL, 'O'},
+    {"runs",            required_argument, NULL, 'n'},
+    {"seed",            required_argument, NULL, 'S'},
+    {"replay",          required_argument, NULL, 'R'},
+    {"help",            no_argument,       NULL, 'h'},
+    {NULL, 0, NULL, 0}
+};
+
+static void print_usage() {
+
+    fprintf(stderr, "Usage: ./simulator [options]\n\n");
+    fprintf(stderr, "  -w, --window LIST           comma-separated window sizes to sweep (default %d)\n",
+            DEFAULT_WINDOW_SIZE);
+    fprintf(stderr, "  -d, --drop LIST             comma-separated drop rates to sweep (default 0)\n");
+    fprintf(stderr, "  -p, --payload N             payload size per packet (default %d)\n", DEFAULT_PAYLOAD_SIZE);
+    fprintf(stderr, "  -s, --sequence-space N      number of sequence numbers; by default the smallest power of two\n");
+    fprintf(stderr, "                              above the window, at least %d\n", DEFAULT_SEQUENCE_SPACE);
+    fprintf(stderr, "  -t, --timeout MS            retransmission timeout bound (default %d)\n", DEFAULT_TIMEOUT_MS);
+    fprintf(stderr, "  -e, --eot-timeout MS        time to wait for the EOT reply (default %d)\n", DEFAULT_TIMEOUT_MS);
+    fprintf(stderr, "  -H, --handshake 0|1         measure the round trip with a SYN exchange first (default 1)\n");
+    fprintf(stderr, "  -r, --retransmission MODE   gbn or packet (default gbn)\n");
+    fprintf(stderr, "  -f, --file-size BYTES       size of the simulated file (default %d)\n",
+            DEFAULT_SIMULATED_FILE_SIZE);
+    fprintf(stderr, "  -D, --delay MS              one-way propagation delay (default %g)\n",
+            DEFAULT_SIMULATED_DELAY_MS);
+    fprintf(stderr, "  -b, --bandwidth BYTES/S     link rate in each direction, 0 for no limit (default 0)\n");
+    fprintf(stderr, "  -q, --queue BYTES           bytes a limited link queues before it drops (default 0, none)\n");
+    fprintf(stderr, "  -o, --reorder RATE          share of datagrams that later ones overtake (default 0)\n");
+    fprintf(stderr, "  -O, --reorder-delay MS      how long a held-back datagram waits at most (default 0)\n");
+    fprintf(stderr, "  -n, --runs N                sessions per point, each with its own seed (default 1)\n");
+    fprintf(stderr, "  -S, --seed N                seed of the first session (default 1)\n");
+    fprintf(stderr, "  -R, --replay CLIENT,SERVER  replay the losses and delays of the transfer captured in the\n");
+    fprintf(stderr, "                              client's and the server's --capture files instead of --drop\n");
+    fprintf(stderr, "                              and --delay; the window, payload, sequence space and file size\n");
+    fprintf(stderr, "                              default to the captured transfer's\n");
+}
+
+static bool parse_number(const char *value, double minimum, double maximum, double &result) {
+
+    char *end;
+    errno = 0;
+    double parsed = strtod(value, &end);
+
+    if (errno != 0 || end == value || *end != '\0' || parsed < minimum || parsed > maximum) return false;
+
+    result = parsed;
+    return true;
+}
+
+static bool parse_list(const char *value, double minimum, double maximum, vector<double> &list) {
+
+    string text(value);
+    size_t start = 0;
+    list.clear();
+
+    while (start <= text.size()) {
+
+        size_t end = text.find(',', start);
+        if (end == string::npos) end = text.size();
+
+        double number;
+        if (!parse_number(text.substr(start, end - start).c_str(), minimum, maximum, number)) return false;
+
+        list.push_back(number);
+        start = end + 1;
+    }
+
+    return !list.empty();
+}
+
+int main(int argc, char *argv[]) {
+
+    simulation_settings settings;
+    vector<double> windows(1, DEFAULT_WINDOW_SIZE), drop_rates(1, 0);
+    double number;
+    int option, runs = 1;
+    bool valid = true;
+    string given;               // the options given on the command line, which a replay does not override
+    replay_trace replay;
+
+    while ((option = getopt_long(argc, argv, "w:d:p:s:t:e:H:r:f:D:b:q:o:O:n:S:R:h", long_options, NULL)) != -1) {
+
+        given += (char) option;
+
+        switch (option) {
+            case 'w': valid = parse_list(optarg, 1, 1 << 20, windows); break;
+            case 'd': valid = parse_list(optarg, 0, 0.99, drop_rates); break;
+            case 'p': valid = parse_number(optarg, 1, MAX_PAYLOAD_SIZE, number); settings.payload_size = number; break;
+            case 's': valid = parse_number(optarg, 2, 1 << 30, number); settings.sequence_space = number; break;
+            case 't': valid = parse_number(optarg, 1, 3600000, number); settings.timeout_ms = number; break;
+            case 'e': valid = parse_number(optarg, 1, 3600000, number); settings.eot_timeout_ms = number; break;
+            case 'H': valid = parse_number(optarg, 0, 1, number); settings.handshake_flag = (number == 1); break;
+            case 'r':
+                settings.retransmission = retransmission_from_name(optarg);
+                valid = (settings.retransmission != -1);
+                break;
+            case 'f': valid = parse_number(optarg, 0, 1e15, number); settings.file_size = (long long) number; break;
+            case 'D': valid = parse_number(optarg, 0, 3600000, settings.delay_ms); break;
+            case 'b': valid = parse_number(optarg, 0, 1e15, settings.bandwidth); break;
+            case 'q': valid = parse_number(optarg, 0, 1e15, settings.queue_limit); break;
+            case 'o': valid = parse_number(optarg, 0, 1, settings.reorder_rate); break;
+            case 'O': valid = parse_number(optarg, 0, 3600000, settings.reorder_delay_ms); break;
+            case 'n': valid = parse_number(optarg, 1, 1000000, number); runs = number; break;
+            case 'S': valid = parse_number(optarg, 0, 1e18, number); settings.seed = (uint64_t) number; break;
+            case 'R': {
+                const char *separator = strchr(optarg, ',');
+                valid = (separator != NULL);
+                if (valid && !load_replay(string(optarg, separator - optarg).c_str(), separator + 1, replay)) {
+                    exit(EXIT_FAILURE);
+                }
+                settings.replay = &replay;
+                break;
+            }
+            case 'h': print_usage(); exit(EXIT_SUCCESS);
+            default: print_usage(); exit(EXIT_FAILURE);
+        }
+
+        if (!valid) {
+            fprintf(stderr, "invalid value for -%c: %s\n", option, optarg);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // A replayed transfer is simulated with the settings its handshake settled on, unless told otherwise.
+    if (settings.replay != NULL) {
+
+        describe_replay(replay, stderr);
+
+        if (replay.negotiated) {
+            if (given.find('w') == string::npos) windows.assign(1, replay.parameters.window_size);
+            if (given.find('p') == string::npos) settings.payload_size = replay.parameters.payload_size;
+            if (given.find('s') == string::npos) settings.sequence_space = replay.parameters.sequence_space;
+        }
+
+        if (replay.file_size >= 0 && given.find('f') == string::npos) settings.file_size = replay.file_size;
+    }
+
+    for (size_t position = 0; position < windows.size(); position++) {
+        if (settings.sequence_space != 0 && (int) windows[position] >= settings.sequence_space) {
+            fprintf(stderr, "simulator: the window size (%d) must be smaller than the sequence space (%d)\n",
+                    (int) windows[position], settings.sequence_space);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("window,drop,runs,completed,completion_s,goodput_bytes_per_s,latency_mean_ms,latency_p50_ms,");
+    printf("latency_p99_ms,packets_sent,retransmitted,timeouts,rewinds,events_per_s,misdelivered\n");
+
+    for (size_t window = 0; window < windows.size(); window++) {
+        for (size_t drop = 0; drop < drop_rates.size(); drop++) {
+
+            simulation_result sum;
+            int completed = 0;
+            struct timespec started, finished;
+
+            clock_gettime(CLOCK_MONOTONIC, &started);
+
+            for (int run = 0; run < runs; run++) {
+
+                simulation_settings point = settings;
+                point.window_size = (int) windows[window];
+                point.drop_rate = drop_rates[drop];
+                point.seed = settings.seed + run;
+
+                simulation_result result = gbn_simulation(point).run();
+
+                completed += result.completed ? 1 : 0;
+                sum.completion_s += result.completion_s;
+                sum.goodput += result.goodput;
+                sum.latency_mean_ms += result.latency_mean_ms;
+                sum.latency_p50_ms += result.latency_p50_ms;
+                sum.latency_p99_ms += result.latency_p99_ms;
+                sum.packets_sent += result.packets_sent;
+                sum.packets_retransmitted += result.packets_retransmitted;
+                sum.timeouts += result.timeouts;
+                sum.rewinds += result.rewinds;
+                sum.events += result.events;
+                sum.misdelivered += result.misdelivered;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &finished);
+            double wall_s = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+
+            printf("%d,%g,%d,%d,%.6f,%.1f,%.3f,%.3f,%.3f,%.1f,%.1f,%.1f,%.1f,%.0f,%.1f\n", (int) windows[window],
+                   drop_rates[drop], runs, completed, sum.completion_s / runs, sum.goodput / runs,
+                   sum.latency_mean_ms / runs, sum.latency_p50_ms / runs, sum.latency_p99_ms / runs,
+                   (double) sum.packets_sent / runs, (double) sum.packets_retransmitted / runs,
+                   (double) sum.timeouts / runs, (double) sum.rewinds / runs,
+                   wall_s > 0 ? sum.events / wall_s : 0, (double) sum.misdelivered / runs);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+
+ * Description:
+   Kernel-side tuning of the session socket. See socket_tuning.h.
+
+ */
+
+#include "socket_tuning.h"
+
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <atomic>
+#include <algorithm>
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+using namespace std;
+
+// The highest SO_RXQ_OVFL count seen. The kernel counts from when the option was set, so the latest value is the
+// total. The client's acknowledgement thread receives too.
+static atomic<uint32_t> highest_drop_count(0);
+
+// Raises one of the socket's buffers to bytes. The FORCE variant passes net.core.rmem_max/wmem_max when the process
+// may do so; otherwise the kernel caps the size there.
+static int raise_buffer(int socket_fd, int option, int force_option, int bytes, bool only_grow) {
+
+    int current;
+    socklen_t length = sizeof(current);
+
+    if (getsockopt(socket_fd, SOL_SOCKET, option, &current, &length) == -1) return -1;
+    if (only_grow && current >= bytes) return current;
+
+    if (setsockopt(socket_fd, SOL_SOCKET, force_option, &bytes, sizeof(bytes)) == -1) {
+        setsockopt(socket_fd, SOL_SOCKET, option, &bytes, sizeof(bytes));
+    }
+
+    length = sizeof(current);
+    if (getsockopt(socket_fd, SOL_SOCKET, option, &current, &length) == -1) return -1;
+    return current;
+}
+
+// Sizes both buffers to fixed_bytes, or, when that is 0, makes them hold at least datagrams datagrams of
+// datagram_length bytes. Returns the sizes the kernel reports afterwards, which count its overhead too.
+socket_buffer_sizes size_socket_buffers(int socket_fd, int datagrams, int datagram_length, int fixed_bytes) {
+
+    long long wanted = (long long) datagrams * (datagram_length + SOCKET_BUFFER_OVERHEAD);
+    int bytes = (fixed_bytes > 0) ? fixed_bytes : (int) min(wanted, (long long) (1 << 30));
+    bool only_grow = (fixed_bytes == 0);
+
+    socket_buffer_sizes sizes;
+    sizes.send_bytes = raise_buffer(socket_fd, SO_SNDBUF, SO_SNDBUFFORCE, bytes, only_grow);
+    sizes.receive_bytes = raise_buffer(socket_fd, SO_RCVBUF, SO_RCVBUFFORCE, bytes, only_grow);
+
+    return sizes;
+}
+
+// Makes blocking receives poll the device queue for up to microseconds before sleeping. Values above
+// net.core.busy_read need CAP_NET_ADMIN.
+bool enable_busy_poll(int socket_fd, int microseconds) {
+
+    return setsockopt(socket_fd, SOL_SOCKET, SO_BUSY_POLL, &microseconds, sizeof(microseconds)) == 0;
+}
+
+bool enable_drop_counter(int socket_fd) {
+
+    int one = 1;
+    return setsockopt(socket_fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) == 0;
+}
+
+bool enable_receive_offload(int socket_fd) {
+
+    int one = 1;
+    return setsockopt(socket_fd, IPPROTO_UDP, UDP_GRO, &one, sizeof(one)) == 0;
+}
+
+// Asks for message's data to be sent as datagrams of segment_length bytes each, the last one possibly shorter.
+// control needs SEGMENT_CONTROL_LENGTH bytes.
+void set_segment_size(struct msghdr &message, char *control, int segment_length) {
+
+    memset(control, 0, SEGMENT_CONTROL_LENGTH);
+    message.msg_control = control;
+    message.msg_controllen = SEGMENT_CONTROL_LENGTH;
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = IPPROTO_UDP;
+    header->cmsg_type = UDP_SEGMENT;
+    header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+    uint16_t size = (uint16_t) segment_length;
+    memcpy(CMSG_DATA(header), &size, sizeof(size));
+}
+
+// Records the drop count of a received message. Returns the length of the datagrams the kernel coalesced into it,
+// or 0 if it holds a single datagram.
+int read_receive_control(const struct msghdr &message) {
+
+    int segment_length = 0;
+
+    for (struct cmsghdr *header = CMSG_FIRSTHDR((struct msghdr *) &message); header != NULL;
+         header = CMSG_NXTHDR((struct msghdr *) &message, header)) {
+
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SO_RXQ_OVFL) {
+
+            uint32_t dropped;
+            memcpy(&dropped, CMSG_DATA(header), sizeof(dropped));
+
+            uint32_t highest = highest_drop_count.load(memory_order_relaxed);
+            while (dropped > highest && !highest_drop_count.compare_exchange_weak(highest, dropped)) {}
+
+        } else if (header->cmsg_level == IPPROTO_UDP && header->cmsg_type == UDP_GRO) {
+            memcpy(&segment_length, CMSG_DATA(header), sizeof(segment_length));
+        }
+    }
+
+    return segment_length;
+}
+
+// recvfrom() that also reads the control messages. from and segment_length may be NULL.
+int receive_datagram(int socket_fd, char *buffer, int buffer_length, int flags, struct sockaddr_storage *from,
+                     socklen_t *from_length, int *segment_length) {
+
+    char control[RECEIVE_CONTROL_LENGTH];
+    struct iovec piece = {buffer, (size_t) buffer_length};
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_name = from;
+    message.msg_namelen = (from != NULL) ? *from_length : 0;
+    message.msg_iov = &piece;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    int num_bytes = recvmsg(socket_fd, &message, flags);
+    if (num_bytes == -1) return -1;
+
+    if (from != NULL) *from_length = message.msg_namelen;
+
+    int coalesced_length = read_receive_control(message);
+    if (segment_length != NULL) *segment_length = coalesced_length;
+
+    return num_bytes;
+}
+
+uint32_t kernel_drops() {
+    return highest_drop_count.load(memory_order_relaxed);
+}
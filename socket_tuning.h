@@ -0,0 +1,51 @@
+/*
+
+ * Description:
+   Kernel-side tuning of the session socket. The socket buffers are sized to hold a full window of datagrams, so a
+   burst is not dropped before the protocol sees it (--socket-buffer overrides the size). --busy-poll sets
+   SO_BUSY_POLL, and --segmentation-offload lets the client hand runs of equally long data packets to the kernel in
+   one sendmsg() (UDP_SEGMENT, GSO) and the server receive them coalesced (UDP_GRO). SO_RXQ_OVFL is always requested,
+   and the number of datagrams the kernel dropped because the receive buffer was full is read from every datagram
+   received through receive_datagram() or read_receive_control().
+
+ */
+
+#ifndef SOCKET_TUNING_H
+#define SOCKET_TUNING_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+// Memory the kernel charges to a socket buffer for each datagram beyond its payload (sk_buff and bookkeeping).
+#define SOCKET_BUFFER_OVERHEAD 1024
+
+// Limits of a single UDP_SEGMENT send: the kernel's segment count limit, and the largest UDP payload.
+#define GSO_MAX_SEGMENTS 64
+#define GSO_MAX_BYTES 65507
+
+// With MSG_ZEROCOPY every piece of a send becomes a page fragment of one buffer, which holds at most 17 (MAX_SKB_FRAGS).
+// The client gathers two pieces per packet.
+#define GSO_MAX_ZERO_COPY_SEGMENTS 8
+
+// Room for the control messages read_receive_control() looks at, and for the one set_segment_size() adds.
+#define RECEIVE_CONTROL_LENGTH (CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int)))
+#define SEGMENT_CONTROL_LENGTH CMSG_SPACE(sizeof(uint16_t))
+
+struct socket_buffer_sizes {
+    int send_bytes;
+    int receive_bytes;
+};
+
+socket_buffer_sizes size_socket_buffers(int socket_fd, int datagrams, int datagram_length, int fixed_bytes);
+bool enable_busy_poll(int socket_fd, int microseconds);
+bool enable_drop_counter(int socket_fd);
+bool enable_receive_offload(int socket_fd);
+
+void set_segment_size(struct msghdr &message, char *control, int segment_length);
+int read_receive_control(const struct msghdr &message);
+int receive_datagram(int socket_fd, char *buffer, int buffer_length, int flags, struct sockaddr_storage *from,
+                     socklen_t *from_length, int *segment_length);
+
+uint32_t kernel_drops();
+
+#endif
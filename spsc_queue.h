@@ -0,0 +1,74 @@
+/*
+
+ * Description:
+   A bounded lock-free queue for exactly one producer thread and one consumer thread, used to pass work between the
+   stages of the client's pipeline. The producer only writes tail and the consumer only writes head, so each side needs
+   a single atomic store per item and neither ever waits on a lock.
+
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+template <typename T>
+class spsc_queue {
+
+private:
+
+    std::vector<T> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head{0};  // next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail{0};  // next slot to push, written by the producer
+
+public:
+
+    // The capacity is rounded up to a power of two.
+    explicit spsc_queue(size_t capacity) {
+
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    bool push(const T &item) {
+
+        size_t position = tail.load(std::memory_order_relaxed);
+        if (position - head.load(std::memory_order_acquire) == slots.size()) return false;
+
+        slots[position & mask] = item;
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+
+        size_t position = head.load(std::memory_order_relaxed);
+        if (position == tail.load(std::memory_order_acquire)) return false;
+
+        item = slots[position & mask];
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// Waits a little before a full or empty queue is tried again: a few yields first, then short sleeps so that a stage
+// with nothing to do does not hold a core.
+inline void queue_backoff(int &attempts) {
+
+    if (attempts++ < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+#endif
@@ -0,0 +1,159 @@
+/*
+
+ * Description:
+   Hierarchical timer wheel. See timer_wheel.h.
+
+ */
+
+#include "timer_wheel.h"
+
+using namespace std;
+
+#define LEVEL_SHIFT(level) (TIMER_WHEEL_SLOT_BITS * (level))
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+timer_wheel::timer_wheel(int capacity) : timers(capacity) {
+
+    for (int slot = 0; slot < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; slot++) {
+        slots[slot] = -1;
+    }
+}
+
+void timer_wheel::start(long long now_ms) {
+
+    clear();
+    current_tick = now_ms;
+}
+
+// Puts a timer in the slot for its deadline. The level is the lowest one whose span still holds the deadline, i.e. the
+// deadline and the current tick differ in no higher bits, so the slot is never behind the level's current slot. The
+// top level wraps around instead; deadlines more than one turn ahead wait in its last slot and are placed again then.
+void timer_wheel::insert(int id) {
+
+    timer &entry = timers[id];
+    int level = 0, slot;
+
+    while (level < TIMER_WHEEL_LEVELS - 1 && ((entry.deadline ^ current_tick) >> LEVEL_SHIFT(level + 1)) != 0) {
+        level++;
+    }
+
+    long long distance = (entry.deadline >> LEVEL_SHIFT(level)) - (current_tick >> LEVEL_SHIFT(level));
+
+    if (distance >= TIMER_WHEEL_SLOTS) {
+        slot = (current_tick >> LEVEL_SHIFT(level)) + TIMER_WHEEL_SLOTS - 1;
+    } else {
+        slot = entry.deadline >> LEVEL_SHIFT(level);
+    }
+
+    slot &= SLOT_MASK;
+
+    int list = level * TIMER_WHEEL_SLOTS + slot;
+
+    entry.slot = list;
+    entry.previous = -1;
+    entry.next = slots[list];
+    if (slots[list] != -1) timers[slots[list]].previous = id;
+    slots[list] = id;
+}
+
+void timer_wheel::unlink(int id) {
+
+    timer &entry = timers[id];
+
+    if (entry.previous != -1) timers[entry.previous].next = entry.next;
+    else slots[entry.slot] = entry.next;
+
+    if (entry.next != -1) timers[entry.next].previous = entry.previous;
+
+    entry.slot = entry.previous = entry.next = -1;
+}
+
+void timer_wheel::arm(int id, long long deadline_ms) {
+
+    if (armed(id)) unlink(id);
+    else armed_count++;
+
+    // The slot of the current tick has already been expired, so a deadline that is due goes to the next one.
+    timers[id].deadline = (deadline_ms > current_tick) ? deadline_ms : current_tick + 1;
+    insert(id);
+}
+
+void timer_wheel::cancel(int id) {
+
+    if (!armed(id)) return;
+
+    unlink(id);
+    armed_count--;
+}
+
+void timer_wheel::clear() {
+
+    for (int id = 0; id < (int) timers.size(); id++) {
+        timers[id].slot = timers[id].previous = timers[id].next = -1;
+    }
+
+    for (int slot = 0; slot < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; slot++) {
+        slots[slot] = -1;
+    }
+
+    armed_count = 0;
+}
+
+// Spreads the current slot of a level over the levels below, once the clock has reached it. Timers due at the current
+// tick land in its level 0 slot, which advance() expires next.
+void timer_wheel::cascade(int level) {
+
+    int list = level * TIMER_WHEEL_SLOTS + ((current_tick >> LEVEL_SHIFT(level)) & SLOT_MASK);
+    int id = slots[list];
+
+    slots[list] = -1;
+
+    while (id != -1) {
+        int next = timers[id].next;
+        insert(id);
+        id = next;
+    }
+}
+
+bool timer_wheel::advance(long long now_ms, vector<int> &expired) {
+
+    bool any_expired = false;
+
+    while (current_tick < now_ms) {
+
+        // With nothing armed there is nothing to move, so the clock can jump.
+        if (armed_count == 0) {
+            current_tick = now_ms;
+            break;
+        }
+
+        current_tick++;
+
+        for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((current_tick & ((1LL << LEVEL_SHIFT(level)) - 1)) == 0) cascade(level);
+        }
+
+        int list = current_tick & SLOT_MASK;
+
+        while (slots[list] != -1) {
+            int id = slots[list];
+            unlink(id);
+            armed_count--;
+            expired.push_back(id);
+            any_expired = true;
+        }
+    }
+
+    return any_expired;
+}
+
+long long timer_wheel::next_deadline() const {
+
+    if (armed_count == 0) return -1;
+
+    // Level 0 holds one tick per slot. Past its end, the next slot of level 1 is spread, which may bring timers due
+    // right then.
+    for (long long tick = current_tick + 1; ; tick++) {
+        if (slots[tick & SLOT_MASK] != -1 || (tick & SLOT_MASK) == 0) return tick;
+    }
+}
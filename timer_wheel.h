@@ -0,0 +1,62 @@
+/*
+
+ * Description:
+   A hierarchical timer wheel for the client's retransmission deadlines. Timers are numbered 0 .. capacity - 1 and
+   kept in doubly-linked slot lists, so arming and cancelling a timer are O(1) whatever the number of timers armed.
+   Level 0 has one slot per millisecond for the next 64 ms; each further level covers 64 times the span of the one
+   below, and its slots are spread over the level below as time reaches them. Advancing the clock costs O(1) per tick
+   plus O(1) per expired or moved timer.
+
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <vector>
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+class timer_wheel {
+
+private:
+
+    struct timer {
+        long long deadline = 0;
+        int previous = -1;
+        int next = -1;
+        int slot = -1;  // level * TIMER_WHEEL_SLOTS + slot while armed, -1 otherwise
+    };
+
+    std::vector<timer> timers;
+    int slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];  // first timer of every slot list, -1 if empty
+    long long current_tick = 0;
+    int armed_count = 0;
+
+    void insert(int id);
+    void unlink(int id);
+    void cascade(int level);
+
+public:
+
+    explicit timer_wheel(int capacity);
+
+    void start(long long now_ms);
+    int capacity() const { return timers.size(); }
+
+    void arm(int id, long long deadline_ms);
+    void cancel(int id);
+    void clear();
+
+    bool armed(int id) const { return timers[id].slot != -1; }
+    bool empty() const { return armed_count == 0; }
+
+    // Moves the clock to now_ms and appends the timers that expired to expired. Returns true if any did.
+    bool advance(long long now_ms, std::vector<int> &expired);
+
+    // The earliest time advance() may find a timer expired, -1 if none is armed.
+    long long next_deadline() const;
+};
+
+#endif
@@ -0,0 +1,191 @@
+/*
+
+ * Description:
+   Matching of the datagrams of two captures into a replayable loss and delay pattern. See trace_replay.h.
+
+ */
+
+#include "trace_replay.h"
+#include "packet_capture.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <string>
+
+using namespace std;
+
+// The sending and the receiving end of one direction, by content.
+struct datagram_copies {
+    vector<int> sent;                   // positions in the sender's order
+    vector<long long> sent_ns, arrived_ns;
+};
+
+static void collect(const vector<captured_datagram> &sender, const vector<captured_datagram> &receiver,
+                    map<string, datagram_copies> &copies, vector<long long> &send_times) {
+
+    for (size_t position = 0; position < sender.size(); position++) {
+
+        if (sender[position].direction != CAPTURE_OUTBOUND) continue;
+
+        datagram_copies &entry = copies[sender[position].data];
+        entry.sent.push_back((int) send_times.size());
+        entry.sent_ns.push_back(sender[position].time_ns);
+        send_times.push_back(sender[position].time_ns);
+    }
+
+    for (size_t position = 0; position < receiver.size(); position++) {
+
+        if (receiver[position].direction != CAPTURE_INBOUND) continue;
+
+        map<string, datagram_copies>::iterator entry = copies.find(receiver[position].data);
+        if (entry != copies.end()) entry->second.arrived_ns.push_back(receiver[position].time_ns);
+    }
+}
+
+// The shortest arrival time minus send time among datagrams sent and received once, on the two clocks as they are.
+static bool shortest_delay(const map<string, datagram_copies> &copies, long long &shortest_ns) {
+
+    bool found = false;
+
+    for (map<string, datagram_copies>::const_iterator entry = copies.begin(); entry != copies.end(); entry++) {
+
+        if (entry->second.sent_ns.size() != 1 || entry->second.arrived_ns.size() != 1) continue;
+
+        long long delay_ns = entry->second.arrived_ns[0] - entry->second.sent_ns[0];
+        if (!found || delay_ns < shortest_ns) shortest_ns = delay_ns;
+        found = true;
+    }
+
+    return found;
+}
+
+// Gives every datagram of a direction its fate. offset_ns is taken off the receiver's timestamps.
+static void match(const map<string, datagram_copies> &copies, size_t count, long long offset_ns,
+                  vector<replayed_datagram> &fates) {
+
+    replayed_datagram lost = {false, 0};
+    fates.assign(count, lost);
+
+    for (map<string, datagram_copies>::const_iterator entry = copies.begin(); entry != copies.end(); entry++) {
+
+        const datagram_copies &copy = entry->second;
+        vector<bool> matched(copy.sent.size(), false);
+
+        for (size_t arrival = 0; arrival < copy.arrived_ns.size(); arrival++) {
+
+            long long arrived_ns = copy.arrived_ns[arrival] - offset_ns;
+            int chosen = -1;
+
+            // The copy sent last before the arrival; failing that (the clocks are not quite lined up), the first.
+            for (size_t sent = 0; sent < copy.sent.size(); sent++) {
+                if (matched[sent]) continue;
+                if (copy.sent_ns[sent] <= arrived_ns || chosen == -1) chosen = (int) sent;
+                if (copy.sent_ns[sent] > arrived_ns) break;
+            }
+
+            if (chosen == -1) continue;  // delivered twice
+
+            matched[chosen] = true;
+            fates[copy.sent[chosen]].delivered = true;
+            fates[copy.sent[chosen]].delay_ns = max(0LL, arrived_ns - copy.sent_ns[chosen]);
+        }
+    }
+}
+
+// The settings of the handshake: the SYN-ACK the server sent, and the file size in the client's SYN.
+static void find_handshake(const vector<captured_datagram> &client, const vector<captured_datagram> &server,
+                           replay_trace &trace) {
+
+    int type, sequence_number, length, header_end;
+
+    for (size_t position = 0; position < server.size() && !trace.negotiated; position++) {
+
+        const string &data = server[position].data;
+
+        if (server[position].direction == CAPTURE_OUTBOUND &&
+            sscanf(data.c_str(), "%d %d %d %n", &type, &sequence_number, &length, &header_end) == 3 &&
+            type == SYN_ACK_PACKET_TYPE && header_end + length <= (int) data.size()) {
+            trace.negotiated = decode_parameters(data.c_str() + header_end, length, trace.parameters);
+        }
+    }
+
+    for (size_t position = 0; position < client.size() && trace.file_size == -1; position++) {
+
+        const string &data = client[position].data;
+        session_parameters offer;
+
+        if (client[position].direction == CAPTURE_OUTBOUND &&
+            sscanf(data.c_str(), "%d %d %d %n", &type, &sequence_number, &length, &header_end) == 3 &&
+            type == SYN_PACKET_TYPE && header_end + length <= (int) data.size() &&
+            decode_parameters(data.c_str() + header_end, length, offer)) {
+            trace.file_size = offer.file_size;
+        }
+    }
+}
+
+bool load_replay(const char *client_capture, const char *server_capture, replay_trace &trace) {
+
+    vector<captured_datagram> client, server;
+
+    if (!read_capture(client_capture, client) || !read_capture(server_capture, server)) return false;
+
+    map<string, datagram_copies> forward, backward;
+    vector<long long> forward_times, backward_times;
+
+    collect(client, server, forward, forward_times);
+    collect(server, client, backward, backward_times);
+
+    if (forward_times.empty() || backward_times.empty()) {
+        fprintf(stderr, "the captures hold no datagrams sent in one of the directions\n");
+        return false;
+    }
+
+    // raw forward = delay + offset and raw backward = delay - offset, for the same shortest delay both ways. Clocks
+    // under which nothing arrives before it was sent (two captures on one host) are taken as they are.
+    long long shortest_forward_ns, shortest_backward_ns;
+    if (shortest_delay(forward, shortest_forward_ns) && shortest_delay(backward, shortest_backward_ns) &&
+        (shortest_forward_ns < 0 || shortest_backward_ns < 0)) {
+        trace.clock_offset_ns = (shortest_forward_ns - shortest_backward_ns) / 2;
+    }
+
+    match(forward, forward_times.size(), trace.clock_offset_ns, trace.forward);
+    match(backward, backward_times.size(), -trace.clock_offset_ns, trace.backward);
+
+    find_handshake(client, server, trace);
+    return true;
+}
+
+static void describe_direction(const char *name, const vector<replayed_datagram> &fates, FILE *output) {
+
+    vector<long long> delays;
+    for (size_t position = 0; position < fates.size(); position++) {
+        if (fates[position].delivered) delays.push_back(fates[position].delay_ns);
+    }
+
+    fprintf(output, "%s: %zu datagrams, %zu lost (%.2f%%)", name, fates.size(), fates.size() - delays.size(),
+            100.0 * (fates.size() - delays.size()) / fates.size());
+
+    if (!delays.empty()) {
+        sort(delays.begin(), delays.end());
+        fprintf(output, ", delay min %.3f ms, median %.3f ms, p99 %.3f ms", delays.front() / 1e6,
+                delays[delays.size() / 2] / 1e6, delays[delays.size() * 99 / 100] / 1e6);
+    }
+
+    fprintf(output, "\n");
+}
+
+void describe_replay(const replay_trace &trace, FILE *output) {
+
+    describe_direction("client to server", trace.forward, output);
+    describe_direction("server to client", trace.backward, output);
+    fprintf(output, "clock offset %.3f ms", trace.clock_offset_ns / 1e6);
+
+    if (trace.negotiated) {
+        fprintf(output, "; handshake: window %d, payload %d, sequence space %d", trace.parameters.window_size,
+                trace.parameters.payload_size, trace.parameters.sequence_space);
+    }
+
+    if (trace.file_size >= 0) fprintf(output, ", file of %lld bytes", trace.file_size);
+    fprintf(output, "\n");
+}
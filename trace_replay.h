@@ -0,0 +1,46 @@
+/*
+
+ * Description:
+   Turns the captures of both ends of a transfer (see packet_capture.h) into the loss and delay pattern it met, for the
+   simulator to play back. Every datagram one end sent is looked for among those the other end received, by its
+   content: found, it was delivered after the delay between the two timestamps; not found, it was lost. A datagram sent
+   several times with the same content (a retransmission, a repeated acknowledgement) is matched to the copy sent last
+   before it arrived.
+
+   The two clocks need not agree. If a datagram seems to arrive before it was sent, their offset is estimated from the
+   datagrams sent and received exactly once, taking the shortest delay to be the same in both directions, the way NTP
+   does; otherwise, as with two captures taken on one host, the timestamps are used as they are. The simulator then
+   gives the n-th datagram it sends in a direction the fate of the n-th datagram sent that way in the capture, and
+   starts over from the first once they run out. A build that sends the same datagrams as the captured one therefore
+   meets exactly the same losses and delays, and a different build meets the same pattern.
+
+ */
+
+#ifndef TRACE_REPLAY_H
+#define TRACE_REPLAY_H
+
+#include <stdio.h>
+#include <vector>
+#include "handshake.h"
+
+struct replayed_datagram {
+    bool delivered;
+    long long delay_ns;
+};
+
+struct replay_trace {
+    std::vector<replayed_datagram> forward;     // client to server, in the order the client sent them
+    std::vector<replayed_datagram> backward;    // server to client, in the order the server sent them
+    long long clock_offset_ns = 0;              // the server's clock minus the client's
+
+    bool negotiated = false;                    // the captures hold the handshake, with the settings below
+    session_parameters parameters;              // as the server accepted them
+    long long file_size = -1;                   // as the client's SYN gave it, -1 if it did not
+};
+
+bool load_replay(const char *client_capture, const char *server_capture, replay_trace &trace);
+
+// Prints how many datagrams each direction lost and how long the rest took.
+void describe_replay(const replay_trace &trace, FILE *output);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+
+ * Description:
+   Support for the zero-copy data path. See zerocopy.h.
+
+ */
+
+#include "zerocopy.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+// Reports after which MSG_ZEROCOPY is given up if the kernel copied every send anyway, as it does over loopback.
+#define ZEROCOPY_PROBE_REPORTS 32
+
+// Reads a header written with FIXED_HEADER_FORMAT. Returns false for anything else, such as the text headers of the
+// handshake and EOT packets.
+bool parse_fixed_header(const char *header, int &type, int &sequence_number, int &length) {
+
+    if (!isdigit(header[0]) || header[1] != ' ' || header[12] != ' ' || header[18] != ' ') {
+        return false;
+    }
+
+    for (int position = 2; position < 18; position++) {
+        if (position != 12 && !isdigit(header[position])) return false;
+    }
+
+    type = header[0] - '0';
+    sequence_number = atoi(header + 2);
+    length = atoi(header + 13);
+
+    return true;
+}
+
+bool zerocopy_tracker::enable(int socket_fd) {
+
+    int one = 1;
+    enabled_flag = (setsockopt(socket_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0);
+
+    return enabled_flag;
+}
+
+// Collects the completion reports waiting on the socket's error queue without blocking.
+void zerocopy_tracker::poll(int socket_fd) {
+
+    char control[128];
+
+    while (true) {
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        if (recvmsg(socket_fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) break;
+
+        for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != NULL;
+             header = CMSG_NXTHDR(&message, header)) {
+
+            struct sock_extended_err error;
+            memcpy(&error, CMSG_DATA(header), sizeof(error));
+
+            if (error.ee_errno != 0 || error.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+            if (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) copied_reports++;
+            else zero_copy_reports++;
+
+            finished[error.ee_info] = error.ee_data;
+        }
+    }
+
+    while (!finished.empty() && finished.begin()->first == completed_sends) {
+        completed_sends = finished.begin()->second + 1;
+        finished.erase(finished.begin());
+    }
+
+    if (enabled_flag && zero_copy_reports == 0 && copied_reports >= ZEROCOPY_PROBE_REPORTS) {
+        enabled_flag = false;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+
+ * Description:
+   Support for the zero-copy data path (--zero-copy). The client hands each packet to the kernel as two pieces with
+   sendmsg(), its header and the prepared chunk, so the chunk is not copied into a packet buffer, and adds
+   MSG_ZEROCOPY so the kernel can send from the chunk's pages too. Data packets then use a fixed-width header,
+
+     1 0000000005 01008 <checksum field><data>
+
+   which packet::deserialize() reads like any other. Because the header length is known in advance, the server can
+   receive with recvmsg() into two pieces, the header into its packet buffer and the data straight into the output
+   writer's block (see block_writer.h).
+
+ */
+
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+#include <stdint.h>
+#include <map>
+
+#define FIXED_HEADER_FORMAT "%d %010d %05d "
+#define FIXED_HEADER_LENGTH 19
+
+// Payload bytes that were copied between user-space buffers, and payload bytes that reached their final buffer (the
+// kernel on the client, the output block on the server) without such a copy.
+struct copy_counters {
+    long long bytes_copied = 0;
+    long long bytes_in_place = 0;
+};
+
+bool parse_fixed_header(const char *header, int &type, int &sequence_number, int &length);
+
+// Tracks MSG_ZEROCOPY sends. The kernel numbers them from 0 and reports finished ranges on the socket's error queue;
+// until a send is reported, its data must not change.
+class zerocopy_tracker {
+
+private:
+
+    bool enabled_flag = false;
+    uint32_t next_send = 0;
+    uint32_t completed_sends = 0;            // sends 0 .. completed_sends - 1 are finished
+    std::map<uint32_t, uint32_t> finished;   // ranges reported out of order, first -> last
+    long copied_reports = 0;
+    long zero_copy_reports = 0;
+
+public:
+
+    bool enable(int socket_fd);
+    bool enabled() const { return enabled_flag; }
+    void disable() { enabled_flag = false; }
+
+    uint32_t record_send() { return next_send++; }
+    uint32_t completed() const { return completed_sends; }
+    void poll(int socket_fd);
+
+    long copied() const { return copied_reports; }
+    long zero_copied() const { return zero_copy_reports; }
+};
+
+#endif